@@ -21,19 +21,173 @@ static void showHelp()
 {
     printf("Image convolution implementation\n");
     printf("  -d <Input image file path>\n");
-    printf("  -o <Output image file path>\n");
-    printf("  -m <Filter matrix file path>\n");
+    printf("  -o <Output image file path. One per filter, or one for all of "
+        "them (pixels made of the outputs of every filter)>\n");
+    printf("  -m <Filter matrix file path. Repeat for a bank of filters, or "
+        "separate the matrices of a file with blank lines>\n");
+    printf("  -g <Gaussian sigma in pixels, instead of a filter matrix>\n");
+    printf("  -n <Box passes of the Gaussian (1-%d). Optional, default: %d>\n",
+        CONV_MAX_BOX_PASSES, CONV_DEFAULT_BOX_PASSES);
     printf("  -y <Image height>\n");
     printf("  -x <Image width>\n");
     printf("  -s <Image pixel size. Optional, default: 1>\n");
+    printf("  -l <Image layout in memory: interleaved or planar. Optional, "
+        "default: interleaved>\n");
+    printf("  -f <Sample type of the files: u8, u16 or f32. Optional, "
+        "default: u8>\n");
+    printf("  -F <Sample type of the image while it is convolved: u8, u16 or "
+        "f32. Optional, default: the one of the files>\n");
+    printf("  -q <Fixed-point weights fractional bits (1-30). Optional>\n");
+    printf("  -b <Border mode: zero, clamp, mirror or wrap. Optional, default: "
+        "zero>\n");
+    printf("  -e <Engine: auto, direct, fft, box, winograd or sparse. "
+        "Optional, default: auto>\n");
+    printf("  -j Generates the vector kernel of every filter at runtime\n");
+    printf("  -t <Column block width in pixels. Optional, default: picked from "
+        "the cache sizes>\n");
+    printf("  -T <Threads per process. Optional, default: 1>\n");
+    printf("  -S <Thread scheduling: static or dynamic. Optional, default: "
+        "static>\n");
+    printf("  -p <Split of the image between the processes: auto, strips, "
+        "blocks (2D grid) or tiles (handed out on request). Optional, "
+        "default: auto>\n");
+    printf("  -D <Rows of the tiles. Optional, default: %d tiles per "
+        "process>\n", CMD_DEFAULT_TILES_PER_PROCESS);
+    printf("  -R Resident strips: the processes exchange the halos "
+        "themselves, while convolving the rows away from them\n");
+    printf("  -P <Rows of the chunks of the strips, streamed to the processes "
+        "and back while convolving. Optional, default: whole strips>\n");
+    printf("  -M Parallel I/O: every process reads and writes its own strip "
+        "of the files (MPI-IO)\n");
+    printf("  -r <Rows of the root process, relative to the ones of another "
+        "process, for strips (0 for none, as for tiles otherwise). "
+        "Optional, default: %g>\n",
+        CMD_DEFAULT_ROOT_SHARE);
+    printf("  -i <Convolution iterations. Optional, default: 1>\n");
+    printf("  -k <Iterations per halo exchange, or auto. Optional, default: "
+        "auto>\n");
+    printf("  -c <Stopping criterion of the iterations: none, l2 (Euclidean "
+        "distance) or max (largest change of a sample). Optional, default: "
+        "none>\n");
+    printf("  -E <Largest change of the last iteration. Optional, default: "
+        "%g>\n", CMD_DEFAULT_TOLERANCE);
     printf("  -v Increases console output verbosity\n");
     printf("  -h Prints this help message\n");
 }
 
+static int parseBorderMode(const char *name, ImgBorderMode *mode)
+{
+    if (strcmp(name, "zero") == 0)
+        *mode = IMG_BORDER_ZERO;
+    else if (strcmp(name, "clamp") == 0)
+        *mode = IMG_BORDER_CLAMP;
+    else if (strcmp(name, "mirror") == 0)
+        *mode = IMG_BORDER_MIRROR;
+    else if (strcmp(name, "wrap") == 0)
+        *mode = IMG_BORDER_WRAP;
+    else
+        return 0;
+
+    return 1;
+}
+
+static int parseLayout(const char *name, ImgLayout *layout)
+{
+    if (strcmp(name, "interleaved") == 0)
+        *layout = IMG_LAYOUT_INTERLEAVED;
+    else if (strcmp(name, "planar") == 0)
+        *layout = IMG_LAYOUT_PLANAR;
+    else
+        return 0;
+
+    return 1;
+}
+
+static int parseSampleType(const char *name, ImgSampleType *sampleType)
+{
+    if (strcmp(name, "u8") == 0)
+        *sampleType = IMG_SAMPLE_U8;
+    else if (strcmp(name, "u16") == 0)
+        *sampleType = IMG_SAMPLE_U16;
+    else if (strcmp(name, "f32") == 0)
+        *sampleType = IMG_SAMPLE_F32;
+    else
+        return 0;
+
+    return 1;
+}
+
+static int parseSplit(const char *name, CommSplit *split)
+{
+    if (strcmp(name, "auto") == 0)
+        *split = COMM_SPLIT_AUTO;
+    else if (strcmp(name, "strips") == 0)
+        *split = COMM_SPLIT_STRIPS;
+    else if (strcmp(name, "blocks") == 0)
+        *split = COMM_SPLIT_BLOCKS;
+    else if (strcmp(name, "tiles") == 0)
+        *split = COMM_SPLIT_TILES;
+    else
+        return 0;
+
+    return 1;
+}
+
+static int parseEngine(const char *name, ConvEngine *engine)
+{
+    if (strcmp(name, "auto") == 0)
+        *engine = CONV_ENGINE_AUTO;
+    else if (strcmp(name, "direct") == 0)
+        *engine = CONV_ENGINE_DIRECT;
+    else if (strcmp(name, "fft") == 0)
+        *engine = CONV_ENGINE_FFT;
+    else if (strcmp(name, "box") == 0)
+        *engine = CONV_ENGINE_BOX;
+    else if (strcmp(name, "winograd") == 0)
+        *engine = CONV_ENGINE_WINOGRAD;
+    else if (strcmp(name, "sparse") == 0)
+        *engine = CONV_ENGINE_SPARSE;
+    else
+        return 0;
+
+    return 1;
+}
+
+static int parseSchedule(const char *name, ConvSchedule *schedule)
+{
+    if (strcmp(name, "static") == 0)
+        *schedule = CONV_SCHEDULE_STATIC;
+    else if (strcmp(name, "dynamic") == 0)
+        *schedule = CONV_SCHEDULE_DYNAMIC;
+    else
+        return 0;
+
+    return 1;
+}
+
+static int parseCriterion(const char *name, ConvCriterion *criterion)
+{
+    if (strcmp(name, "none") == 0)
+        *criterion = CONV_CRITERION_NONE;
+    else if (strcmp(name, "l2") == 0)
+        *criterion = CONV_CRITERION_L2;
+    else if (strcmp(name, "max") == 0)
+        *criterion = CONV_CRITERION_MAX;
+    else
+        return 0;
+
+    return 1;
+}
+
 static void handleErrorArgument()
 {
     if (optopt == 'd' || optopt == 'm' || optopt == 'o' || optopt == 's'
-        || optopt == 'h' || optopt == 'w') {
+        || optopt == 'h' || optopt == 'w' || optopt == 'q'
+        || optopt == 'b' || optopt == 'e' || optopt == 't' || optopt == 'T'
+        || optopt == 'S' || optopt == 'l' || optopt == 'g' || optopt == 'n'
+        || optopt == 'i' || optopt == 'k' || optopt == 'c'
+        || optopt == 'E' || optopt == 'f' || optopt == 'F' || optopt == 'p'
+        || optopt == 'r' || optopt == 'D' || optopt == 'P') {
         log_log(LOG_ERROR, "[CMD] Option -%c requires an argument.", optopt);
     } else if (isprint(optopt)) {
         log_log(LOG_ERROR, "[CMD] Unknown option `-%c'.", optopt);
@@ -53,13 +207,37 @@ static void handleErrorArgument()
 CmdRequest *cmd_createRequest()
 {
     CmdRequest *retVal = malloc(sizeof(CmdRequest));
-    retVal->outputFile = stdout;
+    retVal->outputFiles[0] = stdout;
+    retVal->outputFilesAmt = 0;
     retVal->inputFile = NULL;
-    retVal->matrixFile = NULL;
+    retVal->inputPath = NULL;
+    retVal->matrixFilesAmt = 0;
     retVal->verbose = 0;
     retVal->imgHeight = 0;
     retVal->imgWidth = 0;
     retVal->imgPixelSize = 1;
+    retVal->imgLayout = IMG_LAYOUT_INTERLEAVED;
+    retVal->imgSampleType = IMG_SAMPLE_U8;
+    retVal->workSampleType = IMG_SAMPLE_U8;
+    retVal->sigma = 0;
+    retVal->boxPasses = CONV_DEFAULT_BOX_PASSES;
+    retVal->fixedBits = 0;
+    retVal->borderMode = IMG_BORDER_ZERO;
+    retVal->engine = CONV_ENGINE_AUTO;
+    retVal->jit = 0;
+    retVal->tileWidth = 0;
+    retVal->threads = 1;
+    retVal->schedule = CONV_SCHEDULE_STATIC;
+    retVal->split = COMM_SPLIT_AUTO;
+    retVal->tileRows = 0;
+    retVal->chunkRows = 0;
+    retVal->resident = 0;
+    retVal->rootShare = CMD_DEFAULT_ROOT_SHARE;
+    retVal->mpiIo = 0;
+    retVal->iterations = 1;
+    retVal->haloIterations = 0;
+    retVal->criterion = CONV_CRITERION_NONE;
+    retVal->tolerance = CMD_DEFAULT_TOLERANCE;
     return retVal;
 }
 
@@ -69,10 +247,13 @@ CmdRequest *cmd_createRequest()
  */
 void cmd_destroyRequest(CmdRequest *req)
 {
+    int i;
+
     if (req->inputFile != NULL) fclose(req->inputFile);
-    if (req->matrixFile != NULL) fclose(req->matrixFile);
-    if (req->outputFile != NULL && req->outputFile != stdout)
-        fclose(req->outputFile);
+    for (i = 0; i < req->matrixFilesAmt; i++)
+        fclose(req->matrixFiles[i]);
+    for (i = 0; i < req->outputFilesAmt; i++)
+        fclose(req->outputFiles[i]);
     free(req);
 }
 
@@ -92,9 +273,11 @@ void cmd_destroyRequest(CmdRequest *req)
 int cmd_parseRequest(int argc, char **argv, CmdRequest *req)
 {
     char c;
+    int workSampleTypeSet = 0;
 
     // Parse arguments
-    while ((c = getopt(argc, argv, "vhd:m:o:s:x:y:")) != -1) {
+    while ((c = getopt(argc, argv,
+        "vhjMRb:c:d:e:f:g:i:k:l:m:n:o:p:q:r:s:t:x:y:D:E:F:P:S:T:")) != -1) {
         switch (c) {
             case 'h':  // Help
                 showHelp();
@@ -104,6 +287,10 @@ int cmd_parseRequest(int argc, char **argv, CmdRequest *req)
                 req->verbose = 1;
                 break;
 
+            case 'j':  // Generated kernels
+                req->jit = 1;
+                break;
+
             case 'y':  // Image height
                 sscanf(optarg, "%d", &(req->imgHeight));
                 break;
@@ -116,6 +303,125 @@ int cmd_parseRequest(int argc, char **argv, CmdRequest *req)
                 sscanf(optarg, "%d", &(req->imgPixelSize));
                 break;
 
+            case 'l':  // Image layout
+                if (!parseLayout(optarg, &(req->imgLayout))) {
+                    log_log(LOG_ERROR, "[CMD] Unknown layout %s.", optarg);
+                    return 0;
+                }
+                break;
+
+            case 'f':  // Sample type of the files
+                if (!parseSampleType(optarg, &(req->imgSampleType))) {
+                    log_log(LOG_ERROR, "[CMD] Unknown sample type %s.",
+                        optarg);
+                    return 0;
+                }
+                break;
+
+            case 'F':  // Sample type of the convolution
+                if (!parseSampleType(optarg, &(req->workSampleType))) {
+                    log_log(LOG_ERROR, "[CMD] Unknown sample type %s.",
+                        optarg);
+                    return 0;
+                }
+                workSampleTypeSet = 1;
+                break;
+
+            case 'g':  // Gaussian sigma
+                sscanf(optarg, "%lf", &(req->sigma));
+                break;
+
+            case 'n':  // Box passes
+                sscanf(optarg, "%d", &(req->boxPasses));
+                break;
+
+            case 'R':  // Resident strips
+                req->resident = 1;
+                break;
+
+            case 'M':  // Parallel I/O
+                req->mpiIo = 1;
+                break;
+
+            case 'r':  // Share of the root process
+                sscanf(optarg, "%lf", &(req->rootShare));
+                break;
+
+            case 'p':  // Split between the processes
+                if (!parseSplit(optarg, &(req->split))) {
+                    log_log(LOG_ERROR, "[CMD] Unknown split %s.", optarg);
+                    return 0;
+                }
+                break;
+
+            case 'P':  // Rows of the chunks of the strips
+                sscanf(optarg, "%d", &(req->chunkRows));
+                break;
+
+            case 'D':  // Rows of the tiles
+                sscanf(optarg, "%d", &(req->tileRows));
+                break;
+
+            case 'i':  // Iterations
+                sscanf(optarg, "%d", &(req->iterations));
+                break;
+
+            case 'k':  // Iterations per halo exchange
+                if (strcmp(optarg, "auto") == 0)
+                    req->haloIterations = 0;
+                else if (sscanf(optarg, "%d", &(req->haloIterations)) != 1
+                    || req->haloIterations < 1) {
+                    log_log(LOG_ERROR, "[CMD] Unknown iterations per halo "
+                        "exchange %s.", optarg);
+                    return 0;
+                }
+                break;
+
+            case 'c':  // Stopping criterion
+                if (!parseCriterion(optarg, &(req->criterion))) {
+                    log_log(LOG_ERROR, "[CMD] Unknown stopping criterion %s.",
+                        optarg);
+                    return 0;
+                }
+                break;
+
+            case 'E':  // Tolerance of the stopping criterion
+                sscanf(optarg, "%lf", &(req->tolerance));
+                break;
+
+            case 'q':  // Fixed-point fractional bits
+                sscanf(optarg, "%d", &(req->fixedBits));
+                break;
+
+            case 't':  // Column block width
+                sscanf(optarg, "%d", &(req->tileWidth));
+                break;
+
+            case 'T':  // Threads
+                sscanf(optarg, "%d", &(req->threads));
+                break;
+
+            case 'S':  // Thread scheduling
+                if (!parseSchedule(optarg, &(req->schedule))) {
+                    log_log(LOG_ERROR, "[CMD] Unknown scheduling %s.", optarg);
+                    return 0;
+                }
+                break;
+
+            case 'b':  // Border mode
+                if (!parseBorderMode(optarg, &(req->borderMode))) {
+                    log_log(LOG_ERROR, "[CMD] Unknown border mode %s.", optarg);
+                    return 0;
+                }
+                break;
+
+            case 'e':  // Engine
+                if (!parseEngine(optarg, &(req->engine))) {
+                    log_log(LOG_ERROR, "[CMD] Unknown engine %s.", optarg);
+                    return 0;
+                }
+                break;
+
             case 'd': // Input file path
                 req->inputFile = fopen(optarg, "r");
                 if (req->inputFile == NULL) {
@@ -123,24 +429,38 @@ int cmd_parseRequest(int argc, char **argv, CmdRequest *req)
                         strerror(errno));
                     return 0;
                 }
+                req->inputPath = optarg;
                 break;
 
             case 'm': // Matrix file path
-                req->matrixFile = fopen(optarg, "r");
-                if (req->matrixFile == NULL) {
+                if (req->matrixFilesAmt == CONV_MAX_BANK_FILTERS) {
+                    log_log(LOG_ERROR, "[CMD] At most %d matrix files!",
+                        CONV_MAX_BANK_FILTERS);
+                    return 0;
+                }
+                req->matrixFiles[req->matrixFilesAmt] = fopen(optarg, "r");
+                if (req->matrixFiles[req->matrixFilesAmt] == NULL) {
                     log_log(LOG_ERROR, "[CMD] Failed to open %s: %s", optarg,
                         strerror(errno));
                     return 0;
                 }
+                req->matrixFilesAmt++;
                 break;
 
             case 'o': // Output file path
-                req->outputFile = fopen(optarg, "w");
-                if (req->outputFile == NULL) {
+                if (req->outputFilesAmt == CONV_MAX_BANK_FILTERS) {
+                    log_log(LOG_ERROR, "[CMD] At most %d output files!",
+                        CONV_MAX_BANK_FILTERS);
+                    return 0;
+                }
+                req->outputFiles[req->outputFilesAmt] = fopen(optarg, "w");
+                if (req->outputFiles[req->outputFilesAmt] == NULL) {
                     log_log(LOG_ERROR, "[CMD] Failed to open %s: %s", optarg,
                         strerror(errno));
                     return 0;
                 }
+                req->outputPaths[req->outputFilesAmt] = optarg;
+                req->outputFilesAmt++;
                 break;
 
             case '?': // Unknown
@@ -152,5 +472,9 @@ int cmd_parseRequest(int argc, char **argv, CmdRequest *req)
         }
     }
 
+    // The image is convolved with the samples of the files by default
+    if (!workSampleTypeSet)
+        req->workSampleType = req->imgSampleType;
+
     return 1;
 }
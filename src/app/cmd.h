@@ -7,18 +7,81 @@
 #ifndef _CMD
 #define _CMD
 
+#include <stdio.h>
+#include <types/image.h>
+#include "convolution.h"
+#include "comm.h"
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Largest change of the last iteration for the stopping criteria (a single
+//  intensity level)
+#define CMD_DEFAULT_TOLERANCE 1.0
+
+// Rows of the root process, relative to the ones of a worker (fewer, as it
+//  also reads, sends, receives and writes the image)
+#define CMD_DEFAULT_ROOT_SHARE 0.5
+
+// Tiles per process handed out on request, enough for the faster ones to
+//  take more of them
+#define CMD_DEFAULT_TILES_PER_PROCESS 8
+
 /******************************************************************************
  * Data structures
  *****************************************************************************/
 
 typedef struct {
-    FILE *outputFile;
+    // Output files: one per filter, or one for all of them (stdout if none)
+    FILE *outputFiles[CONV_MAX_BANK_FILTERS];
+    const char *outputPaths[CONV_MAX_BANK_FILTERS];
+    int outputFilesAmt;
     FILE *inputFile;
-    FILE *matrixFile;
+    const char *inputPath;
+    // Matrix files, each one holding one or more matrices
+    FILE *matrixFiles[CONV_MAX_BANK_FILTERS];
+    int matrixFilesAmt;
     int verbose;
     int imgHeight;
     int imgWidth;
     int imgPixelSize;
+    ImgLayout imgLayout;
+    // Samples of the files, and of the image while it is convolved (the
+    //  iterations run without requantising when it is wider)
+    ImgSampleType imgSampleType;
+    ImgSampleType workSampleType;
+    double sigma;
+    int boxPasses;
+    int fixedBits;
+    ImgBorderMode borderMode;
+    ConvEngine engine;
+    // Generate the vector kernels of the filters at runtime
+    int jit;
+    int tileWidth;
+    int threads;
+    ConvSchedule schedule;
+    // Split of the image between the workers, rows of the tiles handed out
+    //  on request (0 for the default amount of them), and whether the strips
+    //  stay resident (the workers exchange all the halos, while convolving)
+    CommSplit split;
+    int tileRows;
+    int resident;
+    // Rows of the strip of the root process, relative to the ones of a
+    //  worker (0 if it only sends and receives the strips)
+    double rootShare;
+    // Rows of the chunks of the strips streamed through the processes (0
+    //  for whole strips)
+    int chunkRows;
+    // Every process reads and writes its own strip of the files (MPI-IO)
+    int mpiIo;
+    // Convolution iterations, and iterations per halo exchange (0 for the
+    //  amount picked from the measured costs)
+    int iterations;
+    int haloIterations;
+    // When the iterations stop early, and the largest change of the last one
+    ConvCriterion criterion;
+    double tolerance;
 } CmdRequest;
 
 /******************************************************************************
@@ -6,37 +6,236 @@
  *****************************************************************************/
 #include "comm.h"
 #include <mpi.h>
+#include <stdlib.h>
 
 #define MY_COMM MPI_COMM_WORLD
 
+// Whether worker threads may run besides the MPI calls of the main thread
+static int threaded = 0;
+
+// The processes other than the root one (MPI_COMM_NULL in the root one)
+static MPI_Comm workersComm = MPI_COMM_NULL;
+
+// The grid of workers, if any (see comm_makeWorkersGrid)
+static MPI_Comm gridComm = MPI_COMM_NULL;
+
+// The scatters in flight, and their counts and displacements, which must
+//  stay in place until they are done (see comm_scatterImgParts)
+#define MAX_SCATTERS 4
+static MPI_Request scatters[MAX_SCATTERS];
+static int *scatterCounts[MAX_SCATTERS];
+static int scattersAmt = 0;
+
+struct comm_exchange_t {    // Persistent exchange of image parts
+    // Receptions from below and above, then sends up and down
+    MPI_Request requests[4];
+    // Datatype of a part (planar images only)
+    MPI_Datatype partType;
+    int planar;
+};
+
+struct comm_file_t {        // Raw image file opened by every process
+    MPI_File file;
+};
+
+/**
+ * Makes the datatype of a part of a planar image, i.e. the same rows of
+ *  every plane, so that a part is still a single message.
+ * @param struct image_t *img The planar image.
+ * @param int limit The amount of rows.
+ * @return MPI_Datatype The committed datatype, to be freed by the caller.
+ */
+static MPI_Datatype makePlanarPartType(struct image_t *img, int limit)
+{
+    int size;
+    MPI_Datatype retVal;
+
+    size = img_getSampleSize(img->sampleType);
+    MPI_Type_vector(img->pixelSize, limit * img->width * size,
+        img->height * img->width * size, MPI_CHAR, &retVal);
+    MPI_Type_commit(&retVal);
+
+    return retVal;
+}
+
+/**
+ * Returns the size of a row of an interleaved image.
+ * @param struct image_t *img The image.
+ * @return int The size in bytes.
+ */
+static int getRowSize(struct image_t *img)
+{
+    return img->pixelSize * img->width * img_getSampleSize(img->sampleType);
+}
+
+/**
+ * Returns the address of the first byte of a row of an image, i.e. the
+ *  start of a part (see makePlanarPartType for planar images).
+ * @param struct image_t *img The image.
+ * @param int rowIdx The row index.
+ * @return unsigned char* The address.
+ */
+static unsigned char* getRowPtr(struct image_t *img, int rowIdx)
+{
+    if (img->layout == IMG_LAYOUT_PLANAR)
+        return &(img->data[rowIdx * img->width
+            * img_getSampleSize(img->sampleType)]);
+
+    return &(img->data[rowIdx * getRowSize(img)]);
+}
+
+/**
+ * Makes the datatype of a row of an image (the same row of every plane for
+ *  planar images), whose extent is the distance between two rows, so that
+ *  the parts of the collectives are counted in rows.
+ * @param struct image_t *img The image.
+ * @return MPI_Datatype The committed datatype, to be freed by the caller.
+ */
+static MPI_Datatype makeRowType(struct image_t *img)
+{
+    int size;
+    MPI_Datatype planesType, retVal;
+
+    if (img->layout != IMG_LAYOUT_PLANAR) {
+        MPI_Type_contiguous(getRowSize(img), MPI_CHAR, &retVal);
+        MPI_Type_commit(&retVal);
+        return retVal;
+    }
+    size = img->width * img_getSampleSize(img->sampleType);
+    MPI_Type_vector(img->pixelSize, size, img->height * size, MPI_CHAR,
+        &planesType);
+    MPI_Type_create_resized(planesType, 0, size, &retVal);
+    MPI_Type_commit(&retVal);
+    MPI_Type_free(&planesType);
+
+    return retVal;
+}
+
+/**
+ * Makes the datatype of a block of an image (the same block of every plane
+ *  for planar images), to be used with the address of the image data.
+ * @param struct image_t *img The image.
+ * @param int rowIdx The first row of the block.
+ * @param int colIdx The first column of the block.
+ * @param int rows The amount of rows (none if not positive).
+ * @param int cols The amount of columns (none if not positive).
+ * @return MPI_Datatype The committed datatype, to be freed by the caller.
+ */
+static MPI_Datatype makeBlockType(struct image_t *img, int rowIdx,
+    int colIdx, int rows, int cols)
+{
+    int pixelBytes;
+    int sizes[3], subSizes[3], starts[3];
+    MPI_Datatype retVal;
+
+    // Empty block
+    if (rows <= 0 || cols <= 0) {
+        MPI_Type_contiguous(0, MPI_CHAR, &retVal);
+        MPI_Type_commit(&retVal);
+        return retVal;
+    }
+
+    // Planes of rows of bytes (a single plane for interleaved images)
+    pixelBytes = img_getSampleSize(img->sampleType);
+    sizes[0] = 1;
+    if (img->layout == IMG_LAYOUT_PLANAR)
+        sizes[0] = img->pixelSize;
+    else
+        pixelBytes *= img->pixelSize;
+    sizes[1] = img->height;
+    sizes[2] = img->width * pixelBytes;
+    subSizes[0] = sizes[0];
+    subSizes[1] = rows;
+    subSizes[2] = cols * pixelBytes;
+    starts[0] = 0;
+    starts[1] = rowIdx;
+    starts[2] = colIdx * pixelBytes;
+    MPI_Type_create_subarray(3, sizes, subSizes, starts, MPI_ORDER_C,
+        MPI_CHAR, &retVal);
+    MPI_Type_commit(&retVal);
+
+    return retVal;
+}
+
+/**
+ * Sends a block of an image to a process while receiving another one from a
+ *  process (MPI_PROC_NULL for none).
+ * @param struct image_t *img The image.
+ * @param int rows The amount of rows of both blocks.
+ * @param int cols The amount of columns of both blocks.
+ * @param int sendRank The rank to send to.
+ * @param int sendRowIdx The first row of the sent block.
+ * @param int sendColIdx The first column of the sent block.
+ * @param int recvRank The rank to receive from.
+ * @param int recvRowIdx The first row of the received block.
+ * @param int recvColIdx The first column of the received block.
+ * @param int tag The message tag.
+ */
+static void exchangeBlocks(struct image_t *img, int rows, int cols,
+    int sendRank, int sendRowIdx, int sendColIdx, int recvRank,
+    int recvRowIdx, int recvColIdx, int tag)
+{
+    MPI_Datatype sendType, recvType;
+
+    // No neighbour: no block (it would be out of the image)
+    sendType = makeBlockType(img, sendRowIdx, sendColIdx,
+        (sendRank == MPI_PROC_NULL) ? 0 : rows, cols);
+    recvType = makeBlockType(img, recvRowIdx, recvColIdx,
+        (recvRank == MPI_PROC_NULL) ? 0 : rows, cols);
+    MPI_Sendrecv(img->data, 1, sendType, sendRank, tag,
+        img->data, 1, recvType, recvRank, tag, gridComm, MPI_STATUS_IGNORE);
+    MPI_Type_free(&sendType);
+    MPI_Type_free(&recvType);
+}
+
 /******************************************************************************
  * Start / stop the communication
  *****************************************************************************/
 
 /**
- * Starts the communication session.
+ * Starts the communication session. Only the main thread makes MPI calls
+ *  (MPI_THREAD_FUNNELED), so that the others can run convolution.
  * @param int *argc The arguments count (pointer).
  * @param char ***argv The list of arguments (pointer).
  * @return int The rank (id) of the process.
  */
 int comm_start(int *argc, char ***argv)
 {
-    int retVal;
+    int retVal, provided;
 
     // Create the communicator
-    MPI_Init(argc, argv);
+    MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+    threaded = provided >= MPI_THREAD_FUNNELED;
 
     // Get the rank
     MPI_Comm_rank(MY_COMM, &retVal);
 
+    // Communicator of the workers, for the reductions they make without the
+    //  root process
+    MPI_Comm_split(MY_COMM, (retVal == 0) ? MPI_UNDEFINED : 1, retVal,
+        &workersComm);
+
     return retVal;
 }
 
+/**
+ * Tells whether the MPI library supports threads besides the main one.
+ * @return int 1 if it does, 0 otherwise.
+ */
+int comm_isThreaded()
+{
+    return threaded;
+}
+
 /**
  * Stop the communication session.
  */
 void comm_stop()
 {
+    if (gridComm != MPI_COMM_NULL)
+        MPI_Comm_free(&gridComm);
+    if (workersComm != MPI_COMM_NULL)
+        MPI_Comm_free(&workersComm);
     MPI_Finalize();
 }
 
@@ -86,86 +285,248 @@ int comm_getRank()
 }
 
 /******************************************************************************
- * Matrix transferring
+ * Reductions
  *****************************************************************************/
 
 /**
- * Broadcast a matrix to all processes of the communicator.
- * @param struct matrix_t *inMat The matrix to broadcast. Set to NULL for all
- *  non-root processes.
- * @return struct matirx_t* The broadcasted matrix. NULL in case of failure.
+ * Returns the minimum of a value over all processes of the communicator. All
+ *  of them must call it.
+ * @param int value The value of the process.
+ * @return int The minimum value.
  */
-struct matrix_t* comm_broadcastMatrix(struct matrix_t *inMat)
+int comm_reduceMin(int value)
+{
+    int retVal;
+
+    MPI_Allreduce(&value, &retVal, 1, MPI_INT, MPI_MIN, MY_COMM);
+
+    return retVal;
+}
+
+/**
+ * Returns the sum of a value over all processes of the communicator. All of
+ *  them must call it.
+ * @param long long value The value of the process.
+ * @return long long The sum.
+ */
+long long comm_reduceSum(long long value)
+{
+    long long retVal;
+
+    MPI_Allreduce(&value, &retVal, 1, MPI_LONG_LONG, MPI_SUM, MY_COMM);
+
+    return retVal;
+}
+
+/**
+ * Returns the maximum of a value over all processes of the communicator. All
+ *  of them must call it.
+ * @param double value The value of the process.
+ * @return double The maximum value.
+ */
+double comm_reduceMax(double value)
+{
+    double retVal;
+
+    MPI_Allreduce(&value, &retVal, 1, MPI_DOUBLE, MPI_MAX, MY_COMM);
+
+    return retVal;
+}
+
+/**
+ * Returns the sum of a value over all worker processes (every one but the
+ *  root). All of them must call it.
+ * @param long long value The value of the process.
+ * @return long long The sum.
+ */
+long long comm_reduceWorkersSum(long long value)
+{
+    long long retVal;
+
+    MPI_Allreduce(&value, &retVal, 1, MPI_LONG_LONG, MPI_SUM, workersComm);
+
+    return retVal;
+}
+
+/**
+ * Returns the maximum of a value over all worker processes (every one but the
+ *  root). All of them must call it.
+ * @param double value The value of the process.
+ * @return double The maximum value.
+ */
+double comm_reduceWorkersMax(double value)
+{
+    double retVal;
+
+    MPI_Allreduce(&value, &retVal, 1, MPI_DOUBLE, MPI_MAX, workersComm);
+
+    return retVal;
+}
+
+/******************************************************************************
+ * Grid of processes
+ *****************************************************************************/
+
+/**
+ * Picks the rows and columns of a balanced grid of processes.
+ * @param int amount The amount of processes.
+ * @param int *dims The amount of rows, then of columns (filled, the first
+ *  one being the largest).
+ */
+void comm_getGridDims(int amount, int *dims)
+{
+    dims[0] = 0;
+    dims[1] = 0;
+    MPI_Dims_create(amount, 2, dims);
+}
+
+/**
+ * Arranges the worker processes (every one but the root) as a Cartesian
+ *  grid, row-major in the order of their ranks (rank r is at row
+ *  (r - 1) / columns). All of them must call it, once.
+ * @param const int *dims The amount of rows and columns of the grid.
+ * @param const int *periods Whether the rows, then the columns, wrap around.
+ * @param int *coords The row and column of the process (filled).
+ */
+void comm_makeWorkersGrid(const int *dims, const int *periods, int *coords)
 {
-    int i;
     int rank;
-    int height, width;
-    struct matrix_t *mat = NULL;
 
-    // Get the rank
-    MPI_Comm_rank(MY_COMM, &rank);
+    // No reordering: the root process places the blocks from the ranks
+    MPI_Cart_create(workersComm, 2, dims, periods, 0, &gridComm);
+    MPI_Comm_rank(gridComm, &rank);
+    MPI_Cart_coords(gridComm, rank, 2, coords);
+}
 
-    // Send the size
-    if (rank == 0) {
-        width = inMat->width;
-        height = inMat->height;
-    }
-    MPI_Bcast(&width, 1, MPI_INT, 0, MY_COMM);
-    MPI_Bcast(&height, 1, MPI_INT, 0, MY_COMM);
+/******************************************************************************
+ * Messages
+ *****************************************************************************/
 
-    // Allocate space for new matrix (non-root processes)
-    if (rank != 0)
-        mat = mat_make(width, height);
+/**
+ * Checks whether a message is waiting to be received (e.g. a request of a
+ *  worker), without receiving it.
+ * @param int srcRank The source rank, or COMM_ANY_RANK.
+ * @param int tag The message tag to match, or COMM_ANY_TAG.
+ * @param int wait Whether to wait for a message rather than return at once.
+ * @return int The source rank of the message, or COMM_NO_RANK if none.
+ */
+int comm_probe(int srcRank, int tag, int wait)
+{
+    int flag;
+    MPI_Status st;
+
+    // Wildcards
+    if (srcRank == COMM_ANY_RANK)
+        srcRank = MPI_ANY_SOURCE;
+    if (tag == COMM_ANY_TAG)
+        tag = MPI_ANY_TAG;
+
+    // Probe
+    flag = 1;
+    if (wait)
+        MPI_Probe(srcRank, tag, MY_COMM, &st);
     else
-        mat = inMat;
+        MPI_Iprobe(srcRank, tag, MY_COMM, &flag, &st);
 
-    // Broadcast data line by line
-    for (i = 0; i < height; i++) {
-        MPI_Bcast(mat->values[i], width, MPI_DOUBLE, 0, MY_COMM);
-    }
+    return flag ? st.MPI_SOURCE : COMM_NO_RANK;
+}
+
+/**
+ * Sends a value to a process.
+ * @param int value The value.
+ * @param int destRank The destination rank.
+ * @param int tag The message tag to use.
+ */
+void comm_sendValue(int value, int destRank, int tag)
+{
+    MPI_Send(&value, 1, MPI_INT, destRank, tag, MY_COMM);
+}
 
-    return mat;
+/**
+ * Receives a value from a process.
+ * @param int srcRank The source rank.
+ * @param int tag The message tag to match.
+ * @return int The value.
+ */
+int comm_recvValue(int srcRank, int tag)
+{
+    int retVal;
+
+    MPI_Recv(&retVal, 1, MPI_INT, srcRank, tag, MY_COMM, MPI_STATUS_IGNORE);
+
+    return retVal;
 }
 
 /******************************************************************************
- * Image transferring
+ * Matrix transferring
  *****************************************************************************/
 
 /**
- * Broadcast an empty image (with proper dimensions though) to all processes of
- *  the communicator.
- * @param struct image_t *inImg The image to broadcast. Set to NULL for all
- *  non-root processes.
- * @return struct image_t* The broadcasted image. NULL in case of failure.
+ * Broadcast a bank of matrices to all processes of the communicator: their
+ *  sizes, then the values of all of them in a single message.
+ * @param struct matrix_t **inMats The matrices to broadcast. Set to NULL for
+ *  all non-root processes.
+ * @param int *amount The amount of matrices. Filled for all non-root
+ *  processes.
+ * @return struct matrix_t** The broadcasted matrices (allocated for all
+ *  non-root processes). NULL in case of failure.
  */
-struct image_t* comm_broadcastEmptyImg(struct image_t *inImg)
+struct matrix_t** comm_broadcastMatrices(struct matrix_t **inMats,
+    int *amount)
 {
-    int rank;
-    int height, width, pixelSize;
-    struct image_t *img = NULL;
+    int f, rank;
+    int *sizes, *lengths;
+    MPI_Aint *addresses;
+    MPI_Datatype bankType;
+    struct matrix_t **mats = NULL;
 
     // Get the rank
     MPI_Comm_rank(MY_COMM, &rank);
 
-    // Send the size
-    if (rank == 0) {
-        width = inImg->width;
-        height = inImg->height;
-        pixelSize = inImg->pixelSize;
+    // Send the sizes
+    MPI_Bcast(amount, 1, MPI_INT, 0, MY_COMM);
+    sizes = malloc(sizeof(int) * 2 * *amount);
+    if (rank == 0)
+        for (f = 0; f < *amount; f++) {
+            sizes[2 * f] = inMats[f]->width;
+            sizes[2 * f + 1] = inMats[f]->height;
+        }
+    MPI_Bcast(sizes, 2 * *amount, MPI_INT, 0, MY_COMM);
+
+    // Allocate space for new matrices (non-root processes)
+    if (rank != 0) {
+        mats = malloc(sizeof(struct matrix_t*) * *amount);
+        for (f = 0; f < *amount; f++)
+            mats[f] = mat_make(sizes[2 * f], sizes[2 * f + 1]);
+    } else
+        mats = inMats;
+
+    // Broadcast all values at once, in place: a datatype made of the
+    //  (contiguous) values of every matrix
+    lengths = malloc(sizeof(int) * *amount);
+    addresses = malloc(sizeof(MPI_Aint) * *amount);
+    for (f = 0; f < *amount; f++) {
+        lengths[f] = sizes[2 * f] * sizes[2 * f + 1];
+        MPI_Get_address(mats[f]->values[0], &addresses[f]);
     }
-    MPI_Bcast(&width, 1, MPI_INT, 0, MY_COMM);
-    MPI_Bcast(&height, 1, MPI_INT, 0, MY_COMM);
-    MPI_Bcast(&pixelSize, 1, MPI_INT, 0, MY_COMM);
-
-    // Allocate space for new matrix (non-root processes)
-    if (rank != 0)
-        img = img_make(width, height, pixelSize);
-    else
-        img = inImg;
-
-    return img;
+    MPI_Type_create_hindexed(*amount, lengths, addresses, MPI_DOUBLE,
+        &bankType);
+    MPI_Type_commit(&bankType);
+    MPI_Bcast(MPI_BOTTOM, 1, bankType, 0, MY_COMM);
+    MPI_Type_free(&bankType);
+
+    // Clean up
+    free(addresses);
+    free(lengths);
+    free(sizes);
+
+    return mats;
 }
 
+/******************************************************************************
+ * Image transferring
+ *****************************************************************************/
+
 /**
  * Send an image part (data) to a process.
  * @param struct image_t *img The input image.
@@ -177,6 +538,8 @@ struct image_t* comm_broadcastEmptyImg(struct image_t *inImg)
 void comm_sendImgPart(struct image_t *img, int offsetRowIdx, int limit,
     int destRank, int tag)
 {
+    MPI_Datatype partType;
+
     // Checks
     if (offsetRowIdx >= img->height)
         return;
@@ -184,14 +547,118 @@ void comm_sendImgPart(struct image_t *img, int offsetRowIdx, int limit,
         limit = img->height - offsetRowIdx;
 
     // Send
+    if (img->layout == IMG_LAYOUT_PLANAR) {
+        partType = makePlanarPartType(img, limit);
+        MPI_Send(getRowPtr(img, offsetRowIdx), 1, partType,
+            destRank, tag, MY_COMM);
+        MPI_Type_free(&partType);
+        return;
+    }
     MPI_Send(
-        &(img->data[offsetRowIdx * img->pixelSize * img->width]),
-        limit * img->pixelSize * img->width,
+        getRowPtr(img, offsetRowIdx),
+        limit * getRowSize(img),
         MPI_CHAR,
         destRank, tag, MY_COMM
     );
 }
 
+/**
+ * Starts scattering parts of an image from the root process to every
+ *  process, which gets its part in its own image (e.g. the image of its part
+ *  only). The parts may overlap (e.g. strips and their halos). All processes
+ *  must call it, then wait for it (see comm_waitImgParts).
+ * @param struct image_t *img The image (its data must stay in place).
+ * @param const int *offsetRowIdxs The offset (as row index) of the part of
+ *  every process in the image of the root process.
+ * @param const int *limits The limit (amount of rows) of the part of every
+ *  process (0 for none, as for the root process).
+ * @param int rowIdx The row of the image of the process receiving its part
+ *  (ignored for the root process).
+ */
+void comm_scatterImgParts(struct image_t *img, const int *offsetRowIdxs,
+    const int *limits, int rowIdx)
+{
+    int i, rank, size, *counts;
+    MPI_Datatype rowType;
+
+    // Room for the scatter
+    if (scattersAmt == MAX_SCATTERS)
+        comm_waitImgParts();
+    MPI_Comm_rank(MY_COMM, &rank);
+    MPI_Comm_size(MY_COMM, &size);
+    counts = malloc(sizeof(int) * 2 * size);
+    for (i = 0; i < size; i++) {
+        counts[i] = limits[i];
+        counts[size + i] = offsetRowIdxs[i];
+    }
+
+    // Scatter whole rows (a datatype can be freed while in use, MPI keeps it
+    //  until the scatter is done)
+    rowType = makeRowType(img);
+    if (rank == 0)
+        MPI_Iscatterv(img->data, counts, counts + size, rowType,
+            MPI_IN_PLACE, 0, rowType, 0, MY_COMM, &scatters[scattersAmt]);
+    else
+        MPI_Iscatterv(NULL, NULL, NULL, rowType,
+            (limits[rank] > 0) ? getRowPtr(img, rowIdx) : img->data,
+            limits[rank], rowType, 0, MY_COMM,
+            &scatters[scattersAmt]);
+    MPI_Type_free(&rowType);
+    scatterCounts[scattersAmt++] = counts;
+}
+
+/**
+ * Waits for all the scatters started by comm_scatterImgParts to be done.
+ */
+void comm_waitImgParts()
+{
+    int i;
+
+    MPI_Waitall(scattersAmt, scatters, MPI_STATUSES_IGNORE);
+    for (i = 0; i < scattersAmt; i++)
+        free(scatterCounts[i]);
+    scattersAmt = 0;
+}
+
+/**
+ * Gathers parts of an image from every process to the root process. The
+ *  parts must not overlap in the image of the root process. All processes
+ *  must call it.
+ * @param struct image_t *img The image.
+ * @param const int *offsetRowIdxs The offset (as row index) of the part of
+ *  every process in the image of the root process.
+ * @param const int *limits The limit (amount of rows) of the part of every
+ *  process (0 for none, as for the root process).
+ * @param int rowIdx The row of the image of the process sending its part
+ *  (ignored for the root process).
+ */
+void comm_gatherImgParts(struct image_t *img, const int *offsetRowIdxs,
+    const int *limits, int rowIdx)
+{
+    int i, rank, size, *counts;
+    MPI_Datatype rowType;
+
+    MPI_Comm_rank(MY_COMM, &rank);
+    MPI_Comm_size(MY_COMM, &size);
+    rowType = makeRowType(img);
+    if (rank != 0) {
+        MPI_Gatherv((limits[rank] > 0) ? getRowPtr(img, rowIdx) : img->data,
+            limits[rank], rowType, NULL, NULL, NULL, rowType, 0,
+            MY_COMM);
+        MPI_Type_free(&rowType);
+        return;
+    }
+    counts = malloc(sizeof(int) * 2 * size);
+    for (i = 0; i < size; i++) {
+        counts[i] = (i == 0) ? 0 : limits[i];
+        counts[size + i] = offsetRowIdxs[i];
+    }
+    MPI_Gatherv(MPI_IN_PLACE, 0, rowType, img->data, counts, counts + size,
+        rowType, 0, MY_COMM);
+    MPI_Type_free(&rowType);
+    free(counts);
+}
+
 /**
  * Receive an image part (data) to a process.
  * @param struct image_t *img The output image.
@@ -204,6 +671,7 @@ void comm_recvImgPart(struct image_t *img, int offsetRowIdx, int limit,
     int srcRank, int tag)
 {
     MPI_Status st;
+    MPI_Datatype partType;
 
     // Checks
     if (offsetRowIdx >= img->height)
@@ -218,11 +686,326 @@ void comm_recvImgPart(struct image_t *img, int offsetRowIdx, int limit,
         tag = MPI_ANY_TAG;
 
     // Receive
+    if (img->layout == IMG_LAYOUT_PLANAR) {
+        partType = makePlanarPartType(img, limit);
+        MPI_Recv(getRowPtr(img, offsetRowIdx), 1, partType,
+            srcRank, tag, MY_COMM, &st);
+        MPI_Type_free(&partType);
+        return;
+    }
     MPI_Recv(
-        &(img->data[offsetRowIdx * img->pixelSize * img->width]),
-        limit * img->pixelSize * img->width,
+        getRowPtr(img, offsetRowIdx),
+        limit * getRowSize(img),
         MPI_CHAR,
         srcRank, tag, MY_COMM,
         &st    // status
     );
 }
+
+/**
+ * Exchanges image parts with two processes (e.g. the halos of the strips
+ *  above and below): a part is sent to each of them while a part is received
+ *  from each of them, with paired sends and receives so that a ring of
+ *  processes cannot deadlock. All parts have the same amount of rows.
+ * @param struct image_t *img The image.
+ * @param int limit The limit (amount of rows) of every part.
+ * @param int upRank The rank of the first process, or COMM_NO_RANK.
+ * @param int upSendRowIdx The offset (as row index) of the part sent to it.
+ * @param int upRecvRowIdx The offset of the part received from it.
+ * @param int downRank The rank of the second process, or COMM_NO_RANK.
+ * @param int downSendRowIdx The offset of the part sent to it.
+ * @param int downRecvRowIdx The offset of the part received from it.
+ */
+void comm_exchangeImgParts(struct image_t *img, int limit, int upRank,
+    int upSendRowIdx, int upRecvRowIdx, int downRank, int downSendRowIdx,
+    int downRecvRowIdx)
+{
+    int i, count;
+    int ranks[2], sendRowIdxs[2], recvRowIdxs[2];
+    MPI_Datatype partType;
+
+    // The part of a planar image is made of the rows of every plane
+    if (img->layout == IMG_LAYOUT_PLANAR) {
+        partType = makePlanarPartType(img, limit);
+        count = 1;
+    } else {
+        partType = MPI_CHAR;
+        count = limit * getRowSize(img);
+    }
+
+    // Send up while receiving from below, then the other way round
+    ranks[0] = (upRank == COMM_NO_RANK) ? MPI_PROC_NULL : upRank;
+    ranks[1] = (downRank == COMM_NO_RANK) ? MPI_PROC_NULL : downRank;
+    sendRowIdxs[0] = upSendRowIdx;
+    sendRowIdxs[1] = downSendRowIdx;
+    recvRowIdxs[0] = downRecvRowIdx;
+    recvRowIdxs[1] = upRecvRowIdx;
+    for (i = 0; i < 2; i++)
+        MPI_Sendrecv(
+            getRowPtr(img, sendRowIdxs[i]), count, partType, ranks[i], 3 + i,
+            getRowPtr(img, recvRowIdxs[i]), count, partType, ranks[1 - i],
+            3 + i, MY_COMM, MPI_STATUS_IGNORE
+        );
+
+    // Clean up
+    if (img->layout == IMG_LAYOUT_PLANAR)
+        MPI_Type_free(&partType);
+}
+
+/**
+ * Prepares an exchange of image parts with two processes, the same as
+ *  comm_exchangeImgParts, as persistent non-blocking requests: it can be
+ *  started and waited for as many times as needed, the image data being
+ *  convolved in between (but for the received parts).
+ * @param struct image_t *img The image (its data must stay in place).
+ * @param int limit The limit (amount of rows) of every part.
+ * @param int upRank The rank of the first process, or COMM_NO_RANK.
+ * @param int upSendRowIdx The offset (as row index) of the part sent to it.
+ * @param int upRecvRowIdx The offset of the part received from it.
+ * @param int downRank The rank of the second process, or COMM_NO_RANK.
+ * @param int downSendRowIdx The offset of the part sent to it.
+ * @param int downRecvRowIdx The offset of the part received from it.
+ * @return struct comm_exchange_t* The exchange or NULL.
+ */
+struct comm_exchange_t* comm_makeImgExchange(struct image_t *img, int limit,
+    int upRank, int upSendRowIdx, int upRecvRowIdx, int downRank,
+    int downSendRowIdx, int downRecvRowIdx)
+{
+    int count;
+    MPI_Datatype partType;
+    struct comm_exchange_t *retVal;
+
+    retVal = malloc(sizeof(struct comm_exchange_t));
+    if (retVal == NULL)
+        return NULL;
+
+    // The part of a planar image is made of the rows of every plane
+    retVal->planar = img->layout == IMG_LAYOUT_PLANAR;
+    if (retVal->planar) {
+        retVal->partType = makePlanarPartType(img, limit);
+        partType = retVal->partType;
+        count = 1;
+    } else {
+        partType = MPI_CHAR;
+        count = limit * getRowSize(img);
+    }
+
+    // Same tags as the blocking exchange: up with 3, down with 4
+    if (upRank == COMM_NO_RANK)
+        upRank = MPI_PROC_NULL;
+    if (downRank == COMM_NO_RANK)
+        downRank = MPI_PROC_NULL;
+    MPI_Recv_init(getRowPtr(img, downRecvRowIdx), count, partType, downRank,
+        3, MY_COMM, &(retVal->requests[0]));
+    MPI_Recv_init(getRowPtr(img, upRecvRowIdx), count, partType, upRank, 4,
+        MY_COMM, &(retVal->requests[1]));
+    MPI_Send_init(getRowPtr(img, upSendRowIdx), count, partType, upRank, 3,
+        MY_COMM, &(retVal->requests[2]));
+    MPI_Send_init(getRowPtr(img, downSendRowIdx), count, partType, downRank,
+        4, MY_COMM, &(retVal->requests[3]));
+
+    return retVal;
+}
+
+/**
+ * Starts an exchange of image parts, without waiting for it.
+ * @param struct comm_exchange_t *exchange The exchange.
+ */
+void comm_startImgExchange(struct comm_exchange_t *exchange)
+{
+    MPI_Startall(4, exchange->requests);
+}
+
+/**
+ * Waits for an exchange of image parts to be done.
+ * @param struct comm_exchange_t *exchange The exchange.
+ */
+void comm_waitImgExchange(struct comm_exchange_t *exchange)
+{
+    MPI_Waitall(4, exchange->requests, MPI_STATUSES_IGNORE);
+}
+
+/**
+ * Destroys an exchange of image parts (not in progress).
+ * @param struct comm_exchange_t *exchange The exchange to destroy.
+ */
+void comm_destroyImgExchange(struct comm_exchange_t *exchange)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        MPI_Request_free(&(exchange->requests[i]));
+    if (exchange->planar)
+        MPI_Type_free(&(exchange->partType));
+    free(exchange);
+}
+
+/**
+ * Send a block of an image (data) to a process.
+ * @param struct image_t *img The input image.
+ * @param int rowIdx The first row of the block.
+ * @param int colIdx The first column (pixel) of the block.
+ * @param int rows The amount of rows.
+ * @param int cols The amount of columns.
+ * @param int destRank The destination rank.
+ * @param int tag The message tag to use.
+ */
+void comm_sendImgBlock(struct image_t *img, int rowIdx, int colIdx, int rows,
+    int cols, int destRank, int tag)
+{
+    MPI_Datatype blockType;
+
+    blockType = makeBlockType(img, rowIdx, colIdx, rows, cols);
+    MPI_Send(img->data, 1, blockType, destRank, tag, MY_COMM);
+    MPI_Type_free(&blockType);
+}
+
+/**
+ * Receive a block of an image (data) from a process. The block may be at
+ *  another place than the sent one, but has the same size.
+ * @param struct image_t *img The output image.
+ * @param int rowIdx The first row of the block.
+ * @param int colIdx The first column (pixel) of the block.
+ * @param int rows The amount of rows.
+ * @param int cols The amount of columns.
+ * @param int srcRank The source rank.
+ * @param int tag The message tag to match.
+ */
+void comm_recvImgBlock(struct image_t *img, int rowIdx, int colIdx, int rows,
+    int cols, int srcRank, int tag)
+{
+    MPI_Datatype blockType;
+
+    blockType = makeBlockType(img, rowIdx, colIdx, rows, cols);
+    MPI_Recv(img->data, 1, blockType, srcRank, tag, MY_COMM,
+        MPI_STATUS_IGNORE);
+    MPI_Type_free(&blockType);
+}
+
+/**
+ * Exchanges the halos of a block with the four neighbours of the process on
+ *  the grid of workers (see comm_makeWorkersGrid): the columns on the left
+ *  and right first, then the rows above and below with the halos of the
+ *  columns, so that the corners come from the diagonal neighbours. The image
+ *  must have room for the halos on the sides with a neighbour.
+ * @param struct image_t *img The image holding the block and its halos.
+ * @param int rowIdx The first row of the block.
+ * @param int colIdx The first column (pixel) of the block.
+ * @param int rows The amount of rows of the block.
+ * @param int cols The amount of columns of the block.
+ * @param int depth The amount of rows or columns of every halo.
+ */
+void comm_exchangeImgHalos(struct image_t *img, int rowIdx, int colIdx,
+    int rows, int cols, int depth)
+{
+    int left, right, up, down;
+    int firstColIdx, lastColIdx;
+
+    MPI_Cart_shift(gridComm, 1, 1, &left, &right);
+    MPI_Cart_shift(gridComm, 0, 1, &up, &down);
+
+    // Columns: send left while receiving from the right, then the other way
+    //  round (the rows of the block only)
+    exchangeBlocks(img, rows, depth, left, rowIdx, colIdx,
+        right, rowIdx, colIdx + cols, 5);
+    exchangeBlocks(img, rows, depth, right, rowIdx, colIdx + cols - depth,
+        left, rowIdx, colIdx - depth, 6);
+
+    // Rows, across the halos of the columns
+    firstColIdx = (left == MPI_PROC_NULL) ? colIdx : colIdx - depth;
+    lastColIdx = (right == MPI_PROC_NULL) ? colIdx + cols
+        : colIdx + cols + depth;
+    exchangeBlocks(img, depth, lastColIdx - firstColIdx, up, rowIdx,
+        firstColIdx, down, rowIdx + rows, firstColIdx, 7);
+    exchangeBlocks(img, depth, lastColIdx - firstColIdx, down,
+        rowIdx + rows - depth, firstColIdx, up, rowIdx - depth, firstColIdx,
+        8);
+}
+
+/******************************************************************************
+ * Image files
+ *****************************************************************************/
+
+/**
+ * Opens a raw image file on every process (MPI-IO), so that they read or
+ *  write their own rows. All processes must call it.
+ * @param const char *path The path of the file.
+ * @param int write 1 to create it (or empty it) and write it, 0 to read it.
+ * @return struct comm_file_t* The file or NULL.
+ */
+struct comm_file_t* comm_openImgFile(const char *path, int write)
+{
+    int err;
+    struct comm_file_t *retVal;
+
+    retVal = malloc(sizeof(struct comm_file_t));
+    if (retVal == NULL)
+        return NULL;
+    err = MPI_File_open(MY_COMM, path,
+        write ? MPI_MODE_CREATE | MPI_MODE_WRONLY : MPI_MODE_RDONLY,
+        MPI_INFO_NULL, &(retVal->file));
+    if (err != MPI_SUCCESS) {
+        free(retVal);
+        return NULL;
+    }
+    if (write)
+        MPI_File_set_size(retVal->file, 0);
+
+    return retVal;
+}
+
+/**
+ * Reads rows of a raw image file into an image, at once on every process
+ *  (collective MPI-IO). All processes must call it, with their own rows (if
+ *  any).
+ * @param struct comm_file_t *file The file.
+ * @param struct image_t *img The image (interleaved, with the samples of the
+ *  file).
+ * @param int rowIdx The first row of the image to fill.
+ * @param int fileRowIdx The first row of the file to read.
+ * @param int rows The amount of rows (0 for none).
+ */
+void comm_readImgRows(struct comm_file_t *file, struct image_t *img,
+    int rowIdx, int fileRowIdx, int rows)
+{
+    MPI_Datatype rowType;
+
+    rowType = makeRowType(img);
+    MPI_File_read_at_all(file->file, (MPI_Offset) fileRowIdx
+        * getRowSize(img), (rows > 0) ? getRowPtr(img, rowIdx) : img->data,
+        rows, rowType, MPI_STATUS_IGNORE);
+    MPI_Type_free(&rowType);
+}
+
+/**
+ * Writes rows of an image into a raw image file, at once on every process
+ *  (collective MPI-IO). All processes must call it, with their own rows (if
+ *  any).
+ * @param struct comm_file_t *file The file.
+ * @param struct image_t *img The image (interleaved, with the samples of the
+ *  file).
+ * @param int rowIdx The first row of the image to write.
+ * @param int fileRowIdx The first row of the file to fill.
+ * @param int rows The amount of rows (0 for none).
+ */
+void comm_writeImgRows(struct comm_file_t *file, struct image_t *img,
+    int rowIdx, int fileRowIdx, int rows)
+{
+    MPI_Datatype rowType;
+
+    rowType = makeRowType(img);
+    MPI_File_write_at_all(file->file, (MPI_Offset) fileRowIdx
+        * getRowSize(img), (rows > 0) ? getRowPtr(img, rowIdx) : img->data,
+        rows, rowType, MPI_STATUS_IGNORE);
+    MPI_Type_free(&rowType);
+}
+
+/**
+ * Closes a raw image file. All processes must call it.
+ * @param struct comm_file_t *file The file.
+ */
+void comm_closeImgFile(struct comm_file_t *file)
+{
+    MPI_File_close(&(file->file));
+    free(file);
+}
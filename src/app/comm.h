@@ -16,19 +16,44 @@
 
 #define COMM_ANY_RANK -1
 #define COMM_ANY_TAG -1
+#define COMM_NO_RANK -2
+
+/******************************************************************************
+ * Data structures
+ *****************************************************************************/
+
+typedef enum {              // How the image is split between the workers
+    COMM_SPLIT_AUTO = 0,    // Smallest halos for the image and worker count
+    COMM_SPLIT_STRIPS = 1,  // Horizontal strips (one per worker)
+    COMM_SPLIT_BLOCKS = 2,  // Blocks of a 2D grid of workers
+    COMM_SPLIT_TILES = 3    // Thin strips handed out on request (dynamic)
+} CommSplit;
+
+// Persistent exchange of image parts (see comm_makeImgExchange)
+struct comm_exchange_t;
+
+// Raw image file opened by every process (see comm_openImgFile)
+struct comm_file_t;
 
 /******************************************************************************
  * Start / stop the communication
  *****************************************************************************/
 
 /**
- * Starts the communication session.
+ * Starts the communication session. Only the main thread makes MPI calls
+ *  (MPI_THREAD_FUNNELED), so that the others can run convolution.
  * @param int *argc The arguments count (pointer).
  * @param char ***argv The list of arguments (pointer).
  * @return int The rank (id) of the process.
  */
 int comm_start(int *argc, char ***argv);
 
+/**
+ * Tells whether the MPI library supports threads besides the main one.
+ * @return int 1 if it does, 0 otherwise.
+ */
+int comm_isThreaded();
+
 /**
  * Stop the communication session.
  */
@@ -61,29 +86,121 @@ int comm_getSize();
 int comm_getRank();
 
 /******************************************************************************
- * Matrix transferring
+ * Reductions
  *****************************************************************************/
 
 /**
- * Broadcast a matrix to all processes of the communicator.
- * @param struct matrix_t *inMat The matrix to broadcast. Set to NULL for all
- *  non-root processes.
- * @return struct matirx_t* The broadcasted matrix. NULL in case of failure.
+ * Returns the minimum of a value over all processes of the communicator. All
+ *  of them must call it.
+ * @param int value The value of the process.
+ * @return int The minimum value.
  */
-struct matrix_t* comm_broadcastMatrix(struct matrix_t *inMat);
+int comm_reduceMin(int value);
+
+/**
+ * Returns the sum of a value over all processes of the communicator. All of
+ *  them must call it.
+ * @param long long value The value of the process.
+ * @return long long The sum.
+ */
+long long comm_reduceSum(long long value);
+
+/**
+ * Returns the maximum of a value over all processes of the communicator. All
+ *  of them must call it.
+ * @param double value The value of the process.
+ * @return double The maximum value.
+ */
+double comm_reduceMax(double value);
+
+/**
+ * Returns the sum of a value over all worker processes (every one but the
+ *  root). All of them must call it.
+ * @param long long value The value of the process.
+ * @return long long The sum.
+ */
+long long comm_reduceWorkersSum(long long value);
+
+/**
+ * Returns the maximum of a value over all worker processes (every one but the
+ *  root). All of them must call it.
+ * @param double value The value of the process.
+ * @return double The maximum value.
+ */
+double comm_reduceWorkersMax(double value);
 
 /******************************************************************************
- * Image transferring
+ * Grid of processes
  *****************************************************************************/
 
 /**
- * Broadcast an empty image (with proper dimensions though) to all processes of
- *  the communicator.
- * @param struct image_t *inImg The image to broadcast. Set to NULL for all
- *  non-root processes.
- * @return struct image_t* The broadcasted image. NULL in case of failure.
+ * Picks the rows and columns of a balanced grid of processes.
+ * @param int amount The amount of processes.
+ * @param int *dims The amount of rows, then of columns (filled, the first
+ *  one being the largest).
  */
-struct image_t* comm_broadcastEmptyImg(struct image_t *inImg);
+void comm_getGridDims(int amount, int *dims);
+
+/**
+ * Arranges the worker processes (every one but the root) as a Cartesian
+ *  grid, row-major in the order of their ranks (rank r is at row
+ *  (r - 1) / columns). All of them must call it, once.
+ * @param const int *dims The amount of rows and columns of the grid.
+ * @param const int *periods Whether the rows, then the columns, wrap around.
+ * @param int *coords The row and column of the process (filled).
+ */
+void comm_makeWorkersGrid(const int *dims, const int *periods, int *coords);
+
+/******************************************************************************
+ * Messages
+ *****************************************************************************/
+
+/**
+ * Checks whether a message is waiting to be received (e.g. a request of a
+ *  worker), without receiving it.
+ * @param int srcRank The source rank, or COMM_ANY_RANK.
+ * @param int tag The message tag to match, or COMM_ANY_TAG.
+ * @param int wait Whether to wait for a message rather than return at once.
+ * @return int The source rank of the message, or COMM_NO_RANK if none.
+ */
+int comm_probe(int srcRank, int tag, int wait);
+
+/**
+ * Sends a value to a process.
+ * @param int value The value.
+ * @param int destRank The destination rank.
+ * @param int tag The message tag to use.
+ */
+void comm_sendValue(int value, int destRank, int tag);
+
+/**
+ * Receives a value from a process.
+ * @param int srcRank The source rank.
+ * @param int tag The message tag to match.
+ * @return int The value.
+ */
+int comm_recvValue(int srcRank, int tag);
+
+/******************************************************************************
+ * Matrix transferring
+ *****************************************************************************/
+
+/**
+ * Broadcast a bank of matrices to all processes of the communicator: their
+ *  sizes, then the values of all of them in a single message.
+ * @param struct matrix_t **inMats The matrices to broadcast. Set to NULL for
+ *  all non-root processes.
+ * @param int *amount The amount of matrices. Filled for all non-root
+ *  processes.
+ * @return struct matrix_t** The broadcasted matrices (allocated for all
+ *  non-root processes). NULL in case of failure.
+ */
+struct matrix_t** comm_broadcastMatrices(struct matrix_t **inMats,
+    int *amount);
+
+/******************************************************************************
+ * Image transferring
+ *****************************************************************************/
 
 /**
  * Send an image part (data) to a process.
@@ -96,6 +213,42 @@ struct image_t* comm_broadcastEmptyImg(struct image_t *inImg);
 void comm_sendImgPart(struct image_t *img, int offsetRowIdx, int limit,
     int destRank, int tag);
 
+/**
+ * Starts scattering parts of an image from the root process to every
+ *  process, which gets its part in its own image (e.g. the image of its part
+ *  only). The parts may overlap (e.g. strips and their halos). All processes
+ *  must call it, then wait for it (see comm_waitImgParts).
+ * @param struct image_t *img The image (its data must stay in place).
+ * @param const int *offsetRowIdxs The offset (as row index) of the part of
+ *  every process in the image of the root process.
+ * @param const int *limits The limit (amount of rows) of the part of every
+ *  process (0 for none, as for the root process).
+ * @param int rowIdx The row of the image of the process receiving its part
+ *  (ignored for the root process).
+ */
+void comm_scatterImgParts(struct image_t *img, const int *offsetRowIdxs,
+    const int *limits, int rowIdx);
+
+/**
+ * Waits for all the scatters started by comm_scatterImgParts to be done.
+ */
+void comm_waitImgParts();
+
+/**
+ * Gathers parts of an image from every process to the root process. The
+ *  parts must not overlap in the image of the root process. All processes
+ *  must call it.
+ * @param struct image_t *img The image.
+ * @param const int *offsetRowIdxs The offset (as row index) of the part of
+ *  every process in the image of the root process.
+ * @param const int *limits The limit (amount of rows) of the part of every
+ *  process (0 for none, as for the root process).
+ * @param int rowIdx The row of the image of the process sending its part
+ *  (ignored for the root process).
+ */
+void comm_gatherImgParts(struct image_t *img, const int *offsetRowIdxs,
+    const int *limits, int rowIdx);
+
 /**
  * Receive an image part (data) to a process.
  * @param struct image_t *img The output image.
@@ -107,4 +260,149 @@ void comm_sendImgPart(struct image_t *img, int offsetRowIdx, int limit,
 void comm_recvImgPart(struct image_t *img, int offsetRowIdx, int limit,
     int srcRank, int tag);
 
+/**
+ * Exchanges image parts with two processes (e.g. the halos of the strips
+ *  above and below): a part is sent to each of them while a part is received
+ *  from each of them, with paired sends and receives so that a ring of
+ *  processes cannot deadlock. All parts have the same amount of rows.
+ * @param struct image_t *img The image.
+ * @param int limit The limit (amount of rows) of every part.
+ * @param int upRank The rank of the first process, or COMM_NO_RANK.
+ * @param int upSendRowIdx The offset (as row index) of the part sent to it.
+ * @param int upRecvRowIdx The offset of the part received from it.
+ * @param int downRank The rank of the second process, or COMM_NO_RANK.
+ * @param int downSendRowIdx The offset of the part sent to it.
+ * @param int downRecvRowIdx The offset of the part received from it.
+ */
+void comm_exchangeImgParts(struct image_t *img, int limit, int upRank,
+    int upSendRowIdx, int upRecvRowIdx, int downRank, int downSendRowIdx,
+    int downRecvRowIdx);
+
+/**
+ * Prepares an exchange of image parts with two processes, the same as
+ *  comm_exchangeImgParts, as persistent non-blocking requests: it can be
+ *  started and waited for as many times as needed, the image data being
+ *  convolved in between (but for the received parts).
+ * @param struct image_t *img The image (its data must stay in place).
+ * @param int limit The limit (amount of rows) of every part.
+ * @param int upRank The rank of the first process, or COMM_NO_RANK.
+ * @param int upSendRowIdx The offset (as row index) of the part sent to it.
+ * @param int upRecvRowIdx The offset of the part received from it.
+ * @param int downRank The rank of the second process, or COMM_NO_RANK.
+ * @param int downSendRowIdx The offset of the part sent to it.
+ * @param int downRecvRowIdx The offset of the part received from it.
+ * @return struct comm_exchange_t* The exchange or NULL.
+ */
+struct comm_exchange_t* comm_makeImgExchange(struct image_t *img, int limit,
+    int upRank, int upSendRowIdx, int upRecvRowIdx, int downRank,
+    int downSendRowIdx, int downRecvRowIdx);
+
+/**
+ * Starts an exchange of image parts, without waiting for it.
+ * @param struct comm_exchange_t *exchange The exchange.
+ */
+void comm_startImgExchange(struct comm_exchange_t *exchange);
+
+/**
+ * Waits for an exchange of image parts to be done.
+ * @param struct comm_exchange_t *exchange The exchange.
+ */
+void comm_waitImgExchange(struct comm_exchange_t *exchange);
+
+/**
+ * Destroys an exchange of image parts (not in progress).
+ * @param struct comm_exchange_t *exchange The exchange to destroy.
+ */
+void comm_destroyImgExchange(struct comm_exchange_t *exchange);
+
+/**
+ * Send a block of an image (data) to a process.
+ * @param struct image_t *img The input image.
+ * @param int rowIdx The first row of the block.
+ * @param int colIdx The first column (pixel) of the block.
+ * @param int rows The amount of rows.
+ * @param int cols The amount of columns.
+ * @param int destRank The destination rank.
+ * @param int tag The message tag to use.
+ */
+void comm_sendImgBlock(struct image_t *img, int rowIdx, int colIdx, int rows,
+    int cols, int destRank, int tag);
+
+/**
+ * Receive a block of an image (data) from a process. The block may be at
+ *  another place than the sent one, but has the same size.
+ * @param struct image_t *img The output image.
+ * @param int rowIdx The first row of the block.
+ * @param int colIdx The first column (pixel) of the block.
+ * @param int rows The amount of rows.
+ * @param int cols The amount of columns.
+ * @param int srcRank The source rank.
+ * @param int tag The message tag to match.
+ */
+void comm_recvImgBlock(struct image_t *img, int rowIdx, int colIdx, int rows,
+    int cols, int srcRank, int tag);
+
+/**
+ * Exchanges the halos of a block with the four neighbours of the process on
+ *  the grid of workers (see comm_makeWorkersGrid): the columns on the left
+ *  and right first, then the rows above and below with the halos of the
+ *  columns, so that the corners come from the diagonal neighbours. The image
+ *  must have room for the halos on the sides with a neighbour.
+ * @param struct image_t *img The image holding the block and its halos.
+ * @param int rowIdx The first row of the block.
+ * @param int colIdx The first column (pixel) of the block.
+ * @param int rows The amount of rows of the block.
+ * @param int cols The amount of columns of the block.
+ * @param int depth The amount of rows or columns of every halo.
+ */
+void comm_exchangeImgHalos(struct image_t *img, int rowIdx, int colIdx,
+    int rows, int cols, int depth);
+
+/******************************************************************************
+ * Image files
+ *****************************************************************************/
+
+/**
+ * Opens a raw image file on every process (MPI-IO), so that they read or
+ *  write their own rows. All processes must call it.
+ * @param const char *path The path of the file.
+ * @param int write 1 to create it (or empty it) and write it, 0 to read it.
+ * @return struct comm_file_t* The file or NULL.
+ */
+struct comm_file_t* comm_openImgFile(const char *path, int write);
+
+/**
+ * Reads rows of a raw image file into an image, at once on every process
+ *  (collective MPI-IO). All processes must call it, with their own rows (if
+ *  any).
+ * @param struct comm_file_t *file The file.
+ * @param struct image_t *img The image (interleaved, with the samples of the
+ *  file).
+ * @param int rowIdx The first row of the image to fill.
+ * @param int fileRowIdx The first row of the file to read.
+ * @param int rows The amount of rows (0 for none).
+ */
+void comm_readImgRows(struct comm_file_t *file, struct image_t *img,
+    int rowIdx, int fileRowIdx, int rows);
+
+/**
+ * Writes rows of an image into a raw image file, at once on every process
+ *  (collective MPI-IO). All processes must call it, with their own rows (if
+ *  any).
+ * @param struct comm_file_t *file The file.
+ * @param struct image_t *img The image (interleaved, with the samples of the
+ *  file).
+ * @param int rowIdx The first row of the image to write.
+ * @param int fileRowIdx The first row of the file to fill.
+ * @param int rows The amount of rows (0 for none).
+ */
+void comm_writeImgRows(struct comm_file_t *file, struct image_t *img,
+    int rowIdx, int fileRowIdx, int rows);
+
+/**
+ * Closes a raw image file. All processes must call it.
+ * @param struct comm_file_t *file The file.
+ */
+void comm_closeImgFile(struct comm_file_t *file);
+
 #endif
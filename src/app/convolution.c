@@ -5,8 +5,531 @@
  *  Image convolution implementation.
  *****************************************************************************/
 #include "convolution.h"
+#include "simd.h"
+#include "fft.h"
+#include "winograd.h"
+#include "jit.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/******************************************************************************
+ * Internals
+ *****************************************************************************/
+
+static inline unsigned char clampByte(double v)
+{
+    // Same as truncating to an int and clamping to [0, 255]
+    return (v >= 255) ? 255 : (v <= 0) ? 0 : (unsigned char) v;
+}
+
+// The change of the rows and the taps of the sparse engine are compiled for
+//  several instruction sets, the best one being picked when the program is
+//  loaded
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define CONV_CLONES \
+    __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define CONV_CLONES
+#endif
+
+// The products and sums of the taps are rounded one by one rather than fused,
+//  as the fused ones only cover the vectorised columns, which would make a
+//  sample depend on where it falls in the row (e.g. in a block or a strip)
+#if defined(__GNUC__) && !defined(__clang__)
+#define CONV_UNFUSED __attribute__((optimize("fp-contract=off")))
+#else
+#define CONV_UNFUSED
+#endif
+
+// Bytes whose squared differences add up within 32 bits
+#define DELTA_BLOCK_BYTES 32768
+
+/**
+ * Restricts bytes of a row to the ones whose change is tracked by a delta.
+ * @param const struct conv_delta_t *delta The change.
+ * @param int byteIdx The first byte (in the row).
+ * @param int *n The amount of bytes, set to the tracked ones.
+ * @return int The amount of bytes skipped before the tracked ones.
+ */
+static int clipDelta(const struct conv_delta_t *delta, int byteIdx, int *n)
+{
+    int first, end;
+
+    if (delta->endByte <= 0)
+        return 0;
+    first = (byteIdx > delta->firstByte) ? byteIdx : delta->firstByte;
+    end = (byteIdx + *n < delta->endByte) ? byteIdx + *n : delta->endByte;
+    *n = (end > first) ? end - first : 0;
+    return first - byteIdx;
+}
+
+/**
+ * Adds the change between an input and an output row to a delta, right after
+ *  the output row is stored (i.e. while both are in the cache).
+ * @param struct conv_delta_t *delta The change, added to (nothing done if
+ *  NULL).
+ * @param const unsigned char *in The input bytes.
+ * @param const unsigned char *out The output bytes.
+ * @param int byteIdx The first byte (in the row, see clipDelta).
+ * @param int n The amount of bytes.
+ */
+CONV_CLONES
+static void addDelta(struct conv_delta_t *delta,
+    const unsigned char *restrict in, const unsigned char *restrict out,
+    int byteIdx, int n)
+{
+    int i, j, end;
+    unsigned int sum, d;
+    unsigned char diff, maxDiff;
+
+    if (delta == NULL)
+        return;
+    i = clipDelta(delta, byteIdx, &n);
+    in += i;
+    out += i;
+
+    // Blocks of 32-bit sums, and byte-sized differences
+    maxDiff = 0;
+    for (j = 0; j < n; j += DELTA_BLOCK_BYTES) {
+        end = (n - j < DELTA_BLOCK_BYTES) ? n : j + DELTA_BLOCK_BYTES;
+        sum = 0;
+        for (i = j; i < end; i++) {
+            diff = (out[i] > in[i]) ? out[i] - in[i] : in[i] - out[i];
+            d = diff;
+            sum += d * d;
+            maxDiff = (diff > maxDiff) ? diff : maxDiff;
+        }
+        delta->sumSquares += sum;
+    }
+    if (maxDiff > delta->maxDiff)
+        delta->maxDiff = maxDiff;
+}
+
+/**
+ * Accumulates taps of the sparse engine over a row, up to four at a time so
+ *  that the accumulators are loaded and stored once for all of them:
+ *  acc += sum of weight * input row. Defined for every sample type.
+ * @param float *acc The accumulators.
+ * @param const unsigned char **in The input samples of every tap.
+ * @param const float *weights The weight of every tap.
+ * @param int taps The amount of taps (1 to 4).
+ * @param int n The amount of samples.
+ */
+#define SPARSE_TAPS(name, type) \
+CONV_CLONES CONV_UNFUSED \
+static void name(float *restrict acc, const unsigned char **in, \
+    const float *weights, int taps, int n) \
+{ \
+    int i; \
+    float w0, w1, w2, w3; \
+    const type *restrict in0, *restrict in1, *restrict in2, *restrict in3; \
+\
+    w0 = weights[0]; \
+    in0 = (const type *) in[0]; \
+    if (taps == 1) { \
+        for (i = 0; i < n; i++) \
+            acc[i] += w0 * in0[i]; \
+        return; \
+    } \
+    w1 = weights[1]; \
+    in1 = (const type *) in[1]; \
+    if (taps == 2) { \
+        for (i = 0; i < n; i++) \
+            acc[i] += w0 * in0[i] + w1 * in1[i]; \
+        return; \
+    } \
+    w2 = weights[2]; \
+    in2 = (const type *) in[2]; \
+    if (taps == 3) { \
+        for (i = 0; i < n; i++) \
+            acc[i] += w0 * in0[i] + w1 * in1[i] + w2 * in2[i]; \
+        return; \
+    } \
+    w3 = weights[3]; \
+    in3 = (const type *) in[3]; \
+    for (i = 0; i < n; i++) \
+        acc[i] += w0 * in0[i] + w1 * in1[i] + w2 * in2[i] + w3 * in3[i]; \
+}
+
+SPARSE_TAPS(addSparseTaps, unsigned char)
+SPARSE_TAPS(addSparseTaps16, unsigned short)
+SPARSE_TAPS(addSparseTapsF32, float)
+
+/**
+ * Adds the change between an input and an output row of 16-bit or float
+ *  samples to a delta, in levels of the samples (the squared changes of float
+ *  samples being rounded one by one to fixed-point, see conv_delta_t).
+ * @param struct conv_delta_t *delta The change, added to (nothing done if
+ *  NULL).
+ * @param const unsigned char *in The input samples.
+ * @param const unsigned char *out The output samples (same type).
+ * @param int byteIdx The first byte (in the row, see clipDelta).
+ * @param int n The amount of samples.
+ * @param ImgSampleType sampleType The type of the samples.
+ */
+CONV_CLONES
+static void addSampleDelta(struct conv_delta_t *delta,
+    const unsigned char *in, const unsigned char *out, int byteIdx, int n,
+    ImgSampleType sampleType)
+{
+    int i, size;
+    long long sum;
+    double diff, maxDiff;
+    const unsigned short *in16, *out16;
+    const float *inF, *outF;
+
+    if (delta == NULL)
+        return;
+    size = img_getSampleSize(sampleType);
+    n *= size;
+    i = clipDelta(delta, byteIdx, &n);
+    in += i;
+    out += i;
+    n /= size;
+
+    sum = 0;
+    maxDiff = 0;
+    in16 = (const unsigned short *) in;
+    out16 = (const unsigned short *) out;
+    inF = (const float *) in;
+    outF = (const float *) out;
+    for (i = 0; i < n; i++) {
+        if (sampleType == IMG_SAMPLE_U16) {
+            diff = abs(out16[i] - in16[i]);
+            sum += (long long) diff * diff;
+        } else {
+            diff = fabs((double) outF[i] - inF[i]);
+            sum += llround(diff * diff * CONV_DELTA_FLOAT_ONE);
+        }
+        maxDiff = (diff > maxDiff) ? diff : maxDiff;
+    }
+    delta->sumSquares += sum;
+    if (maxDiff > delta->maxDiff)
+        delta->maxDiff = maxDiff;
+}
+
+/**
+ * Stores a row of 16-bit or float samples (truncated towards zero and clamped
+ *  to [0, 65535], or as they are), and adds the change to a delta (see
+ *  addSampleDelta).
+ * @param unsigned char *out The output samples.
+ * @param const float *acc The values.
+ * @param const unsigned char *in The input samples (same type).
+ * @param int byteIdx The first byte (in the row).
+ * @param int n The amount of samples.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @param struct conv_delta_t *delta The change, added to (NULL if not
+ *  tracked).
+ */
+CONV_CLONES
+static void storeSamples(unsigned char *out, const float *restrict acc,
+    const unsigned char *in, int byteIdx, int n, ImgSampleType sampleType,
+    struct conv_delta_t *delta)
+{
+    int i;
+    unsigned short *restrict out16;
+    float *restrict outF;
+
+    // Store
+    out16 = (unsigned short *) out;
+    outF = (float *) out;
+    if (sampleType == IMG_SAMPLE_U16)
+        for (i = 0; i < n; i++)
+            out16[i] = (acc[i] >= 65535) ? 65535
+                : (acc[i] <= 0) ? 0 : (unsigned short) acc[i];
+    else
+        for (i = 0; i < n; i++)
+            outF[i] = acc[i];
+    addSampleDelta(delta, in, out, byteIdx, n, sampleType);
+}
+
+/**
+ * Fixed-point row convolution with 32-bit weights and 64-bit accumulators,
+ *  for the weights that do not fit the vector kernels.
+ * @see SimdFixedRowKernel
+ */
+static void convolveRowFixedWide(unsigned char *out, int n,
+    const unsigned char **rows, const int *weights, int k, int pixelSize,
+    int bits)
+{
+    int i, a, b;
+    long long acc;
+
+    for (i = 0; i < n; i++) {
+        acc = 0;
+        for (a = 0; a < k; a++)
+            for (b = 0; b < k; b++)
+                acc += (long long) weights[a * k + b]
+                    * rows[a][i + b * pixelSize];
+        acc >>= bits;
+        out[i] = (acc > 255) ? 255 : (acc < 0) ? 0 : acc;
+    }
+}
+
+// Pass along the columns of the box engine
+typedef struct {
+    int k;                  // Box size
+    int count;              // Rows fed so far
+    double *window;         // The last k rows fed (row r at slot r % k)
+    double *sums;           // Their sums
+} BoxPass;
+
+/**
+ * Picks the sizes of the box passes approximating a Gaussian: n boxes of size
+ *  w have a variance of n (w^2 - 1) / 12, so the passes use the two odd sizes
+ *  around the ideal one, as many of each as gives the closest variance.
+ * @param double sigma The standard deviation of the Gaussian in pixels.
+ * @param int passes The amount of passes.
+ * @param int *radii Filled with the radius of every pass.
+ * @return int The sum of the radii (radius of the whole filter) or -1.
+ */
+static int getBoxRadii(double sigma, int passes, int *radii)
+{
+    int i, small, nSmall, retVal;
+    double variance;
+
+    // Check params
+    if (sigma <= 0 || passes < 1 || passes > CONV_MAX_BOX_PASSES)
+        return -1;
+
+    // Sizes and amount of passes of the smaller size
+    variance = 12 * sigma * sigma;
+    small = floor(sqrt(variance / passes + 1));
+    if (small % 2 == 0)
+        small--;
+    nSmall = round((variance - passes * (small * small + 4 * small + 3))
+        / (-4.0 * small - 4));
+    if (nSmall < 0)
+        nSmall = 0;
+    if (nSmall > passes)
+        nSmall = passes;
+
+    // Radii
+    retVal = 0;
+    for (i = 0; i < passes; i++) {
+        radii[i] = (i < nSmall) ? (small - 1) / 2 : (small + 1) / 2;
+        retVal += radii[i];
+    }
+
+    return retVal;
+}
+
+/**
+ * One box pass along a row: out[i] is the sum of the k samples of the channel
+ *  of i starting at in[i], updated from out[i - pixelSize] by adding the
+ *  entering sample and removing the leaving one. The running sum of each
+ *  channel stays in a register, and the difference of the samples is taken
+ *  first so that only one addition is on the critical path.
+ * @param const double *in The input row (n + (k - 1) * pixelSize values).
+ * @param int n The amount of output values.
+ * @param int k The box size.
+ * @param int pixelSize The pixel size in bytes (distance between samples).
+ * @param double *out The output row.
+ */
+static void runBoxRow(const double *restrict in, int n, int k, int pixelSize,
+    double *restrict out)
+{
+    int i, b, c;
+    double sum;
+
+    for (c = 0; c < pixelSize && c < n; c++) {
+        // First pixel: whole window
+        sum = 0;
+        for (b = 0; b < k; b++)
+            sum += in[c + b * pixelSize];
+        out[c] = sum;
+
+        // Then slide it
+        for (i = c + pixelSize; i < n; i += pixelSize) {
+            sum += in[i + (k - 1) * pixelSize] - in[i - pixelSize];
+            out[i] = sum;
+        }
+    }
+}
+
+// Partial convolution method (same parameters as conv_runVectorPartially)
+typedef void (*ConvMethod)(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Runs a method on every plane of a planar image, each plane being an image
+ *  of 1 byte pixels, so that the kernels read contiguous samples of a single
+ *  channel.
+ * @param ConvMethod method The method.
+ * @param struct image_t *inImg The input image (planar).
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image (planar).
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+static void runPlanes(ConvMethod method, struct image_t *inImg,
+    int offsetRowIdx, int limit, struct image_t *outImg,
+    struct conv_filter_t *filter)
+{
+    int c;
+    struct image_t inPlane, outPlane;
+
+    for (c = 0; c < inImg->pixelSize; c++) {
+        img_getPlane(inImg, c, &inPlane);
+        img_getPlane(outImg, c, &outPlane);
+        method(&inPlane, offsetRowIdx, limit, &outPlane, filter);
+    }
+}
+
+// Measured cost of a pair of FFT tiles per size^2 (nanoseconds, same image
+//  and CPU as CONV_COST_DIRECT_TAP), by log2(size). Besides the log2(size)
+//  factor of the transforms, tiles above 128 x 128 no longer fit the caches.
+static const double fftTileCosts[] = {
+    0, 0, 8, 11, 15, 20, 25, 30, 46, 58, 62
+};
+
+/**
+ * Returns the size of a data cache level, from the system or a default value.
+ * @param int level The cache level (1 or 2).
+ * @return long The size in bytes.
+ */
+static long getCacheSize(int level)
+{
+    long retVal;
+
+    retVal = -1;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+    retVal = sysconf((level == 1) ? _SC_LEVEL1_DCACHE_SIZE
+        : _SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (retVal <= 0)
+        retVal = (level == 1) ? CONV_DEFAULT_L1_SIZE : CONV_DEFAULT_L2_SIZE;
+
+    return retVal;
+}
+
+/**
+ * Picks the FFT size of the overlap-save tiles of a strip, i.e. the one with
+ *  the least estimated cost.
+ * @param int k The filter size.
+ * @param int width The image width.
+ * @param int rows The amount of rows of the strip.
+ * @param int pixelSize The pixel size in bytes.
+ * @param double *cost Filled with the estimated cost (nanoseconds). May be
+ *  NULL.
+ * @return int The FFT size or 0 if the filter is too large.
+ */
+static int chooseFftSize(int k, int width, int rows, int pixelSize,
+    double *cost)
+{
+    int size, logSize, valid, retVal;
+    double pairs, sizeCost, minCost;
+
+    retVal = 0;
+    minCost = 0;
+    for (size = FFT_MIN_SIZE, logSize = 2; size <= FFT_MAX_SIZE;
+        size <<= 1, logSize++) {
+        valid = size - k + 1;
+        if (valid < 1)
+            continue;
+        pairs = ceil(ceil(width / (double) valid)
+            * ceil(rows / (double) valid) * pixelSize / 2.0);
+        sizeCost = pairs * size * size * fftTileCosts[logSize];
+        if (retVal == 0 || sizeCost < minCost) {
+            retVal = size;
+            minCost = sizeCost;
+        }
+    }
+    if (cost != NULL)
+        *cost = minCost;
+
+    return retVal;
+}
+
+/**
+ * Copies a tile of a padded strip (one byte of every pixel) into a matrix,
+ *  with zeros beyond the strip.
+ * @param struct image_t *padded The padded strip.
+ * @param int rowIdx The first row of the tile.
+ * @param int pixelIdx The first pixel of the tile.
+ * @param int byteIdx The byte of the pixels.
+ * @param int size The tile size.
+ * @param double *tile The size x size matrix.
+ */
+static void loadTile(struct image_t *padded, int rowIdx, int pixelIdx,
+    int byteIdx, int size, double *tile)
+{
+    int i, j, n;
+    unsigned char *in;
+
+    n = padded->width - pixelIdx;
+    if (n > size)
+        n = size;
+    for (i = 0; i < size; i++) {
+        if (rowIdx + i >= padded->height) {
+            for (j = 0; j < size; j++)
+                tile[i * size + j] = 0;
+            continue;
+        }
+        in = &(padded->rows[rowIdx + i][pixelIdx * padded->pixelSize
+            + byteIdx]);
+        for (j = 0; j < n; j++)
+            tile[i * size + j] = in[j * padded->pixelSize];
+        for (; j < size; j++)
+            tile[i * size + j] = 0;
+    }
+}
+
+/**
+ * Copies the valid part of a convolved tile (all but the first k - 1 rows and
+ *  columns) into the output image.
+ * @param double *tile The size x size matrix.
+ * @param int size The tile size.
+ * @param int k The filter size.
+ * @param struct image_t *inImg The input image.
+ * @param struct image_t *outImg The output image.
+ * @param int rowIdx The first output row of the tile.
+ * @param int endRowIdx The end of the strip (exclusive row index).
+ * @param int pixelIdx The first output pixel of the tile.
+ * @param int byteIdx The byte of the pixels.
+ * @param struct conv_delta_t *delta The change, added to (NULL if not
+ *  tracked).
+ */
+static void storeTile(double *tile, int size, int k, struct image_t *inImg,
+    struct image_t *outImg, int rowIdx, int endRowIdx, int pixelIdx,
+    int byteIdx, struct conv_delta_t *delta)
+{
+    int i, j, n, d, idx, tracked;
+    unsigned char *out;
+    const unsigned char *in;
+
+    n = outImg->width - pixelIdx;
+    if (n > size - k + 1)
+        n = size - k + 1;
+    for (i = k - 1; i < size && rowIdx < endRowIdx; i++, rowIdx++) {
+        idx = pixelIdx * outImg->pixelSize + byteIdx;
+        out = &(outImg->rows[rowIdx][idx]);
+        for (j = 0; j < n; j++)
+            out[j * outImg->pixelSize] = clampByte(tile[i * size + k - 1 + j]);
+
+        // Change of the bytes (strided, so not with addDelta)
+        if (delta == NULL)
+            continue;
+        in = &(inImg->rows[rowIdx][idx]);
+        for (j = 0; j < n; j++) {
+            tracked = idx + j * outImg->pixelSize;
+            if (delta->endByte > 0 && (tracked < delta->firstByte
+                || tracked >= delta->endByte))
+                continue;
+            d = out[j * outImg->pixelSize] - in[j * outImg->pixelSize];
+            delta->sumSquares += d * d;
+            d = (d < 0) ? -d : d;
+            if (d > delta->maxDiff)
+                delta->maxDiff = d;
+        }
+    }
+}
 
 /******************************************************************************
  * Filter normalization
@@ -46,12 +569,497 @@ struct matrix_t* conv_normalizeFilter(struct matrix_t *mat)
     return retVal;
 }
 
+/******************************************************************************
+ * Filter analysis
+ *****************************************************************************/
+
+/**
+ * Checks whether a filter is separable (rank 1), i.e. it can be written as a
+ *  column vector times a row vector.
+ * @param struct matrix_t *mat The filter.
+ * @param double tolerance The maximum residual allowed for any coefficient,
+ *  relative to the largest absolute coefficient.
+ * @param double *colVec Filled with the column vector (mat->height values).
+ *  May be NULL.
+ * @param double *rowVec Filled with the row vector (mat->width values). May be
+ *  NULL.
+ * @return int 1 if the filter is separable, 0 otherwise.
+ */
+int conv_isSeparable(struct matrix_t *mat, double tolerance, double *colVec,
+    double *rowVec)
+{
+    int i, j;
+    int pivotI, pivotJ;
+    double max, pivot, residual;
+
+    // Find the pivot (largest absolute coefficient)
+    max = 0;
+    pivotI = pivotJ = 0;
+    for (i = 0; i < mat->height; i++)
+        for (j = 0; j < mat->width; j++)
+            if (fabs(mat->values[i][j]) > max) {
+                max = fabs(mat->values[i][j]);
+                pivotI = i;
+                pivotJ = j;
+            }
+    if (max == 0)
+        return 0;
+    pivot = mat->values[pivotI][pivotJ];
+
+    // If the filter is rank 1, every row is a multiple of the pivot row, so
+    //  mat[i][j] = mat[i][pivotJ] * mat[pivotI][j] / pivot
+    for (i = 0; i < mat->height; i++)
+        for (j = 0; j < mat->width; j++) {
+            residual = mat->values[i][j]
+                - mat->values[i][pivotJ] * mat->values[pivotI][j] / pivot;
+            if (fabs(residual) > tolerance * max)
+                return 0;
+        }
+
+    // Decompose
+    if (colVec != NULL)
+        for (i = 0; i < mat->height; i++)
+            colVec[i] = mat->values[i][pivotJ];
+    if (rowVec != NULL)
+        for (j = 0; j < mat->width; j++)
+            rowVec[j] = mat->values[pivotI][j] / pivot;
+
+    return 1;
+}
+
+/**
+ * Makes the filter approximating a Gaussian by box passes, i.e. the
+ *  composition of the boxes (see conv_useBoxPasses). The box sizes are the
+ *  odd ones whose composition has the closest variance to sigma^2.
+ * @param double sigma The standard deviation of the Gaussian in pixels.
+ * @param int passes The amount of box passes (1 to CONV_MAX_BOX_PASSES).
+ * @return struct matrix_t* The normalized filter or NULL.
+ */
+struct matrix_t* conv_makeGaussianMatrix(double sigma, int passes)
+{
+    int i, j, b, k, len, boxSize;
+    int radii[CONV_MAX_BOX_PASSES];
+    double norm, *counts, *tmp;
+    struct matrix_t *retVal;
+
+    // Box sizes
+    k = getBoxRadii(sigma, passes, radii);
+    if (k < 0)
+        return NULL;
+    k = 2 * k + 1;
+
+    // Compose the boxes in one dimension (counts of the paths of every tap)
+    counts = calloc(k, sizeof(double));
+    tmp = calloc(k, sizeof(double));
+    if (counts == NULL || tmp == NULL) {
+        free(counts);
+        free(tmp);
+        return NULL;
+    }
+    counts[0] = 1;
+    len = 1;
+    norm = 1;
+    for (i = 0; i < passes; i++) {
+        boxSize = 2 * radii[i] + 1;
+        for (j = 0; j < len + boxSize - 1; j++) {
+            tmp[j] = 0;
+            for (b = 0; b < boxSize; b++)
+                if (j - b >= 0 && j - b < len)
+                    tmp[j] += counts[j - b];
+        }
+        len += boxSize - 1;
+        for (j = 0; j < len; j++)
+            counts[j] = tmp[j];
+        norm *= boxSize;
+    }
+
+    // Separable filter
+    retVal = mat_make(k, k);
+    if (retVal != NULL)
+        for (i = 0; i < k; i++)
+            for (j = 0; j < k; j++)
+                retVal->values[i][j] = counts[i] * counts[j] / (norm * norm);
+
+    // Clean up
+    free(counts);
+    free(tmp);
+
+    return retVal;
+}
+
+/**
+ * Analyses a normalized filter and prepares it for convolution. Uniform
+ *  filters are detected as single box passes.
+ * @param struct matrix_t *normFilter The normalized filter. It must outlive
+ *  the returned instance.
+ * @return struct conv_filter_t* The prepared filter or NULL.
+ */
+struct conv_filter_t* conv_makeFilter(struct matrix_t *normFilter)
+{
+    int i, j, k;
+    struct conv_filter_t *retVal;
+
+    // Allocate space
+    retVal = malloc(sizeof(struct conv_filter_t));
+    if (retVal == NULL)
+        return NULL;
+    retVal->mat = normFilter;
+    retVal->border = IMG_BORDER_ZERO;
+    retVal->engine = CONV_ENGINE_AUTO;
+    retVal->tileWidth = 0;
+    retVal->threads = 1;
+    retVal->schedule = CONV_SCHEDULE_STATIC;
+    retVal->fixedBits = 0;
+    retVal->fixedWeights = NULL;
+    retVal->fixedWeights16 = NULL;
+    retVal->jit = NULL;
+    retVal->delta = NULL;
+    retVal->radius = (normFilter->width - 1) / 2;
+    k = 2 * retVal->radius + 1;
+    retVal->colVec = malloc(sizeof(double) * normFilter->height);
+    retVal->rowVec = malloc(sizeof(double) * normFilter->width);
+    retVal->weights = malloc(sizeof(float) * k * k);
+    retVal->taps = malloc(sizeof(struct conv_tap_t) * k * k);
+    if (retVal->colVec == NULL || retVal->rowVec == NULL
+        || retVal->weights == NULL || retVal->taps == NULL) {
+        conv_destroyFilter(retVal);
+        return NULL;
+    }
+
+    // Flipped weights, so that tap (a, b) reads input pixel
+    //  (rowIdx - radius + a, pixelIdx - radius + b)
+    for (i = 0; i < k; i++)
+        for (j = 0; j < k; j++)
+            retVal->weights[i * k + j] =
+                normFilter->values[k - 1 - i][k - 1 - j];
+
+    // Non-zero taps
+    retVal->nTaps = 0;
+    for (i = 0; i < k * k; i++)
+        if (retVal->weights[i] != 0) {
+            retVal->taps[retVal->nTaps].dy = i / k;
+            retVal->taps[retVal->nTaps].dx = i % k;
+            retVal->taps[retVal->nTaps++].weight = retVal->weights[i];
+        }
+
+    // Winograd transform (3x3 filters)
+    if (k == 3)
+        winograd_transformFilter(retVal->weights, retVal->winogradWeights);
+
+    // Separability (square filters only)
+    retVal->separable = normFilter->width == normFilter->height
+        && conv_isSeparable(normFilter, CONV_SEPARABLE_TOLERANCE,
+            retVal->colVec, retVal->rowVec);
+
+    // Uniform filters are single boxes
+    retVal->boxScale = normFilter->values[0][0];
+    retVal->boxRadii[0] = retVal->radius;
+    retVal->boxPasses = retVal->separable && retVal->boxScale != 0;
+    for (i = 0; i < k && retVal->boxPasses; i++)
+        for (j = 0; j < k; j++)
+            if (fabs(normFilter->values[i][j] - retVal->boxScale)
+                > CONV_SEPARABLE_TOLERANCE * fabs(retVal->boxScale)) {
+                retVal->boxPasses = 0;
+                break;
+            }
+
+    return retVal;
+}
+
+/**
+ * Marks a prepared filter as made by conv_makeGaussianMatrix(), so that the
+ *  box engine applies it as box passes.
+ * @param struct conv_filter_t *filter The filter prepared from the matrix.
+ * @param double sigma The standard deviation of the Gaussian in pixels.
+ * @param int passes The amount of box passes.
+ * @return int 1 on success, 0 if the filter does not match the passes.
+ */
+int conv_useBoxPasses(struct conv_filter_t *filter, double sigma,
+    int passes)
+{
+    int i, boxSize;
+    int radii[CONV_MAX_BOX_PASSES];
+
+    // Check params
+    if (getBoxRadii(sigma, passes, radii) != filter->radius)
+        return 0;
+
+    // Passes (those of radius 0 change nothing)
+    filter->boxPasses = 0;
+    filter->boxScale = 1;
+    for (i = 0; i < passes; i++) {
+        if (radii[i] == 0)
+            continue;
+        boxSize = 2 * radii[i] + 1;
+        filter->boxRadii[filter->boxPasses++] = radii[i];
+        filter->boxScale /= (double) boxSize * boxSize;
+    }
+    if (filter->boxPasses == 0) {
+        filter->boxRadii[0] = 0;
+        filter->boxPasses = 1;
+    }
+
+    return 1;
+}
+
+/**
+ * Quantises the filter into fixed-point weights. From then on the filter is
+ *  applied with integer arithmetic, rounding once per output byte.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param int bits The fractional bits of the weights.
+ * @return double The worst-case error against the double precision result,
+ *  in intensity levels (before truncating to bytes), or -1 on failure.
+ */
+double conv_quantizeFilter(struct conv_filter_t *filter, int bits)
+{
+    int i, k, fits16;
+    double scale, w, q, error;
+    long long sumAbs;
+
+    // Check params
+    if (bits < CONV_FIXED_MIN_BITS || bits > CONV_FIXED_MAX_BITS)
+        return -1;
+
+    // Allocate space
+    k = 2 * filter->radius + 1;
+    free(filter->fixedWeights);
+    free(filter->fixedWeights16);
+    filter->fixedWeights16 = NULL;
+    filter->fixedWeights = malloc(sizeof(int) * k * k);
+    if (filter->fixedWeights == NULL) {
+        filter->fixedBits = 0;
+        return -1;
+    }
+
+    // Quantise (round to nearest). Every weight is off by at most half a
+    //  step, and each byte contributes at most 255 times its weight's error.
+    scale = ldexp(1, bits);
+    error = 0;
+    sumAbs = 0;
+    for (i = 0; i < k * k; i++) {
+        w = filter->mat->values[(k * k - 1 - i) / k][(k * k - 1 - i) % k];
+        q = round(w * scale);
+        if (fabs(q) > INT_MAX) {
+            free(filter->fixedWeights);
+            filter->fixedWeights = NULL;
+            filter->fixedBits = 0;
+            return -1;
+        }
+        filter->fixedWeights[i] = q;
+        error += fabs(w - q / scale);
+        sumAbs += llabs(filter->fixedWeights[i]);
+    }
+    filter->fixedBits = bits;
+
+    // 16-bit weights for the vector kernels, as long as the 32-bit
+    //  accumulators cannot overflow
+    fits16 = 255 * sumAbs <= INT_MAX;
+    for (i = 0; i < k * k && fits16; i++)
+        fits16 = filter->fixedWeights[i] >= SHRT_MIN
+            && filter->fixedWeights[i] <= SHRT_MAX;
+    if (fits16) {
+        filter->fixedWeights16 = malloc(sizeof(short) * k * k);
+        if (filter->fixedWeights16 != NULL)
+            for (i = 0; i < k * k; i++)
+                filter->fixedWeights16[i] = filter->fixedWeights[i];
+    }
+
+    return 255 * error;
+}
+
+/**
+ * Generates the machine code of the vector kernel of the filter (see jit.h).
+ *  It is kept when it is cheaper than the static kernels according to the
+ *  measured costs (see CONV_COST_JIT_TAP), i.e. when many weights are zero
+ *  or the filter is separable. From then on the direct engine runs it, the
+ *  static kernels only computing the bytes left over at the end of the
+ *  column blocks.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param int pixelSize The pixel size in bytes of the images (1 for planar
+ *  images).
+ * @return int 1 if the kernel is kept, 0 if the static kernels are cheaper,
+ *  -1 if code cannot be generated.
+ */
+int conv_compileFilter(struct conv_filter_t *filter, int pixelSize)
+{
+    int k;
+    double staticCost, jitCost;
+
+    // Generate
+    k = 2 * filter->radius + 1;
+    if (filter->jit != NULL)
+        jit_destroyKernel(filter->jit);
+    filter->jit = jit_makeRowKernel(filter->weights, k, pixelSize);
+    if (filter->jit == NULL)
+        return -1;
+
+    // Keep it if it is cheaper than the engine it replaces
+    if (filter->separable)
+        staticCost = CONV_COST_SEPARABLE_BYTE
+            + 2 * k * CONV_COST_SEPARABLE_TAP;
+    else
+        staticCost = CONV_COST_DIRECT_BYTE + k * k * CONV_COST_DIRECT_TAP;
+    jitCost = CONV_COST_JIT_BYTE + filter->jit->taps * CONV_COST_JIT_TAP
+        + filter->jit->groups * CONV_COST_JIT_GROUP;
+    if (jitCost >= staticCost) {
+        jit_destroyKernel(filter->jit);
+        filter->jit = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Destroys a prepared filter. The underlying matrix is not destroyed.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_destroyFilter(struct conv_filter_t *filter)
+{
+    if (filter->jit != NULL)
+        jit_destroyKernel(filter->jit);
+    free(filter->fixedWeights);
+    free(filter->fixedWeights16);
+    free(filter->colVec);
+    free(filter->rowVec);
+    free(filter->weights);
+    free(filter->taps);
+    free(filter);
+}
+
+/**
+ * Returns a printable name of an engine.
+ * @param ConvEngine engine The engine.
+ * @return const char* The name.
+ */
+const char* conv_getEngineName(ConvEngine engine)
+{
+    switch (engine) {
+        case CONV_ENGINE_DIRECT:
+            return "direct";
+        case CONV_ENGINE_FFT:
+            return "FFT";
+        case CONV_ENGINE_BOX:
+            return "box";
+        case CONV_ENGINE_WINOGRAD:
+            return "Winograd";
+        case CONV_ENGINE_SPARSE:
+            return "sparse";
+        default:
+            return "auto";
+    }
+}
+
+/**
+ * Picks the engine for a strip: the requested one, or the cheapest one
+ *  according to the measured costs (see CONV_COST_DIRECT_TAP) when it is
+ *  CONV_ENGINE_AUTO. Fixed-point filters always use the direct engine, and
+ *  box filters the box engine unless another one is requested. 3x3 filters
+ *  use the Winograd engine when there are no vector kernels: the nine taps
+ *  of the vector kernels are faster than its transforms otherwise. Filters
+ *  with many zero weights use the sparse engine when their non-zero taps are
+ *  cheaper than the dense ones (see CONV_COST_SPARSE_TAP). Images of 16-bit
+ *  or float samples always use the sparse engine, whatever is picked.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param int width The image width.
+ * @param int rows The amount of rows of the strip.
+ * @param int pixelSize The pixel size in bytes.
+ * @return ConvEngine The engine to use (never CONV_ENGINE_AUTO).
+ */
+ConvEngine conv_chooseEngine(struct conv_filter_t *filter, int width,
+    int rows, int pixelSize)
+{
+    int k;
+    double fftCost, directCost, sparseCost;
+    ConvEngine tapEngine;
+
+    // Engines without choice (running sums beat any other engine)
+    k = 2 * filter->radius + 1;
+    if (filter->fixedBits == 0 && filter->boxPasses > 0
+        && (filter->engine == CONV_ENGINE_AUTO
+            || filter->engine == CONV_ENGINE_BOX))
+        return CONV_ENGINE_BOX;
+    if (filter->fixedBits == 0 && k == 3
+        && (filter->engine == CONV_ENGINE_WINOGRAD
+            || (filter->engine == CONV_ENGINE_AUTO
+                && simd_getLevel() == SIMD_NONE)))
+        return CONV_ENGINE_WINOGRAD;
+    if (filter->fixedBits == 0 && filter->engine == CONV_ENGINE_SPARSE)
+        return CONV_ENGINE_SPARSE;
+    if (filter->fixedBits > 0 || filter->engine == CONV_ENGINE_DIRECT
+        || rows <= 0)
+        return CONV_ENGINE_DIRECT;
+
+    // Cheapest tap engine: all the taps, or the non-zero ones
+    if (filter->jit != NULL)
+        directCost = CONV_COST_JIT_BYTE + filter->jit->taps * CONV_COST_JIT_TAP
+            + filter->jit->groups * CONV_COST_JIT_GROUP;
+    else if (filter->separable)
+        directCost = CONV_COST_SEPARABLE_BYTE + 2 * k * CONV_COST_SEPARABLE_TAP;
+    else
+        directCost = CONV_COST_DIRECT_BYTE + k * k * CONV_COST_DIRECT_TAP;
+    sparseCost = CONV_COST_SPARSE_BYTE + filter->nTaps * CONV_COST_SPARSE_TAP;
+    tapEngine = CONV_ENGINE_DIRECT;
+    if (filter->engine == CONV_ENGINE_AUTO && sparseCost < directCost) {
+        directCost = sparseCost;
+        tapEngine = CONV_ENGINE_SPARSE;
+    }
+    if (chooseFftSize(k, width, rows, pixelSize, &fftCost) == 0)
+        return tapEngine;
+    if (filter->engine == CONV_ENGINE_FFT)
+        return CONV_ENGINE_FFT;
+
+    // Compare the estimated costs
+    directCost *= (double) width * rows * pixelSize;
+
+    return (fftCost < directCost) ? CONV_ENGINE_FFT : tapEngine;
+}
+
+/**
+ * Picks the width of the column blocks of the tap engines: the requested
+ *  one, or the widest one whose rolling window fits half of the cache when
+ *  it is 0. The window of the separable method (k rows of doubles) is sized
+ *  to the L2 cache, the one of the other methods (k input rows) to the L1
+ *  cache.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param int width The image width.
+ * @param int pixelSize The pixel size in bytes.
+ * @return int The block width in pixels.
+ */
+int conv_getTileWidth(struct conv_filter_t *filter, int width, int pixelSize)
+{
+    int k;
+    long retVal, cacheSize, columnSize;
+
+    // Requested width
+    if (filter->tileWidth > 0)
+        return (filter->tileWidth < width) ? filter->tileWidth : width;
+
+    // Bytes of every pixel column of the window
+    k = 2 * filter->radius + 1;
+    if (filter->separable && filter->fixedBits == 0 && filter->jit == NULL) {
+        cacheSize = getCacheSize(2);
+        columnSize = (long) (k + 1) * pixelSize * sizeof(double);
+    } else {
+        cacheSize = getCacheSize(1);
+        columnSize = (long) (k + 1) * pixelSize;
+    }
+    retVal = cacheSize / 2 / columnSize;
+    retVal -= retVal % CONV_MIN_TILE_WIDTH;
+    if (retVal < CONV_MIN_TILE_WIDTH)
+        retVal = CONV_MIN_TILE_WIDTH;
+
+    return (retVal < width) ? retVal : width;
+}
+
 /******************************************************************************
  * Functionality
  *****************************************************************************/
 
 /**
- * Partial running convolution. No filter normalization and other logic used.
+ * Partial running convolution using the direct (k x k taps per pixel) method.
+ *  This is the reference implementation: bounds are checked on every tap and
+ *  the border is always zero.
  * @param struct image_t *inImg The input image.
  * @param int offsetRowIdx The offset (as row index).
  * @param int limit The limit (amount of rows).
@@ -59,19 +1067,19 @@ struct matrix_t* conv_normalizeFilter(struct matrix_t *mat)
  * @param struct matrix_t *normFilter The filter to apply. It is already
  *  normalized.
  */
-void conv_runPartially(struct image_t *inImg, int offsetRowIdx, int limit,
-    struct image_t *outImg, struct matrix_t *normFilter)
+void conv_runDirectPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct matrix_t *normFilter)
 {
     int rowIdx;
     int pixelIdx, byteIdx;
     int inRowIdx, inPixelIdx;
     int s;
     int p, q;
-    int *accs;
+    double *accs;
 
     // Prepare
     s = (normFilter->width - 1) / 2;
-    accs = malloc(sizeof(int) * inImg->pixelSize);
+    accs = malloc(sizeof(double) * inImg->pixelSize);
 
     // Go through each row
     for (rowIdx = offsetRowIdx; rowIdx < inImg->height
@@ -102,14 +1110,10 @@ void conv_runPartially(struct image_t *inImg, int offsetRowIdx, int limit,
             }
 
             // Set pixel bytes
-            for (byteIdx = 0; byteIdx < inImg->pixelSize; byteIdx++) {
-                accs[byteIdx] = (accs[byteIdx] > 255) ? 255
-                    : (accs[byteIdx] < 0) ? 0
-                        : accs[byteIdx];
+            for (byteIdx = 0; byteIdx < inImg->pixelSize; byteIdx++)
                 IMG_SET_PIXEL_BYTE(
-                    outImg, rowIdx, pixelIdx, byteIdx, accs[byteIdx]
+                    outImg, rowIdx, pixelIdx, byteIdx, clampByte(accs[byteIdx])
                 );
-            }
         }
 
     // Clean up
@@ -117,21 +1121,1085 @@ void conv_runPartially(struct image_t *inImg, int offsetRowIdx, int limit,
 }
 
 /**
- * Runs image convolution.
- * @param struct image_t *imp The image.
- * @param struct matrix_t *filter The filter to apply.
- * @return struct image_t* The resulting image or NULL in case of failure.
+ * Runs the generated kernel of a filter on a row of a column block, and the
+ *  static one on the bytes left over (see JIT_STEP_BYTES).
+ * @param struct jit_kernel_t *jit The generated kernel.
+ * @param SimdRowKernel kernel The static kernel.
+ * @param unsigned char *out The output bytes.
+ * @param int n The amount of output bytes.
+ * @param const unsigned char **rows The input rows (restored on return).
+ * @param const float **weights The weights of each input row.
+ * @param int k The filter size.
+ * @param int pixelSize The pixel size in bytes.
  */
-struct image_t *conv_run(struct image_t *img, struct matrix_t *filter)
+static void runJitRow(struct jit_kernel_t *jit, SimdRowKernel kernel,
+    unsigned char *out, int n, const unsigned char **rows,
+    const float **weights, int k, int pixelSize)
 {
-    struct image_t *retVal;
-    struct matrix_t *normFilter;
+    int a, done;
 
-    // Normalize the filter
-    normFilter = conv_normalizeFilter(filter);
+    jit->run(out, n, rows);
+    done = n - n % JIT_STEP_BYTES;
+    if (done == n)
+        return;
+    for (a = 0; a < k; a++)
+        rows[a] += done;
+    kernel(&(out[done]), n - done, rows, weights, k, pixelSize);
+    for (a = 0; a < k; a++)
+        rows[a] -= done;
+}
+
+/**
+ * Partial running convolution using the vectorised row kernels (see simd.h).
+ *  The strip is padded once, so that the kernels run without bound checks,
+ *  and processed in column blocks (see conv_getTileWidth).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_runVectorPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter)
+{
+    int rowIdx, a, s, k, x, n, tileWidth;
+    struct image_t *padded;
+    const unsigned char **rows;
+    const float **weights;
+    SimdRowKernel kernel;
+    struct jit_kernel_t *jit;
+
+    // Planar images: plane by plane
+    if (inImg->layout == IMG_LAYOUT_PLANAR) {
+        runPlanes(conv_runVectorPartially, inImg, offsetRowIdx, limit, outImg,
+            filter);
+        return;
+    }
+
+    // Pad the strip
+    s = filter->radius;
+    k = 2 * s + 1;
+    padded = img_makePadded(inImg, offsetRowIdx, limit, s, filter->border);
+    if (padded == NULL)
+        return;
+
+    // Prepare (the generated kernel only fits its own pixel size)
+    kernel = simd_getRowKernel(s, inImg->pixelSize);
+    jit = filter->jit;
+    if (jit != NULL && jit->pixelSize != inImg->pixelSize)
+        jit = NULL;
+    rows = malloc(sizeof(unsigned char*) * k);
+    weights = malloc(sizeof(float*) * k);
+    for (a = 0; a < k; a++)
+        weights[a] = &(filter->weights[a * k]);
+
+    // Go through each column block and each row of it, so that the k input
+    //  rows of the block stay in the cache from one output row to the next
+    tileWidth = conv_getTileWidth(filter, inImg->width, inImg->pixelSize);
+    for (x = 0; x < inImg->width; x += tileWidth) {
+        n = (inImg->width - x < tileWidth) ? inImg->width - x : tileWidth;
+        for (rowIdx = 0; rowIdx < padded->height - 2 * s; rowIdx++) {
+            for (a = 0; a < k; a++)
+                rows[a] = &(padded->rows[rowIdx + a][x * inImg->pixelSize]);
+            if (jit != NULL)
+                runJitRow(jit, kernel,
+                    &(outImg->rows[offsetRowIdx + rowIdx][
+                        x * inImg->pixelSize]),
+                    n * inImg->pixelSize,
+                    rows, weights, k, inImg->pixelSize
+                );
+            else
+                kernel(
+                    &(outImg->rows[offsetRowIdx + rowIdx][
+                        x * inImg->pixelSize]),
+                    n * inImg->pixelSize,
+                    rows, weights, k, inImg->pixelSize
+                );
+            addDelta(filter->delta,
+                &(padded->rows[rowIdx + s][(x + s) * inImg->pixelSize]),
+                &(outImg->rows[offsetRowIdx + rowIdx][x * inImg->pixelSize]),
+                x * inImg->pixelSize, n * inImg->pixelSize);
+        }
+    }
+
+    // Clean up
+    free(rows);
+    free(weights);
+    img_destroy(padded);
+}
+
+/**
+ * Partial running convolution with the fixed-point weights (see
+ *  conv_quantizeFilter).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter. Must be quantised.
+ */
+void conv_runFixedPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter)
+{
+    int rowIdx, a, s, k, x, n, tileWidth;
+    unsigned char *out;
+    struct image_t *padded;
+    const unsigned char **rows;
+    const short **weights;
+    SimdFixedRowKernel kernel;
+
+    // Planar images: plane by plane
+    if (inImg->layout == IMG_LAYOUT_PLANAR) {
+        runPlanes(conv_runFixedPartially, inImg, offsetRowIdx, limit, outImg,
+            filter);
+        return;
+    }
+
+    // Pad the strip
+    s = filter->radius;
+    k = 2 * s + 1;
+    padded = img_makePadded(inImg, offsetRowIdx, limit, s, filter->border);
+    if (padded == NULL)
+        return;
+
+    // Prepare
+    kernel = simd_getFixedRowKernel(s, inImg->pixelSize);
+    rows = malloc(sizeof(unsigned char*) * k);
+    weights = malloc(sizeof(short*) * k);
+    for (a = 0; a < k && filter->fixedWeights16 != NULL; a++)
+        weights[a] = &(filter->fixedWeights16[a * k]);
+
+    // Go through each column block and each row of it
+    tileWidth = conv_getTileWidth(filter, inImg->width, inImg->pixelSize);
+    for (x = 0; x < inImg->width; x += tileWidth) {
+        n = (inImg->width - x < tileWidth) ? inImg->width - x : tileWidth;
+        for (rowIdx = 0; rowIdx < padded->height - 2 * s; rowIdx++) {
+            for (a = 0; a < k; a++)
+                rows[a] = &(padded->rows[rowIdx + a][x * inImg->pixelSize]);
+            out = &(outImg->rows[offsetRowIdx + rowIdx][x * inImg->pixelSize]);
+
+            // Weights too large for the 16-bit kernels: scalar code
+            if (filter->fixedWeights16 == NULL)
+                convolveRowFixedWide(
+                    out, n * inImg->pixelSize,
+                    rows, filter->fixedWeights, k,
+                    inImg->pixelSize, filter->fixedBits
+                );
+            else
+                kernel(
+                    out, n * inImg->pixelSize,
+                    rows, weights, k, inImg->pixelSize, filter->fixedBits
+                );
+            addDelta(filter->delta,
+                &(padded->rows[rowIdx + s][(x + s) * inImg->pixelSize]),
+                out, x * inImg->pixelSize, n * inImg->pixelSize);
+        }
+    }
+
+    // Clean up
+    free(rows);
+    free(weights);
+    img_destroy(padded);
+}
+
+/**
+ * Horizontal pass of the separable convolution for a single padded row.
+ * @param unsigned char *in The padded input row.
+ * @param int n The amount of output values (row size in bytes).
+ * @param double *taps The row taps (flipped row vector).
+ * @param int k The filter width.
+ * @param int pixelSize The pixel size in bytes.
+ * @param double *out The output.
+ */
+static void runHorizontalPass(unsigned char *in, int n, double *taps, int k,
+    int pixelSize, double *out)
+{
+    int i, b;
+
+    for (i = 0; i < n; i++)
+        out[i] = 0;
+    for (b = 0; b < k; b++)
+        for (i = 0; i < n; i++)
+            out[i] += in[i + b * pixelSize] * taps[b];
+}
+
+/**
+ * Partial running convolution of a separable filter, as a horizontal pass
+ *  followed by a vertical pass (2k taps per pixel). Matches the direct method
+ *  within one intensity level.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter. Must be separable.
+ */
+void conv_runSeparablePartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter)
+{
+    int rowIdx, nextRowIdx;
+    int i, a, s, k, x, n, tileWidth, tileSize;
+    unsigned char *out;
+    struct image_t *padded;
+    double *rowTaps, *colTaps, *window, *acc, *in;
+
+    // Planar images: plane by plane
+    if (inImg->layout == IMG_LAYOUT_PLANAR) {
+        runPlanes(conv_runSeparablePartially, inImg, offsetRowIdx, limit,
+            outImg, filter);
+        return;
+    }
+
+    // Pad the strip
+    s = filter->radius;
+    k = 2 * s + 1;
+    padded = img_makePadded(inImg, offsetRowIdx, limit, s, filter->border);
+    if (padded == NULL)
+        return;
+
+    // Prepare (taps are flipped, as in the direct method)
+    tileWidth = conv_getTileWidth(filter, inImg->width, inImg->pixelSize);
+    tileSize = tileWidth * inImg->pixelSize;
+    rowTaps = malloc(sizeof(double) * k);
+    colTaps = malloc(sizeof(double) * k);
+    for (a = 0; a < k; a++) {
+        rowTaps[a] = filter->rowVec[k - 1 - a];
+        colTaps[a] = filter->colVec[k - 1 - a];
+    }
+
+    // Rolling window of the k horizontally filtered rows of a column block
+    //  around the current row (padded row r is kept at slot r % k) and the
+    //  vertical accumulator
+    window = malloc(sizeof(double) * k * tileSize);
+    acc = malloc(sizeof(double) * tileSize);
+
+    // Go through each column block
+    for (x = 0; x < inImg->width; x += tileWidth) {
+        n = ((inImg->width - x < tileWidth) ? inImg->width - x : tileWidth)
+            * inImg->pixelSize;
+
+        // Fill the window with the rows above the first output row
+        for (nextRowIdx = 0; nextRowIdx < k - 1; nextRowIdx++)
+            runHorizontalPass(
+                &(padded->rows[nextRowIdx][x * inImg->pixelSize]), n,
+                rowTaps, k, inImg->pixelSize,
+                &(window[(nextRowIdx % k) * tileSize])
+            );
+
+        // Go through each row
+        for (rowIdx = 0; rowIdx < padded->height - 2 * s; rowIdx++) {
+            // Slide the window down by one row
+            runHorizontalPass(
+                &(padded->rows[nextRowIdx][x * inImg->pixelSize]), n,
+                rowTaps, k, inImg->pixelSize,
+                &(window[(nextRowIdx % k) * tileSize])
+            );
+            nextRowIdx++;
+
+            // Vertical pass
+            for (i = 0; i < n; i++)
+                acc[i] = 0;
+            for (a = 0; a < k; a++) {
+                in = &(window[((rowIdx + a) % k) * tileSize]);
+                for (i = 0; i < n; i++)
+                    acc[i] += in[i] * colTaps[a];
+            }
+
+            // Set row bytes
+            out = &(outImg->rows[offsetRowIdx + rowIdx][x * inImg->pixelSize]);
+            for (i = 0; i < n; i++)
+                out[i] = clampByte(acc[i]);
+            addDelta(filter->delta,
+                &(padded->rows[rowIdx + s][(x + s) * inImg->pixelSize]),
+                out, x * inImg->pixelSize, n);
+        }
+    }
+
+    // Clean up
+    free(rowTaps);
+    free(colTaps);
+    free(window);
+    free(acc);
+    img_destroy(padded);
+}
+
+/**
+ * Partial running convolution in the frequency domain (overlap-save). The
+ *  padded strip is cut into overlapping square tiles, whose transforms are
+ *  multiplied with the one of the filter. Two tiles share each complex
+ *  transform (as real and imaginary parts). Matches the direct method within
+ *  one intensity level.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_runFftPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter)
+{
+    int i, j, s, k, rows, size, valid;
+    int nTilesX, nTiles, tile, tileIdx, byteIdx, rowIdx, pixelIdx;
+    double scale, xr, xi;
+    double *filterRe, *filterIm, *re, *im, *tiles[2];
+    struct image_t *padded;
+    struct fft_plan_t *plan;
+
+    // Planar images: plane by plane
+    if (inImg->layout == IMG_LAYOUT_PLANAR) {
+        runPlanes(conv_runFftPartially, inImg, offsetRowIdx, limit, outImg,
+            filter);
+        return;
+    }
+
+    // Pad the strip
+    s = filter->radius;
+    k = 2 * s + 1;
+    padded = img_makePadded(inImg, offsetRowIdx, limit, s, filter->border);
+    if (padded == NULL)
+        return;
+    rows = padded->height - 2 * s;
+
+    // Prepare
+    size = chooseFftSize(k, inImg->width, rows, inImg->pixelSize, NULL);
+    plan = fft_makePlan(size);
+    filterRe = calloc(size * size, sizeof(double));
+    filterIm = calloc(size * size, sizeof(double));
+    re = malloc(sizeof(double) * size * size);
+    im = malloc(sizeof(double) * size * size);
+    if (plan == NULL || filterRe == NULL || filterIm == NULL || re == NULL
+        || im == NULL) {
+        if (plan != NULL)
+            fft_destroyPlan(plan);
+        free(filterRe);
+        free(filterIm);
+        free(re);
+        free(im);
+        img_destroy(padded);
+        conv_runVectorPartially(inImg, offsetRowIdx, limit, outImg, filter);
+        return;
+    }
+    tiles[0] = re;
+    tiles[1] = im;
+
+    // Filter transform. The filter is not flipped (the tiles are convolved,
+    //  not correlated) and carries the scale of the inverse transform.
+    scale = 1.0 / ((double) size * size);
+    for (i = 0; i < k; i++)
+        for (j = 0; j < k; j++)
+            filterRe[i * size + j] = filter->mat->values[i][j] * scale;
+    fft_run2D(plan, filterRe, filterIm, 0);
+
+    // Go through each pair of tiles (one byte of every pixel each). Tiles
+    //  overlap by k - 1 rows and columns, which are wrapped around by the
+    //  circular convolution and thrown away.
+    valid = size - k + 1;
+    nTilesX = (inImg->width + valid - 1) / valid;
+    nTiles = nTilesX * ((rows + valid - 1) / valid) * inImg->pixelSize;
+    for (tile = 0; tile < nTiles; tile += 2) {
+        // Load
+        for (i = 0; i < 2; i++) {
+            tileIdx = (tile + i) / inImg->pixelSize;
+            byteIdx = (tile + i) % inImg->pixelSize;
+            if (tile + i < nTiles)
+                loadTile(padded, (tileIdx / nTilesX) * valid,
+                    (tileIdx % nTilesX) * valid, byteIdx, size, tiles[i]);
+            else
+                for (j = 0; j < size * size; j++)
+                    tiles[i][j] = 0;
+        }
+
+        // Convolve
+        fft_run2D(plan, re, im, 0);
+        for (j = 0; j < size * size; j++) {
+            xr = re[j] * filterRe[j] - im[j] * filterIm[j];
+            xi = re[j] * filterIm[j] + im[j] * filterRe[j];
+            re[j] = xr;
+            im[j] = xi;
+        }
+        fft_run2D(plan, re, im, 1);
+
+        // Store
+        for (i = 0; i < 2 && tile + i < nTiles; i++) {
+            tileIdx = (tile + i) / inImg->pixelSize;
+            byteIdx = (tile + i) % inImg->pixelSize;
+            rowIdx = offsetRowIdx + (tileIdx / nTilesX) * valid;
+            pixelIdx = (tileIdx % nTilesX) * valid;
+            storeTile(tiles[i], size, k, inImg, outImg, rowIdx,
+                offsetRowIdx + rows, pixelIdx, byteIdx, filter->delta);
+        }
+    }
+
+    // Clean up
+    fft_destroyPlan(plan);
+    free(filterRe);
+    free(filterIm);
+    free(re);
+    free(im);
+    img_destroy(padded);
+}
+
+/**
+ * Partial running convolution of box passes (see conv_filter_t), with
+ *  running sums along the rows and then along the columns: the cost does not
+ *  depend on the radius. The sums are exact, the scale being applied once
+ *  per output byte. Matches the direct method within one intensity level.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter. Must be made of
+ *  boxes.
+ */
+void conv_runBoxPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter)
+{
+    int i, j, p, n, len, outRowIdx, pixelSize, failed;
+    unsigned char *in, *out;
+    double *rows[2], *cur, *slot;
+    struct image_t *padded;
+    BoxPass passes[CONV_MAX_BOX_PASSES];
+
+    // Planar images: plane by plane
+    if (inImg->layout == IMG_LAYOUT_PLANAR) {
+        runPlanes(conv_runBoxPartially, inImg, offsetRowIdx, limit, outImg,
+            filter);
+        return;
+    }
+
+    // Pad the strip
+    padded = img_makePadded(inImg, offsetRowIdx, limit, filter->radius,
+        filter->border);
+    if (padded == NULL)
+        return;
+
+    // Prepare: two padded rows for the passes along the rows, and the
+    //  window and sums of every pass along the columns
+    pixelSize = inImg->pixelSize;
+    n = inImg->width * pixelSize;
+    rows[0] = malloc(sizeof(double) * padded->width * pixelSize);
+    rows[1] = malloc(sizeof(double) * padded->width * pixelSize);
+    failed = rows[0] == NULL || rows[1] == NULL;
+    for (j = 0; j < filter->boxPasses; j++) {
+        passes[j].k = 2 * filter->boxRadii[j] + 1;
+        passes[j].count = 0;
+        passes[j].window = calloc((size_t) passes[j].k * n, sizeof(double));
+        passes[j].sums = calloc(n, sizeof(double));
+        failed |= passes[j].window == NULL || passes[j].sums == NULL;
+    }
+
+    // Go through each padded row
+    outRowIdx = offsetRowIdx;
+    for (p = 0; p < padded->height && !failed; p++) {
+        // Passes along the row
+        in = padded->rows[p];
+        len = padded->width * pixelSize;
+        for (i = 0; i < len; i++)
+            rows[0][i] = in[i];
+        cur = rows[0];
+        for (j = 0; j < filter->boxPasses; j++) {
+            len -= (passes[j].k - 1) * pixelSize;
+            runBoxRow(cur, len, passes[j].k, pixelSize,
+                (cur == rows[0]) ? rows[1] : rows[0]);
+            cur = (cur == rows[0]) ? rows[1] : rows[0];
+        }
+
+        // Passes along the columns: each one replaces the oldest row of its
+        //  window, and feeds the next one once the window is full
+        for (j = 0; j < filter->boxPasses && cur != NULL; j++) {
+            slot = &(passes[j].window[(passes[j].count % passes[j].k) * n]);
+            for (i = 0; i < n; i++) {
+                passes[j].sums[i] += cur[i] - slot[i];
+                slot[i] = cur[i];
+            }
+            passes[j].count++;
+            cur = (passes[j].count >= passes[j].k) ? passes[j].sums : NULL;
+        }
+        if (cur == NULL)
+            continue;
+
+        // Set row bytes
+        out = outImg->rows[outRowIdx++];
+        for (i = 0; i < n; i++)
+            out[i] = clampByte(cur[i] * filter->boxScale);
+        addDelta(filter->delta, inImg->rows[outRowIdx - 1], out, 0, n);
+    }
+
+    // Clean up
+    free(rows[0]);
+    free(rows[1]);
+    for (j = 0; j < filter->boxPasses; j++) {
+        free(passes[j].window);
+        free(passes[j].sums);
+    }
+    img_destroy(padded);
+}
+
+/**
+ * Partial running convolution of a 3x3 filter with Winograd's minimal
+ *  filtering F(2x2, 3x3) (see winograd.h): 4 multiplications per output byte
+ *  instead of 9. The strip is processed two rows at a time, every input row
+ *  being transformed once. Matches the direct method within one intensity
+ *  level.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter. Must be 3x3.
+ */
+void conv_runWinogradPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter)
+{
+    int a, n, nTiles, rowIdx, rows, nextRowIdx;
+    float *window, *y;
+    struct image_t *padded;
+
+    // Planar images: plane by plane
+    if (inImg->layout == IMG_LAYOUT_PLANAR) {
+        runPlanes(conv_runWinogradPartially, inImg, offsetRowIdx, limit,
+            outImg, filter);
+        return;
+    }
+
+    // Pad the strip, with an extra ghost pixel on each side for the last
+    //  tile of an odd width or height (padded row 1 is strip row -1)
+    padded = img_makePadded(inImg, offsetRowIdx, limit, 2, filter->border);
+    if (padded == NULL)
+        return;
+    rows = padded->height - 4;
+
+    // Prepare: rolling window of the 4 transformed input rows of a row of
+    //  tiles (padded row r is kept at slot r % 4), and the outputs
+    nTiles = (inImg->width + 1) / WINOGRAD_TILE;
+    n = nTiles * inImg->pixelSize;
+    window = malloc(sizeof(float) * 4 * WINOGRAD_INPUT_TILE * n);
+    y = malloc(sizeof(float) * 4 * n);
+    if (window == NULL || y == NULL) {
+        free(window);
+        free(y);
+        img_destroy(padded);
+        conv_runVectorPartially(inImg, offsetRowIdx, limit, outImg, filter);
+        return;
+    }
+
+    // Go through each row of tiles (two output rows)
+    for (nextRowIdx = 1; nextRowIdx < 3; nextRowIdx++)
+        winograd_transformRow(&(padded->rows[nextRowIdx][inImg->pixelSize]),
+            nTiles, inImg->pixelSize, &(window[(nextRowIdx % 4) * 4 * n]));
+    for (rowIdx = 0; rowIdx < rows; rowIdx += WINOGRAD_TILE) {
+        // Slide the window down by two rows
+        for (a = 0; a < WINOGRAD_TILE; a++, nextRowIdx++)
+            winograd_transformRow(
+                &(padded->rows[nextRowIdx][inImg->pixelSize]), nTiles,
+                inImg->pixelSize, &(window[(nextRowIdx % 4) * 4 * n]));
+
+        // Tiles
+        winograd_runTiles(
+            &(window[((rowIdx + 1) % 4) * 4 * n]),
+            &(window[((rowIdx + 2) % 4) * 4 * n]),
+            &(window[((rowIdx + 3) % 4) * 4 * n]),
+            &(window[(rowIdx % 4) * 4 * n]),
+            filter->winogradWeights, n, y);
+
+        // Set rows bytes
+        for (a = 0; a < WINOGRAD_TILE && rowIdx + a < rows; a++) {
+            winograd_storeRow(&(y[2 * a * n]), &(y[(2 * a + 1) * n]),
+                inImg->width, inImg->pixelSize,
+                outImg->rows[offsetRowIdx + rowIdx + a]);
+            addDelta(filter->delta, inImg->rows[offsetRowIdx + rowIdx + a],
+                outImg->rows[offsetRowIdx + rowIdx + a], 0,
+                inImg->width * inImg->pixelSize);
+        }
+    }
+
+    // Clean up
+    free(window);
+    free(y);
+    img_destroy(padded);
+}
+
+/**
+ * Partial running convolution with the non-zero taps of the filter only: the
+ *  taps are accumulated one by one over the row of a column block, i.e.
+ *  every output byte costs as many multiplications as there are non-zero
+ *  weights. Matches the direct method within one intensity level. It is
+ *  also the engine of the 16-bit and float images (float outputs are not
+ *  clamped).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_runSparsePartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter)
+{
+    int rowIdx, i, j, t, s, x, n, tileWidth, ps, size;
+    unsigned char *out;
+    float *acc, weights[4];
+    const unsigned char *in[4], *centre;
+    struct image_t *padded;
+    struct conv_tap_t *tap;
+
+    // Planar images: plane by plane
+    if (inImg->layout == IMG_LAYOUT_PLANAR) {
+        runPlanes(conv_runSparsePartially, inImg, offsetRowIdx, limit, outImg,
+            filter);
+        return;
+    }
+
+    // Pad the strip
+    s = filter->radius;
+    ps = inImg->pixelSize;
+    size = img_getSampleSize(inImg->sampleType);
+    padded = img_makePadded(inImg, offsetRowIdx, limit, s, filter->border);
+    if (padded == NULL)
+        return;
+
+    // Prepare: accumulators of a row of a column block
+    tileWidth = conv_getTileWidth(filter, inImg->width, ps * size);
+    acc = malloc(sizeof(float) * tileWidth * ps);
+    if (acc == NULL) {
+        img_destroy(padded);
+        return;
+    }
+
+    // Go through each column block and each row of it, so that the input
+    //  rows of the taps stay in the cache from one output row to the next
+    for (x = 0; x < inImg->width; x += tileWidth) {
+        n = ((inImg->width - x < tileWidth) ? inImg->width - x : tileWidth)
+            * ps;
+        for (rowIdx = 0; rowIdx < padded->height - 2 * s; rowIdx++) {
+            for (i = 0; i < n; i++)
+                acc[i] = 0;
+            for (t = 0; t < filter->nTaps; t += j) {
+                for (j = 0; j < 4 && t + j < filter->nTaps; j++) {
+                    tap = &(filter->taps[t + j]);
+                    in[j] = &(padded->rows[rowIdx + tap->dy][
+                        (x + tap->dx) * ps * size]);
+                    weights[j] = tap->weight;
+                }
+                if (inImg->sampleType == IMG_SAMPLE_U16)
+                    addSparseTaps16(acc, in, weights, j, n);
+                else if (inImg->sampleType == IMG_SAMPLE_F32)
+                    addSparseTapsF32(acc, in, weights, j, n);
+                else
+                    addSparseTaps(acc, in, weights, j, n);
+            }
+
+            // Set row samples
+            out = &(outImg->rows[offsetRowIdx + rowIdx][x * ps * size]);
+            centre = &(padded->rows[rowIdx + s][(x + s) * ps * size]);
+            if (inImg->sampleType != IMG_SAMPLE_U8) {
+                storeSamples(out, acc, centre, x * ps * size, n,
+                    inImg->sampleType, filter->delta);
+                continue;
+            }
+            for (i = 0; i < n; i++)
+                out[i] = clampByte(acc[i]);
+            addDelta(filter->delta, centre, out, x * ps * size, n);
+        }
+    }
+
+    // Clean up
+    free(acc);
+    img_destroy(padded);
+}
+
+/**
+ * Runs an engine on some rows, in the calling thread. Images of 16-bit or
+ *  float samples always run the sparse engine.
+ * @param ConvEngine engine The engine (see conv_chooseEngine).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+static void runEngine(ConvEngine engine, struct image_t *inImg,
+    int offsetRowIdx, int limit, struct image_t *outImg,
+    struct conv_filter_t *filter)
+{
+    if (inImg->sampleType != IMG_SAMPLE_U8)
+        conv_runSparsePartially(inImg, offsetRowIdx, limit, outImg, filter);
+    else if (filter->fixedBits > 0)
+        conv_runFixedPartially(inImg, offsetRowIdx, limit, outImg, filter);
+    else if (engine == CONV_ENGINE_FFT)
+        conv_runFftPartially(inImg, offsetRowIdx, limit, outImg, filter);
+    else if (engine == CONV_ENGINE_BOX)
+        conv_runBoxPartially(inImg, offsetRowIdx, limit, outImg, filter);
+    else if (engine == CONV_ENGINE_WINOGRAD)
+        conv_runWinogradPartially(inImg, offsetRowIdx, limit, outImg, filter);
+    else if (engine == CONV_ENGINE_SPARSE)
+        conv_runSparsePartially(inImg, offsetRowIdx, limit, outImg, filter);
+    else if (filter->separable && filter->jit == NULL)
+        conv_runSeparablePartially(inImg, offsetRowIdx, limit, outImg, filter);
+    else
+        conv_runVectorPartially(inImg, offsetRowIdx, limit, outImg, filter);
+}
+
+/**
+ * Runs the vector method of several filters on some rows, in the calling
+ *  thread. The strip is padded once, by the largest radius, and all the
+ *  filters are applied to a row of a column block before moving on to the
+ *  next one, so that their input rows are read from the cache.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t **outImgs The output image of every filter.
+ * @param struct conv_filter_t **filters The prepared filters (same border
+ *  mode).
+ * @param int amount The amount of filters.
+ */
+static void runVectorBank(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t **outImgs, struct conv_filter_t **filters,
+    int amount)
+{
+    int rowIdx, f, a, c, s, k, x, n, maxS, maxK, widest, tileWidth, ps;
+    struct image_t *padded, inPlane;
+    struct image_t outPlanes[CONV_MAX_BANK_FILTERS];
+    struct image_t *outPlanePtrs[CONV_MAX_BANK_FILTERS];
+    const unsigned char **rows;
+    const float **weights;
+    SimdRowKernel kernels[CONV_MAX_BANK_FILTERS];
+    struct jit_kernel_t *jits[CONV_MAX_BANK_FILTERS];
+
+    // Planar images: plane by plane
+    if (inImg->layout == IMG_LAYOUT_PLANAR) {
+        for (c = 0; c < inImg->pixelSize; c++) {
+            img_getPlane(inImg, c, &inPlane);
+            for (f = 0; f < amount; f++) {
+                img_getPlane(outImgs[f], c, &(outPlanes[f]));
+                outPlanePtrs[f] = &(outPlanes[f]);
+            }
+            runVectorBank(&inPlane, offsetRowIdx, limit, outPlanePtrs,
+                filters, amount);
+        }
+        return;
+    }
+
+    // Pad the strip for the widest filter
+    widest = 0;
+    for (f = 1; f < amount; f++)
+        if (filters[f]->radius > filters[widest]->radius)
+            widest = f;
+    maxS = filters[widest]->radius;
+    maxK = 2 * maxS + 1;
+    ps = inImg->pixelSize;
+    padded = img_makePadded(inImg, offsetRowIdx, limit, maxS,
+        filters[0]->border);
+    if (padded == NULL)
+        return;
+
+    // Prepare
+    rows = malloc(sizeof(unsigned char*) * maxK);
+    weights = malloc(sizeof(float*) * maxK * amount);
+    if (rows == NULL || weights == NULL) {
+        free(rows);
+        free(weights);
+        img_destroy(padded);
+        return;
+    }
+    for (f = 0; f < amount; f++) {
+        k = 2 * filters[f]->radius + 1;
+        kernels[f] = simd_getRowKernel(filters[f]->radius, ps);
+        jits[f] = filters[f]->jit;
+        if (jits[f] != NULL && jits[f]->pixelSize != ps)
+            jits[f] = NULL;
+        for (a = 0; a < k; a++)
+            weights[f * maxK + a] = &(filters[f]->weights[a * k]);
+    }
+
+    // Go through each column block and each row of it. The rows of a
+    //  narrower filter start maxS - s rows and pixels into the padding.
+    tileWidth = conv_getTileWidth(filters[widest], inImg->width, ps);
+    for (x = 0; x < inImg->width; x += tileWidth) {
+        n = (inImg->width - x < tileWidth) ? inImg->width - x : tileWidth;
+        for (rowIdx = 0; rowIdx < padded->height - 2 * maxS; rowIdx++)
+            for (f = 0; f < amount; f++) {
+                s = filters[f]->radius;
+                k = 2 * s + 1;
+                for (a = 0; a < k; a++)
+                    rows[a] = &(padded->rows[rowIdx + maxS - s + a][
+                        (x + maxS - s) * ps]);
+                if (jits[f] != NULL)
+                    runJitRow(jits[f], kernels[f],
+                        &(outImgs[f]->rows[offsetRowIdx + rowIdx][x * ps]),
+                        n * ps, rows, &(weights[f * maxK]), k, ps
+                    );
+                else
+                    kernels[f](
+                        &(outImgs[f]->rows[offsetRowIdx + rowIdx][x * ps]),
+                        n * ps, rows, &(weights[f * maxK]), k, ps
+                    );
+            }
+    }
+
+    // Clean up
+    free(rows);
+    free(weights);
+    img_destroy(padded);
+}
+
+/**
+ * Splits the rows of a strip between the threads: one block per thread, or
+ *  chunks large enough for the padding of every chunk (2 * radius rows) not
+ *  to matter. The chunks of the FFT engine are the same for any amount of
+ *  threads (see CONV_FFT_CHUNK_ROWS).
+ * @param struct conv_filter_t *filter The prepared filter (threads and
+ *  scheduling).
+ * @param ConvEngine engine The engine of the strip.
+ * @param int radius The radius of the padding.
+ * @param int rows The amount of rows of the strip.
+ * @param int *threads Filled with the amount of threads.
+ * @return int The amount of rows of the chunks.
+ */
+static int getChunkRows(struct conv_filter_t *filter, ConvEngine engine,
+    int radius, int rows, int *threads)
+{
+    int retVal;
+
+    *threads = (filter->threads > 1) ? filter->threads : 1;
+    if (engine == CONV_ENGINE_FFT) {
+        retVal = 4 * (2 * radius + 1);
+        if (retVal < CONV_FFT_CHUNK_ROWS)
+            retVal = CONV_FFT_CHUNK_ROWS;
+    } else if (filter->schedule == CONV_SCHEDULE_DYNAMIC && *threads > 1) {
+        retVal = 4 * (2 * radius + 1);
+        if (retVal < CONV_DYNAMIC_CHUNK_ROWS)
+            retVal = CONV_DYNAMIC_CHUNK_ROWS;
+    } else
+        retVal = (rows + *threads - 1) / *threads;
+
+    return retVal;
+}
+
+/**
+ * Partial running convolution with a prepared filter. The engine is picked by
+ *  conv_chooseEngine() and the fastest method applicable to the filter is
+ *  used. The rows are split between filter->threads threads (OpenMP), each
+ *  one running the method on its own rows.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_runFilterPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter)
+{
+    conv_runFilterPartiallyDelta(inImg, offsetRowIdx, limit, outImg, filter,
+        NULL);
+}
+
+/**
+ * Same as conv_runFilterPartially, also accumulating the change made to the
+ *  bytes of the rows. The engines compare every output row with the input one
+ *  as they store it, i.e. without another pass over the images.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param struct conv_delta_t *delta The change, added to (NULL if not
+ *  tracked).
+ */
+void conv_runFilterPartiallyDelta(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter,
+    struct conv_delta_t *delta)
+{
+    int i, rows, threads, chunkRows, nChunks;
+    long long sumSquares;
+    double maxDiff;
+    ConvEngine engine;
+    struct conv_filter_t chunkFilter;
+    struct conv_delta_t chunkDelta;
+
+    // Pick the engine for the whole strip
+    rows = inImg->height - offsetRowIdx;
+    if (rows > limit)
+        rows = limit;
+    if (rows <= 0)
+        return;
+    engine = conv_chooseEngine(filter, inImg->width, rows, inImg->pixelSize);
+    simd_init();
+
+    // Split the rows
+    chunkRows = getChunkRows(filter, engine, filter->radius, rows,
+        &threads);
+    nChunks = (rows + chunkRows - 1) / chunkRows;
+
+    // Run every chunk, each one with its own change (exact integer sums, so
+    //  the order in which they are added up does not matter)
+    sumSquares = 0;
+    maxDiff = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(threads) schedule(dynamic, 1) \
+        if (nChunks > 1) private(chunkFilter, chunkDelta) \
+        reduction(+:sumSquares) reduction(max:maxDiff)
+#endif
+    for (i = 0; i < nChunks; i++) {
+        chunkFilter = *filter;
+        chunkFilter.delta = (delta != NULL) ? &chunkDelta : NULL;
+        chunkDelta.sumSquares = 0;
+        chunkDelta.maxDiff = 0;
+        chunkDelta.firstByte = (delta != NULL) ? delta->firstByte : 0;
+        chunkDelta.endByte = (delta != NULL) ? delta->endByte : 0;
+        runEngine(engine, inImg, offsetRowIdx + i * chunkRows,
+            (rows - i * chunkRows < chunkRows) ? rows - i * chunkRows
+                : chunkRows,
+            outImg, &chunkFilter);
+        sumSquares += chunkDelta.sumSquares;
+        if (chunkDelta.maxDiff > maxDiff)
+            maxDiff = chunkDelta.maxDiff;
+    }
+    if (delta == NULL)
+        return;
+    delta->sumSquares += sumSquares;
+    if (maxDiff > delta->maxDiff)
+        delta->maxDiff = maxDiff;
+}
+
+/**
+ * Partial running convolution with a bank of prepared filters, in a single
+ *  pass over the input where possible: the filters of the vector method
+ *  (see conv_runVectorPartially) share the padded strip and its column
+ *  blocks, so that every input row is loaded once for all of them. The other
+ *  filters run with their own engine (see conv_runFilterPartially).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t **outImgs The output image of every filter.
+ * @param struct conv_filter_t **filters The prepared filters. They must have
+ *  the same border mode.
+ * @param int amount The amount of filters (at most CONV_MAX_BANK_FILTERS).
+ */
+void conv_runBankPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t **outImgs, struct conv_filter_t **filters,
+    int amount)
+{
+    int i, f, k, rows, threads, chunkRows, nChunks, shared, widest;
+    struct conv_filter_t *sharedFilters[CONV_MAX_BANK_FILTERS];
+    struct image_t *sharedImgs[CONV_MAX_BANK_FILTERS];
+
+    // Check params
+    rows = inImg->height - offsetRowIdx;
+    if (rows > limit)
+        rows = limit;
+    if (rows <= 0 || amount <= 0 || amount > CONV_MAX_BANK_FILTERS)
+        return;
+    simd_init();
+
+    // Filters of the vector method share a pass (8-bit samples). Separable
+    //  ones join it when their taps are cheaper than the two passes (small
+    //  filters) or when they have a generated kernel.
+    shared = 0;
+    widest = 0;
+    for (f = 0; f < amount; f++) {
+        k = 2 * filters[f]->radius + 1;
+        if (inImg->sampleType == IMG_SAMPLE_U8
+            && conv_chooseEngine(filters[f], inImg->width, rows,
+                inImg->pixelSize) == CONV_ENGINE_DIRECT
+            && filters[f]->fixedBits == 0 && (!filters[f]->separable
+                || filters[f]->jit != NULL || CONV_COST_DIRECT_BYTE + k * k * CONV_COST_DIRECT_TAP
+                    < CONV_COST_SEPARABLE_BYTE
+                        + 2 * k * CONV_COST_SEPARABLE_TAP)) {
+            if (filters[f]->radius > filters[widest]->radius)
+                widest = f;
+            sharedFilters[shared] = filters[f];
+            sharedImgs[shared++] = outImgs[f];
+        } else
+            conv_runFilterPartially(inImg, offsetRowIdx, limit, outImgs[f],
+                filters[f]);
+    }
+    if (shared == 0)
+        return;
+
+    // Split the rows (the widest filter pads the chunks)
+    chunkRows = getChunkRows(filters[widest], CONV_ENGINE_DIRECT,
+        filters[widest]->radius, rows, &threads);
+    nChunks = (rows + chunkRows - 1) / chunkRows;
+
+    // Run every chunk
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(threads) schedule(dynamic, 1) \
+        if (nChunks > 1)
+#endif
+    for (i = 0; i < nChunks; i++)
+        runVectorBank(inImg, offsetRowIdx + i * chunkRows,
+            (rows - i * chunkRows < chunkRows) ? rows - i * chunkRows
+                : chunkRows,
+            sharedImgs, sharedFilters, shared);
+}
+
+/**
+ * Partial running convolution. No filter normalization and other logic used.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct matrix_t *normFilter The filter to apply. It is already
+ *  normalized.
+ */
+void conv_runPartially(struct image_t *inImg, int offsetRowIdx, int limit,
+    struct image_t *outImg, struct matrix_t *normFilter)
+{
+    struct conv_filter_t *filter;
+
+    // Analyse the filter
+    filter = conv_makeFilter(normFilter);
+    if (filter == NULL) {
+        conv_runDirectPartially(inImg, offsetRowIdx, limit, outImg,
+            normFilter);
+        return;
+    }
+
+    // Run
+    conv_runFilterPartially(inImg, offsetRowIdx, limit, outImg, filter);
+
+    // Clean up
+    conv_destroyFilter(filter);
+}
+
+/**
+ * Runs image convolution with a prepared filter.
+ * @param struct image_t *imp The image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @return struct image_t* The resulting image or NULL in case of failure.
+ */
+struct image_t *conv_runFilter(struct image_t *img,
+    struct conv_filter_t *filter)
+{
+    struct image_t *retVal;
 
     // Make output image
-    retVal = img_make(img->width, img->height, img->pixelSize);
+    retVal = img_makeWithLayout(img->width, img->height, img->pixelSize,
+        img->layout);
+    if (retVal == NULL) {
+        return NULL;
+    }
+
+    // Run the partial call
+    conv_runFilterPartially(img, 0, img->height, retVal, filter);
+
+    return retVal;
+}
+
+/**
+ * Runs image convolution.
+ * @param struct image_t *imp The image.
+ * @param struct matrix_t *filter The filter to apply.
+ * @return struct image_t* The resulting image or NULL in case of failure.
+ */
+struct image_t *conv_run(struct image_t *img, struct matrix_t *filter)
+{
+    struct image_t *retVal;
+    struct matrix_t *normFilter;
+
+    // Normalize the filter
+    normFilter = conv_normalizeFilter(filter);
+
+    // Make output image
+    retVal = img_makeWithLayout(img->width, img->height, img->pixelSize,
+        img->layout);
     if (retVal == NULL) {
         return NULL;
     }
@@ -144,3 +2212,46 @@ struct image_t *conv_run(struct image_t *img, struct matrix_t *filter)
 
     return retVal;
 }
+
+/******************************************************************************
+ * Convergence
+ *****************************************************************************/
+
+/**
+ * Returns the Euclidean distance between the input and output samples of a
+ *  change.
+ * @param struct conv_delta_t *delta The change.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @return double The distance.
+ */
+double conv_getDeltaDistance(struct conv_delta_t *delta,
+    ImgSampleType sampleType)
+{
+    if (sampleType == IMG_SAMPLE_F32)
+        return sqrt(delta->sumSquares / (double) CONV_DELTA_FLOAT_ONE);
+
+    return sqrt((double) delta->sumSquares);
+}
+
+/**
+ * Tells whether iterations have converged, from the change made by the last
+ *  one.
+ * @param struct conv_delta_t *delta The change of the last iteration (over
+ *  the whole image).
+ * @param ImgSampleType sampleType The type of the samples.
+ * @param ConvCriterion criterion The stopping criterion.
+ * @param double tolerance The largest change of a converged iteration: the
+ *  Euclidean distance or the change of a sample.
+ * @return int 1 if they have converged, 0 otherwise (always with
+ *  CONV_CRITERION_NONE).
+ */
+int conv_hasConverged(struct conv_delta_t *delta, ImgSampleType sampleType,
+    ConvCriterion criterion, double tolerance)
+{
+    if (criterion == CONV_CRITERION_L2)
+        return conv_getDeltaDistance(delta, sampleType) <= tolerance;
+    if (criterion == CONV_CRITERION_MAX)
+        return delta->maxDiff <= tolerance;
+
+    return 0;
+}
@@ -10,6 +10,156 @@
 #include <types/matrix.h>
 #include <types/image.h>
 
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Maximum relative residual (against the largest coefficient) for a filter to
+//  be treated as separable
+#define CONV_SEPARABLE_TOLERANCE 1e-6
+
+// Range of fractional bits of the fixed-point weights
+#define CONV_FIXED_MIN_BITS 1
+#define CONV_FIXED_MAX_BITS 30
+
+// Column blocks of the tap engines: the width is a multiple of the minimum
+//  one, and the cache sizes are assumed when they cannot be detected
+#define CONV_MIN_TILE_WIDTH 16
+#define CONV_DEFAULT_L1_SIZE (32 * 1024)
+#define CONV_DEFAULT_L2_SIZE (256 * 1024)
+
+// Box filters: passes of the Gaussian approximation (three passes are
+//  within a few percent of a true Gaussian)
+#define CONV_MAX_BOX_PASSES 8
+#define CONV_DEFAULT_BOX_PASSES 3
+
+// Maximum amount of filters of a bank (see conv_runBankPartially)
+#define CONV_MAX_BANK_FILTERS 16
+
+// Minimum amount of rows of the chunks handed out to the threads one by one
+//  (dynamic scheduling)
+#define CONV_DYNAMIC_CHUNK_ROWS 16
+
+// Minimum amount of rows of the chunks of the FFT engine, whatever the
+//  threads (its tiles start at the first row of a chunk, so the chunks must
+//  not depend on the amount of threads for the output not to)
+#define CONV_FFT_CHUNK_ROWS 128
+
+// Fixed-point unit of the squared changes of float samples (see
+//  conv_delta_t)
+#define CONV_DELTA_FLOAT_ONE 65536
+
+// Measured costs of the direct and separable methods on a 1920x2520 RGB
+//  image (nanoseconds, AVX-512 CPU): per output byte and per tap and output
+//  byte. conv_chooseEngine() weighs them against the cost of the FFT tiles.
+#define CONV_COST_DIRECT_BYTE 2.8
+#define CONV_COST_DIRECT_TAP 0.048
+#define CONV_COST_SEPARABLE_BYTE 4.6
+#define CONV_COST_SEPARABLE_TAP 0.63
+
+// Same for the sparse engine, per non-zero tap
+#define CONV_COST_SPARSE_BYTE 2.8
+#define CONV_COST_SPARSE_TAP 0.12
+
+// Same for the generated kernels (see jit.h), per non-zero tap and per group
+//  of taps sharing a weight
+#define CONV_COST_JIT_BYTE 2.8
+#define CONV_COST_JIT_TAP 0.048
+#define CONV_COST_JIT_GROUP 0.012
+
+/******************************************************************************
+ * Data structures
+ *****************************************************************************/
+
+typedef enum {
+    CONV_ENGINE_AUTO = 0,   // Cheapest engine for the filter and strip size
+    CONV_ENGINE_DIRECT = 1, // Taps (vector, separable or fixed-point kernels)
+    CONV_ENGINE_FFT = 2,    // Overlap-save with 2D FFTs
+    CONV_ENGINE_BOX = 3,    // Running sums (box filters only)
+    CONV_ENGINE_WINOGRAD = 4, // Winograd F(2x2, 3x3) tiles (3x3 filters only)
+    CONV_ENGINE_SPARSE = 5  // Non-zero taps only (filters with many zeros)
+} ConvEngine;
+
+typedef enum {
+    CONV_CRITERION_NONE = 0,    // Run every iteration
+    CONV_CRITERION_L2 = 1,      // Euclidean distance between the iterations
+    CONV_CRITERION_MAX = 2      // Largest change of a byte
+} ConvCriterion;
+
+typedef enum {
+    CONV_SCHEDULE_STATIC = 0,   // One block of rows per thread
+    CONV_SCHEDULE_DYNAMIC = 1   // Small chunks of rows, handed out on demand
+} ConvSchedule;
+
+struct conv_tap_t {         // Non-zero tap of a filter
+    // Row and column of the tap in the window of an output pixel (input
+    //  pixel (rowIdx - radius + dy, pixelIdx - radius + dx))
+    int dy;
+    int dx;
+    float weight;
+};
+
+struct conv_delta_t {       // Change made by a convolution to the samples
+    // Sum of the squared differences between the input and output samples
+    //  (in 1 / CONV_DELTA_FLOAT_ONE for float samples, each one being rounded
+    //  on its own so that the sum does not depend on their order)
+    long long sumSquares;
+    // Largest absolute difference
+    double maxDiff;
+    // Bytes of the rows whose change is tracked, from firstByte up to
+    //  endByte (exclusive), e.g. the columns of a block (the whole rows if
+    //  endByte is 0)
+    int firstByte;
+    int endByte;
+};
+
+struct conv_filter_t {      // Analysed filter, ready to be applied
+    // The normalized filter (not owned)
+    struct matrix_t *mat;
+    // Filter radius (filter size is 2 * radius + 1)
+    int radius;
+    // How the pixels outside the image are made up
+    ImgBorderMode border;
+    // Requested engine
+    ConvEngine engine;
+    // Width of the column blocks of the tap engines in pixels (0 for the
+    //  one picked from the cache sizes)
+    int tileWidth;
+    // Threads splitting the rows of a strip, and how
+    int threads;
+    ConvSchedule schedule;
+    // Rank-1 decomposition: mat[i][j] = colVec[i] * rowVec[j]
+    int separable;
+    double *colVec;
+    double *rowVec;
+    // Box passes (0 if the filter is not made of boxes): the filter is the
+    //  composition of boxPasses uniform filters of the given radii, times
+    //  boxScale
+    int boxPasses;
+    int boxRadii[CONV_MAX_BOX_PASSES];
+    double boxScale;
+    // Flipped single precision weights (k x k, row-major) for the vector
+    //  kernels, i.e. weights[a * k + b] = mat[k - 1 - a][k - 1 - b]
+    float *weights;
+    // The non-zero weights, in the same order (see conv_runSparsePartially)
+    int nTaps;
+    struct conv_tap_t *taps;
+    // Winograd transform of the weights (4 x 4, 3x3 filters only)
+    float winogradWeights[16];
+    // Fixed-point weights scaled by 2^fixedBits (flipped like weights). The
+    //  16-bit copy is NULL when they do not fit the vector kernels.
+    int fixedBits;
+    int *fixedWeights;
+    short *fixedWeights16;
+    // Machine code of the vector kernel generated for this filter (NULL if
+    //  none, see conv_compileFilter)
+    struct jit_kernel_t *jit;
+    // Change accumulated by the engines as they store the output rows (NULL
+    //  if it is not tracked). Set on a copy of the filter per chunk of rows,
+    //  see conv_runFilterPartiallyDelta.
+    struct conv_delta_t *delta;
+};
+
 /******************************************************************************
  * Filter normalization
  *****************************************************************************/
@@ -21,10 +171,291 @@
  */
 struct matrix_t* conv_normalizeFilter(struct matrix_t *mat);
 
+/******************************************************************************
+ * Filter analysis
+ *****************************************************************************/
+
+/**
+ * Checks whether a filter is separable (rank 1), i.e. it can be written as a
+ *  column vector times a row vector.
+ * @param struct matrix_t *mat The filter.
+ * @param double tolerance The maximum residual allowed for any coefficient,
+ *  relative to the largest absolute coefficient.
+ * @param double *colVec Filled with the column vector (mat->height values).
+ *  May be NULL.
+ * @param double *rowVec Filled with the row vector (mat->width values). May be
+ *  NULL.
+ * @return int 1 if the filter is separable, 0 otherwise.
+ */
+int conv_isSeparable(struct matrix_t *mat, double tolerance, double *colVec,
+    double *rowVec);
+
+/**
+ * Makes the filter approximating a Gaussian by box passes, i.e. the
+ *  composition of the boxes (see conv_useBoxPasses). The box sizes are the
+ *  odd ones whose composition has the closest variance to sigma^2.
+ * @param double sigma The standard deviation of the Gaussian in pixels.
+ * @param int passes The amount of box passes (1 to CONV_MAX_BOX_PASSES).
+ * @return struct matrix_t* The normalized filter or NULL.
+ */
+struct matrix_t* conv_makeGaussianMatrix(double sigma, int passes);
+
+/**
+ * Analyses a normalized filter and prepares it for convolution. Uniform
+ *  filters are detected as single box passes.
+ * @param struct matrix_t *normFilter The normalized filter. It must outlive
+ *  the returned instance.
+ * @return struct conv_filter_t* The prepared filter or NULL.
+ */
+struct conv_filter_t* conv_makeFilter(struct matrix_t *normFilter);
+
+/**
+ * Marks a prepared filter as made by conv_makeGaussianMatrix(), so that the
+ *  box engine applies it as box passes.
+ * @param struct conv_filter_t *filter The filter prepared from the matrix.
+ * @param double sigma The standard deviation of the Gaussian in pixels.
+ * @param int passes The amount of box passes.
+ * @return int 1 on success, 0 if the filter does not match the passes.
+ */
+int conv_useBoxPasses(struct conv_filter_t *filter, double sigma,
+    int passes);
+
+/**
+ * Quantises the filter into fixed-point weights. From then on the filter is
+ *  applied with integer arithmetic, rounding once per output byte.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param int bits The fractional bits of the weights.
+ * @return double The worst-case error against the double precision result,
+ *  in intensity levels (before truncating to bytes), or -1 on failure.
+ */
+double conv_quantizeFilter(struct conv_filter_t *filter, int bits);
+
+/**
+ * Generates the machine code of the vector kernel of the filter (see jit.h).
+ *  It is kept when it is cheaper than the static kernels according to the
+ *  measured costs (see CONV_COST_JIT_TAP), i.e. when many weights are zero
+ *  or the filter is separable. From then on the direct engine runs it, the
+ *  static kernels only computing the bytes left over at the end of the
+ *  column blocks.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param int pixelSize The pixel size in bytes of the images (1 for planar
+ *  images).
+ * @return int 1 if the kernel is kept, 0 if the static kernels are cheaper,
+ *  -1 if code cannot be generated.
+ */
+int conv_compileFilter(struct conv_filter_t *filter, int pixelSize);
+
+/**
+ * Destroys a prepared filter. The underlying matrix is not destroyed.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_destroyFilter(struct conv_filter_t *filter);
+
+/**
+ * Returns a printable name of an engine.
+ * @param ConvEngine engine The engine.
+ * @return const char* The name.
+ */
+const char* conv_getEngineName(ConvEngine engine);
+
+/**
+ * Picks the engine for a strip: the requested one, or the cheapest one
+ *  according to the measured costs (see CONV_COST_DIRECT_TAP) when it is
+ *  CONV_ENGINE_AUTO. Fixed-point filters always use the direct engine, and
+ *  box filters the box engine unless another one is requested. 3x3 filters
+ *  use the Winograd engine when there are no vector kernels: the nine taps
+ *  of the vector kernels are faster than its transforms otherwise. Filters
+ *  with many zero weights use the sparse engine when their non-zero taps are
+ *  cheaper than the dense ones (see CONV_COST_SPARSE_TAP). Images of 16-bit
+ *  or float samples always use the sparse engine, whatever is picked.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param int width The image width.
+ * @param int rows The amount of rows of the strip.
+ * @param int pixelSize The pixel size in bytes.
+ * @return ConvEngine The engine to use (never CONV_ENGINE_AUTO).
+ */
+ConvEngine conv_chooseEngine(struct conv_filter_t *filter, int width,
+    int rows, int pixelSize);
+
+/**
+ * Picks the width of the column blocks of the tap engines: the requested
+ *  one, or the widest one whose rolling window fits half of the cache when
+ *  it is 0. The window of the separable method (k rows of doubles) is sized
+ *  to the L2 cache, the one of the other methods (k input rows) to the L1
+ *  cache.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param int width The image width.
+ * @param int pixelSize The pixel size in bytes.
+ * @return int The block width in pixels.
+ */
+int conv_getTileWidth(struct conv_filter_t *filter, int width, int pixelSize);
+
 /******************************************************************************
  * Functionality
  *****************************************************************************/
 
+/**
+ * Partial running convolution using the direct (k x k taps per pixel) method.
+ *  This is the reference implementation: bounds are checked on every tap and
+ *  the border is always zero.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct matrix_t *normFilter The filter to apply. It is already
+ *  normalized.
+ */
+void conv_runDirectPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct matrix_t *normFilter);
+
+/**
+ * Partial running convolution using the vectorised row kernels (see simd.h).
+ *  The strip is padded once, so that the kernels run without bound checks,
+ *  and processed in column blocks (see conv_getTileWidth).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_runVectorPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Partial running convolution with the fixed-point weights (see
+ *  conv_quantizeFilter).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter. Must be quantised.
+ */
+void conv_runFixedPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Partial running convolution of a separable filter, as a horizontal pass
+ *  followed by a vertical pass (2k taps per pixel). Matches the direct method
+ *  within one intensity level.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter. Must be separable.
+ */
+void conv_runSeparablePartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Partial running convolution in the frequency domain (overlap-save). The
+ *  padded strip is cut into overlapping square tiles, whose transforms are
+ *  multiplied with the one of the filter. Two tiles share each complex
+ *  transform (as real and imaginary parts). Matches the direct method within
+ *  one intensity level.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_runFftPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Partial running convolution of box passes (see conv_filter_t), with
+ *  running sums along the rows and then along the columns: the cost does not
+ *  depend on the radius. The sums are exact, the scale being applied once
+ *  per output byte. Matches the direct method within one intensity level.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter. Must be made of
+ *  boxes.
+ */
+void conv_runBoxPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Partial running convolution with the non-zero taps of the filter only: the
+ *  taps are accumulated one by one over the row of a column block, i.e.
+ *  every output byte costs as many multiplications as there are non-zero
+ *  weights. Matches the direct method within one intensity level. It is
+ *  also the engine of the 16-bit and float images (float outputs are not
+ *  clamped).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_runSparsePartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Partial running convolution of a 3x3 filter with Winograd's minimal
+ *  filtering F(2x2, 3x3) (see winograd.h): 4 multiplications per output byte
+ *  instead of 9. The strip is processed two rows at a time, every input row
+ *  being transformed once. Matches the direct method within one intensity
+ *  level.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter. Must be 3x3.
+ */
+void conv_runWinogradPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Partial running convolution with a prepared filter. The engine is picked by
+ *  conv_chooseEngine() and the fastest method applicable to the filter is
+ *  used. The rows are split between filter->threads threads (OpenMP), each
+ *  one running the method on its own rows. Planar images are convolved plane
+ *  by plane (see img_getPlane); both images must have the same layout.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ */
+void conv_runFilterPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter);
+
+/**
+ * Same as conv_runFilterPartially, also accumulating the change made to the
+ *  bytes of the rows. The engines compare every output row with the input one
+ *  as they store it, i.e. without another pass over the images.
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t *outImg The output image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @param struct conv_delta_t *delta The change, added to (NULL if not
+ *  tracked).
+ */
+void conv_runFilterPartiallyDelta(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t *outImg, struct conv_filter_t *filter,
+    struct conv_delta_t *delta);
+
+/**
+ * Partial running convolution with a bank of prepared filters, in a single
+ *  pass over the input where possible: the filters of the vector method
+ *  (see conv_runVectorPartially) share the padded strip and its column
+ *  blocks, so that every input row is loaded once for all of them. The other
+ *  filters run with their own engine (see conv_runFilterPartially).
+ * @param struct image_t *inImg The input image.
+ * @param int offsetRowIdx The offset (as row index).
+ * @param int limit The limit (amount of rows).
+ * @param struct image_t **outImgs The output image of every filter.
+ * @param struct conv_filter_t **filters The prepared filters. They must have
+ *  the same border mode.
+ * @param int amount The amount of filters (at most CONV_MAX_BANK_FILTERS).
+ */
+void conv_runBankPartially(struct image_t *inImg, int offsetRowIdx,
+    int limit, struct image_t **outImgs, struct conv_filter_t **filters,
+    int amount);
+
 /**
  * Partial running convolution. No filter normalization and other logic used.
  * @param struct image_t *inImg The input image.
@@ -37,6 +468,15 @@ struct matrix_t* conv_normalizeFilter(struct matrix_t *mat);
 void conv_runPartially(struct image_t *inImg, int offsetRowIdx, int limit,
     struct image_t *outImg, struct matrix_t *normFilter);
 
+/**
+ * Runs image convolution with a prepared filter.
+ * @param struct image_t *imp The image.
+ * @param struct conv_filter_t *filter The prepared filter.
+ * @return struct image_t* The resulting image or NULL in case of failure.
+ */
+struct image_t *conv_runFilter(struct image_t *img,
+    struct conv_filter_t *filter);
+
 /**
  * Runs image convolution.
  * @param struct image_t *imp The image.
@@ -45,4 +485,33 @@ void conv_runPartially(struct image_t *inImg, int offsetRowIdx, int limit,
  */
 struct image_t *conv_run(struct image_t *img, struct matrix_t *filter);
 
+/******************************************************************************
+ * Convergence
+ *****************************************************************************/
+
+/**
+ * Returns the Euclidean distance between the input and output samples of a
+ *  change.
+ * @param struct conv_delta_t *delta The change.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @return double The distance.
+ */
+double conv_getDeltaDistance(struct conv_delta_t *delta,
+    ImgSampleType sampleType);
+
+/**
+ * Tells whether iterations have converged, from the change made by the last
+ *  one.
+ * @param struct conv_delta_t *delta The change of the last iteration (over
+ *  the whole image).
+ * @param ImgSampleType sampleType The type of the samples.
+ * @param ConvCriterion criterion The stopping criterion.
+ * @param double tolerance The largest change of a converged iteration: the
+ *  Euclidean distance or the change of a sample.
+ * @return int 1 if they have converged, 0 otherwise (always with
+ *  CONV_CRITERION_NONE).
+ */
+int conv_hasConverged(struct conv_delta_t *delta, ImgSampleType sampleType,
+    ConvCriterion criterion, double tolerance);
+
 #endif
@@ -0,0 +1,294 @@
+/******************************************************************************
+ * NAME:
+ *  fft.c
+ * DESCRIPTION:
+ *  Fast Fourier transform implementation (iterative radix-2).
+ *****************************************************************************/
+#include "fft.h"
+#include <stdlib.h>
+#include <math.h>
+
+/******************************************************************************
+ * Internals
+ *****************************************************************************/
+
+// The butterflies are compiled for several instruction sets, the best one
+//  being picked when the program is loaded
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define FFT_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define FFT_CLONES
+#endif
+
+// Side of the blocks of the transposition
+#define TRANSPOSE_BLOCK 32
+
+/**
+ * In place transposition of a size x size matrix, block by block.
+ * @param double *values The matrix (row-major).
+ * @param int size The matrix side.
+ */
+static void transpose(double *values, int size)
+{
+    int i, j, bi, bj, endI, endJ;
+    double tmp;
+
+    for (bi = 0; bi < size; bi += TRANSPOSE_BLOCK)
+        for (bj = bi; bj < size; bj += TRANSPOSE_BLOCK) {
+            endI = (bi + TRANSPOSE_BLOCK < size) ? bi + TRANSPOSE_BLOCK : size;
+            endJ = (bj + TRANSPOSE_BLOCK < size) ? bj + TRANSPOSE_BLOCK : size;
+            for (i = bi; i < endI; i++)
+                for (j = (bi == bj) ? i + 1 : bj; j < endJ; j++) {
+                    tmp = values[i * size + j];
+                    values[i * size + j] = values[j * size + i];
+                    values[j * size + i] = tmp;
+                }
+        }
+}
+
+/**
+ * Butterflies between two rows of a matrix: lo + w * hi and lo - w * hi.
+ * @param double *loRe The real parts of the low row.
+ * @param double *loIm The imaginary parts of the low row.
+ * @param double *hiRe The real parts of the high row.
+ * @param double *hiIm The imaginary parts of the high row.
+ * @param double wr The real part of the twiddle factor.
+ * @param double wi The imaginary part of the twiddle factor.
+ * @param int n The row size.
+ */
+FFT_CLONES
+static void runButterflies(double *restrict loRe, double *restrict loIm,
+    double *restrict hiRe, double *restrict hiIm, double wr, double wi, int n)
+{
+    int i;
+    double xr, xi;
+
+    for (i = 0; i < n; i++) {
+        xr = hiRe[i] * wr - hiIm[i] * wi;
+        xi = hiRe[i] * wi + hiIm[i] * wr;
+        hiRe[i] = loRe[i] - xr;
+        hiIm[i] = loIm[i] - xi;
+        loRe[i] += xr;
+        loIm[i] += xi;
+    }
+}
+
+/**
+ * Two stages of butterflies between four rows of a matrix (rows j, j + half,
+ *  j + 2 * half and j + 3 * half), i.e. one pass over memory instead of two.
+ * @param double *re0 The real parts of the first row.
+ * @param double *im0 The imaginary parts of the first row.
+ * @param double *re1 The real parts of the second row.
+ * @param double *im1 The imaginary parts of the second row.
+ * @param double *re2 The real parts of the third row.
+ * @param double *im2 The imaginary parts of the third row.
+ * @param double *re3 The real parts of the fourth row.
+ * @param double *im3 The imaginary parts of the fourth row.
+ * @param const double *w The twiddle factors (real and imaginary parts): one
+ *  of the first stage and two of the second stage.
+ * @param int n The row size.
+ */
+FFT_CLONES
+static void runButterflies4(double *restrict re0, double *restrict im0,
+    double *restrict re1, double *restrict im1, double *restrict re2,
+    double *restrict im2, double *restrict re3, double *restrict im3,
+    const double *w, int n)
+{
+    int i;
+    double xr, xi;
+    double ar0, ai0, ar1, ai1, ar2, ai2, ar3, ai3;
+    double w0r, w0i, w1r, w1i, w2r, w2i;
+
+    w0r = w[0];
+    w0i = w[1];
+    w1r = w[2];
+    w1i = w[3];
+    w2r = w[4];
+    w2i = w[5];
+    for (i = 0; i < n; i++) {
+        // First stage: (0, 1) and (2, 3)
+        xr = re1[i] * w0r - im1[i] * w0i;
+        xi = re1[i] * w0i + im1[i] * w0r;
+        ar0 = re0[i] + xr;
+        ai0 = im0[i] + xi;
+        ar1 = re0[i] - xr;
+        ai1 = im0[i] - xi;
+        xr = re3[i] * w0r - im3[i] * w0i;
+        xi = re3[i] * w0i + im3[i] * w0r;
+        ar2 = re2[i] + xr;
+        ai2 = im2[i] + xi;
+        ar3 = re2[i] - xr;
+        ai3 = im2[i] - xi;
+
+        // Second stage: (0, 2) and (1, 3)
+        xr = ar2 * w1r - ai2 * w1i;
+        xi = ar2 * w1i + ai2 * w1r;
+        re0[i] = ar0 + xr;
+        im0[i] = ai0 + xi;
+        re2[i] = ar0 - xr;
+        im2[i] = ai0 - xi;
+        xr = ar3 * w2r - ai3 * w2i;
+        xi = ar3 * w2i + ai3 * w2r;
+        re1[i] = ar1 + xr;
+        im1[i] = ai1 + xi;
+        re3[i] = ar1 - xr;
+        im3[i] = ai1 - xi;
+    }
+}
+
+/**
+ * Swaps two rows of a matrix.
+ * @param double *a The first row.
+ * @param double *b The second row.
+ * @param int n The row size.
+ */
+static void swapRows(double *restrict a, double *restrict b, int n)
+{
+    int i;
+    double tmp;
+
+    for (i = 0; i < n; i++) {
+        tmp = a[i];
+        a[i] = b[i];
+        b[i] = tmp;
+    }
+}
+
+/**
+ * In place transform of every column of a size x size matrix. Butterflies
+ *  combine whole rows, so the inner loops run over contiguous memory.
+ * @param struct fft_plan_t *plan The plan.
+ * @param double *re The real parts.
+ * @param double *im The imaginary parts.
+ * @param int inverse 1 for the inverse transform, 0 for the forward one.
+ */
+static void runColumns(struct fft_plan_t *plan, double *re, double *im,
+    int inverse)
+{
+    int i, j, half, size;
+    double sign, w[6];
+
+    // Bit reversal permutation
+    size = plan->size;
+    for (i = 0; i < size; i++) {
+        j = plan->bitRev[i];
+        if (i < j) {
+            swapRows(&(re[i * size]), &(re[j * size]), size);
+            swapRows(&(im[i * size]), &(im[j * size]), size);
+        }
+    }
+
+    // Butterflies (the inverse transform uses the conjugate twiddles). An
+    //  odd stage first, then the stages two by two.
+    sign = inverse ? -1 : 1;
+    half = 1;
+    if (plan->logSize % 2) {
+        for (i = 0; i < size; i += 2)
+            runButterflies(&(re[i * size]), &(im[i * size]),
+                &(re[(i + 1) * size]), &(im[(i + 1) * size]), 1, 0, size);
+        half = 2;
+    }
+    for (; half < size; half <<= 2)
+        for (i = 0; i < size; i += 4 * half)
+            for (j = 0; j < half; j++) {
+                w[0] = plan->twiddleRe[half - 1 + j];
+                w[1] = sign * plan->twiddleIm[half - 1 + j];
+                w[2] = plan->twiddleRe[2 * half - 1 + j];
+                w[3] = sign * plan->twiddleIm[2 * half - 1 + j];
+                w[4] = plan->twiddleRe[2 * half - 1 + j + half];
+                w[5] = sign * plan->twiddleIm[2 * half - 1 + j + half];
+                runButterflies4(&(re[(i + j) * size]), &(im[(i + j) * size]),
+                    &(re[(i + j + half) * size]), &(im[(i + j + half) * size]),
+                    &(re[(i + j + 2 * half) * size]),
+                    &(im[(i + j + 2 * half) * size]),
+                    &(re[(i + j + 3 * half) * size]),
+                    &(im[(i + j + 3 * half) * size]), w, size);
+            }
+}
+
+/******************************************************************************
+ * Creation / destruction
+ *****************************************************************************/
+
+/**
+ * Creates a transform plan.
+ * @param int size The transform size. Must be a power of two between
+ *  FFT_MIN_SIZE and FFT_MAX_SIZE.
+ * @return struct fft_plan_t* The plan or NULL.
+ */
+struct fft_plan_t* fft_makePlan(int size)
+{
+    int i, j, half;
+    struct fft_plan_t *retVal;
+
+    // Check params
+    if (size < FFT_MIN_SIZE || size > FFT_MAX_SIZE || (size & (size - 1)))
+        return NULL;
+
+    // Allocate space
+    retVal = malloc(sizeof(struct fft_plan_t));
+    if (retVal == NULL)
+        return NULL;
+    retVal->size = size;
+    for (retVal->logSize = 0; (1 << retVal->logSize) < size;
+        retVal->logSize++);
+    retVal->bitRev = malloc(sizeof(int) * size);
+    retVal->twiddleRe = malloc(sizeof(double) * size);
+    retVal->twiddleIm = malloc(sizeof(double) * size);
+    if (retVal->bitRev == NULL || retVal->twiddleRe == NULL
+        || retVal->twiddleIm == NULL) {
+        fft_destroyPlan(retVal);
+        return NULL;
+    }
+
+    // Bit reversal permutation
+    for (i = 0; i < size; i++) {
+        retVal->bitRev[i] = 0;
+        for (j = 0; j < retVal->logSize; j++)
+            if (i & (1 << j))
+                retVal->bitRev[i] |= 1 << (retVal->logSize - 1 - j);
+    }
+
+    // Twiddle factors, stage by stage so that every stage reads them in order
+    for (half = 1; half < size; half <<= 1)
+        for (j = 0; j < half; j++) {
+            retVal->twiddleRe[half - 1 + j] = cos(M_PI * j / half);
+            retVal->twiddleIm[half - 1 + j] = -sin(M_PI * j / half);
+        }
+
+    return retVal;
+}
+
+/**
+ * Destroys a transform plan.
+ * @param struct fft_plan_t *plan The plan to destroy.
+ */
+void fft_destroyPlan(struct fft_plan_t *plan)
+{
+    free(plan->bitRev);
+    free(plan->twiddleRe);
+    free(plan->twiddleIm);
+    free(plan);
+}
+
+/******************************************************************************
+ * Transforms
+ *****************************************************************************/
+
+/**
+ * In place complex transform of a size x size matrix (row-major), as a pass
+ *  over the columns, a transposition and another pass over the columns. The
+ *  result is therefore transposed: running the forward and then the inverse
+ *  transform gives back the original matrix (scaled by size * size).
+ * @param struct fft_plan_t *plan The plan.
+ * @param double *re The real parts.
+ * @param double *im The imaginary parts.
+ * @param int inverse 1 for the inverse transform, 0 for the forward one.
+ */
+void fft_run2D(struct fft_plan_t *plan, double *re, double *im, int inverse)
+{
+    runColumns(plan, re, im, inverse);
+    transpose(re, plan->size);
+    transpose(im, plan->size);
+    runColumns(plan, re, im, inverse);
+}
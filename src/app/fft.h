@@ -0,0 +1,67 @@
+/******************************************************************************
+ * NAME:
+ *  fft.h
+ * DESCRIPTION:
+ *  Fast Fourier transform header file.
+ *****************************************************************************/
+#ifndef _FFT
+#define _FFT
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Range of transform sizes (powers of two)
+#define FFT_MIN_SIZE 4
+#define FFT_MAX_SIZE 1024
+
+/******************************************************************************
+ * Data structures
+ *****************************************************************************/
+
+struct fft_plan_t {         // Precomputed tables of a transform size
+    int size;
+    int logSize;
+    // Bit reversed index of every element
+    int *bitRev;
+    // Twiddle factors exp(-2 pi i j / len) of every stage (len = 2 * half),
+    //  the ones of a stage starting at index half - 1
+    double *twiddleRe;
+    double *twiddleIm;
+};
+
+/******************************************************************************
+ * Creation / destruction
+ *****************************************************************************/
+
+/**
+ * Creates a transform plan.
+ * @param int size The transform size. Must be a power of two between
+ *  FFT_MIN_SIZE and FFT_MAX_SIZE.
+ * @return struct fft_plan_t* The plan or NULL.
+ */
+struct fft_plan_t* fft_makePlan(int size);
+
+/**
+ * Destroys a transform plan.
+ * @param struct fft_plan_t *plan The plan to destroy.
+ */
+void fft_destroyPlan(struct fft_plan_t *plan);
+
+/******************************************************************************
+ * Transforms
+ *****************************************************************************/
+
+/**
+ * In place complex transform of a size x size matrix (row-major), as a pass
+ *  over the columns, a transposition and another pass over the columns. The
+ *  result is therefore transposed: running the forward and then the inverse
+ *  transform gives back the original matrix (scaled by size * size).
+ * @param struct fft_plan_t *plan The plan.
+ * @param double *re The real parts.
+ * @param double *im The imaginary parts.
+ * @param int inverse 1 for the inverse transform, 0 for the forward one.
+ */
+void fft_run2D(struct fft_plan_t *plan, double *re, double *im, int inverse);
+
+#endif
@@ -0,0 +1,475 @@
+/******************************************************************************
+ * NAME:
+ *  jit.c
+ * DESCRIPTION:
+ *  Row kernels generated at runtime for a given filter implementation. The
+ *  AVX2 code is written into an anonymous mapping, which is made executable
+ *  (and read-only) once complete.
+ *****************************************************************************/
+#include "jit.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/******************************************************************************
+ * Internals
+ *****************************************************************************/
+
+// Layout of the constants at the start of the mapping: the permutation of
+//  the packed bytes, 255 and the weight of every group (as a whole vector)
+#define POOL_ORDER 0
+#define POOL_MAX 32
+#define POOL_WEIGHTS 64
+#define POOL_WEIGHT_SIZE 32
+
+// Upper bound of the code size: the loop of a tap (and of its group), and
+//  the rest
+#define CODE_TAP_SIZE 160
+#define CODE_BASE_SIZE 1024
+
+// Registers (numbers of the instruction encoding)
+#define RAX 0
+#define RDX 2
+#define RSI 6
+#define RDI 7
+#define R8 8
+#define R9 9
+
+// Vector registers: accumulators (0-3), sums of a group (4-7), bytes of a
+//  tap (8-11), permutation (12), 255 (13) and zero (14)
+#define YMM_ACC 0
+#define YMM_SUM 4
+#define YMM_TAP 8
+#define YMM_ORDER 12
+#define YMM_MAX 13
+#define YMM_ZERO 14
+
+// VEX opcode maps and implied prefixes
+#define MAP_0F 1
+#define MAP_0F38 2
+#define PP_NONE 0
+#define PP_66 1
+#define PP_F3 2
+
+// Code being written
+typedef struct {
+    unsigned char *code;
+    int size;               // Bytes written (may exceed the capacity)
+    int capacity;
+} Emitter;
+
+// Operand of the r/m field: a vector register, or [base + index + disp]
+typedef struct {
+    int isReg;
+    int reg;
+    int base;
+    int index;              // -1 if none
+    int disp;
+} Operand;
+
+static Operand regOperand(int reg)
+{
+    Operand retVal = {1, reg, 0, -1, 0};
+
+    return retVal;
+}
+
+static Operand memOperand(int base, int index, int disp)
+{
+    Operand retVal = {0, 0, base, index, disp};
+
+    return retVal;
+}
+
+static void emitByte(Emitter *e, int value)
+{
+    if (e->size < e->capacity)
+        e->code[e->size] = value;
+    e->size++;
+}
+
+static void emitInt(Emitter *e, int value)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        emitByte(e, (value >> (8 * i)) & 0xff);
+}
+
+/**
+ * Emits the ModR/M byte, and the SIB byte and 32-bit displacement of memory
+ *  operands.
+ * @param Emitter *e The code.
+ * @param int reg The register of the reg field.
+ * @param Operand rm The operand of the r/m field.
+ */
+static void emitModRm(Emitter *e, int reg, Operand rm)
+{
+    if (rm.isReg) {
+        emitByte(e, 0xc0 | (reg & 7) << 3 | (rm.reg & 7));
+        return;
+    }
+    if (rm.index >= 0 || (rm.base & 7) == 4) {
+        emitByte(e, 0x80 | (reg & 7) << 3 | 4);
+        emitByte(e, ((rm.index >= 0) ? rm.index & 7 : 4) << 3
+            | (rm.base & 7));
+    } else
+        emitByte(e, 0x80 | (reg & 7) << 3 | (rm.base & 7));
+    emitInt(e, rm.disp);
+}
+
+/**
+ * Emits a 256-bit VEX instruction (3-byte prefix, W0).
+ * @param Emitter *e The code.
+ * @param int map The opcode map (MAP_0F or MAP_0F38).
+ * @param int pp The implied prefix (PP_NONE, PP_66 or PP_F3).
+ * @param int opcode The opcode.
+ * @param int reg The register of the reg field.
+ * @param int vvvv The extra source register (0 if none).
+ * @param Operand rm The operand of the r/m field.
+ */
+static void emitVex(Emitter *e, int map, int pp, int opcode, int reg,
+    int vvvv, Operand rm)
+{
+    int x, b;
+
+    b = (rm.isReg ? rm.reg : rm.base) >> 3;
+    x = (!rm.isReg && rm.index >= 0) ? rm.index >> 3 : 0;
+    emitByte(e, 0xc4);
+    emitByte(e, !(reg >> 3) << 7 | !x << 6 | !b << 5 | map);
+    emitByte(e, (~vvvv & 15) << 3 | 1 << 2 | pp);
+    emitByte(e, opcode);
+    emitModRm(e, reg, rm);
+}
+
+/**
+ * Emits a jump to an earlier position or to one patched later (see
+ *  patchJump).
+ * @param Emitter *e The code.
+ * @param int condition The condition code (0x0c: less, 0x0e: less or
+ *  equal).
+ * @param int target The target position (ignored when patched later).
+ * @return int The position of the displacement.
+ */
+static int emitJump(Emitter *e, int condition, int target)
+{
+    int retVal;
+
+    emitByte(e, 0x0f);
+    emitByte(e, 0x80 | condition);
+    retVal = e->size;
+    emitInt(e, target - (retVal + 4));
+
+    return retVal;
+}
+
+static void patchJump(Emitter *e, int position, int target)
+{
+    int i, value;
+
+    value = target - (position + 4);
+    for (i = 0; i < 4 && position + i < e->capacity; i++)
+        e->code[position + i] = (value >> (8 * i)) & 0xff;
+}
+
+/**
+ * Emits the code of a group of taps: the sum of their bytes (the ones of the
+ *  opposite weight being subtracted), multiplied by the weight and added to
+ *  the accumulators.
+ * @param Emitter *e The code.
+ * @param const int *taps The indices of the taps (a * k + b).
+ * @param const int *signs The sign of every tap (1 or -1).
+ * @param int amount The amount of taps.
+ * @param int group The group index (weight in the constants).
+ * @param int k The filter size.
+ * @param int pixelSize The pixel size in bytes.
+ */
+static void emitGroup(Emitter *e, const int *taps, const int *signs,
+    int amount, int group, int k, int pixelSize)
+{
+    int t, j, dst, offset;
+
+    for (t = 0; t < amount; t++) {
+        // mov r8, [rdx + 8 * a]: the input row of the tap
+        emitByte(e, 0x4c);
+        emitByte(e, 0x8b);
+        emitModRm(e, R8, memOperand(RDX, -1, 8 * (taps[t] / k)));
+
+        // vpmovzxbd: 4 x 8 bytes to 32-bit integers, added to the sums
+        offset = (taps[t] % k) * pixelSize;
+        dst = (t == 0) ? YMM_SUM : YMM_TAP;
+        for (j = 0; j < 4; j++)
+            emitVex(e, MAP_0F38, PP_66, 0x31, dst + j, 0,
+                memOperand(R8, RAX, offset + 8 * j));
+        for (j = 0; j < 4 && t > 0; j++)
+            emitVex(e, MAP_0F, PP_66, (signs[t] > 0) ? 0xfe : 0xfa,
+                YMM_SUM + j, YMM_SUM + j, regOperand(YMM_TAP + j));
+    }
+
+    // The first tap of a group has the positive sign, so the weight of the
+    //  group is its own: acc += float(sum) * weight (vfmadd231ps, the
+    //  weight being stored broadcast)
+    for (j = 0; j < 4; j++) {
+        emitVex(e, MAP_0F, PP_NONE, 0x5b, YMM_SUM + j, 0,
+            regOperand(YMM_SUM + j));
+        emitVex(e, MAP_0F38, PP_66, 0xb8, YMM_ACC + j, YMM_SUM + j,
+            memOperand(R9, -1, POOL_WEIGHTS + POOL_WEIGHT_SIZE * group));
+    }
+}
+
+/**
+ * Emits the whole kernel (see JitRowKernel).
+ * @param Emitter *e The code.
+ * @param const int *tapIdxs The indices of the non-zero taps (a * k + b).
+ * @param const int *groups The group of every tap, in index order.
+ * @param const int *signs The sign of every tap.
+ * @param int taps The amount of taps.
+ * @param int amount The amount of groups.
+ * @param int k The filter size.
+ * @param int pixelSize The pixel size in bytes.
+ * @param int *poolPosition Filled with the position of the address of the
+ *  constants.
+ */
+static void emitKernel(Emitter *e, const int *tapIdxs, const int *groups,
+    const int *signs, int taps, int amount, int k, int pixelSize,
+    int *poolPosition)
+{
+    int g, t, j, n, loop, end;
+    int *groupTaps, *groupSigns;
+
+    // n = (n & -32), nothing to do if zero
+    emitByte(e, 0x48);      // movsxd rsi, esi
+    emitByte(e, 0x63);
+    emitByte(e, 0xf6);
+    emitByte(e, 0x48);      // and rsi, -32
+    emitByte(e, 0x83);
+    emitByte(e, 0xe6);
+    emitByte(e, -JIT_STEP_BYTES & 0xff);
+    emitByte(e, 0x48);      // test rsi, rsi
+    emitByte(e, 0x85);
+    emitByte(e, 0xf6);
+    end = emitJump(e, 0x0e, 0);
+
+    // Constants: r9 = address (patched once mapped), permutation, 255 and
+    //  zero. i (rax) = 0.
+    emitByte(e, 0x49);      // mov r9, imm64
+    emitByte(e, 0xb9);
+    *poolPosition = e->size;
+    for (j = 0; j < 8; j++)
+        emitByte(e, 0);
+    emitVex(e, MAP_0F, PP_F3, 0x6f, YMM_ORDER, 0,
+        memOperand(R9, -1, POOL_ORDER));
+    emitVex(e, MAP_0F38, PP_66, 0x18, YMM_MAX, 0,
+        memOperand(R9, -1, POOL_MAX));
+    emitVex(e, MAP_0F, PP_NONE, 0x57, YMM_ZERO, YMM_ZERO,
+        regOperand(YMM_ZERO));
+    emitByte(e, 0x31);      // xor eax, eax
+    emitByte(e, 0xc0);
+
+    // Loop over the steps: accumulate the groups
+    loop = e->size;
+    for (j = 0; j < 4; j++)
+        emitVex(e, MAP_0F, PP_NONE, 0x57, YMM_ACC + j, YMM_ACC + j,
+            regOperand(YMM_ACC + j));
+    groupTaps = malloc(sizeof(int) * (taps + 1));
+    groupSigns = malloc(sizeof(int) * (taps + 1));
+    for (g = 0; g < amount && groupTaps != NULL && groupSigns != NULL; g++) {
+        n = 0;
+        for (t = 0; t < taps; t++)
+            if (groups[t] == g) {
+                groupTaps[n] = tapIdxs[t];
+                groupSigns[n++] = signs[t];
+            }
+        emitGroup(e, groupTaps, groupSigns, n, g, k, pixelSize);
+    }
+    if (groupTaps == NULL || groupSigns == NULL)
+        e->size = e->capacity + 1;
+    free(groupTaps);
+    free(groupSigns);
+
+    // Clamp, truncate and pack to bytes (per 128-bit lane, hence the
+    //  permutation), then store
+    for (j = 0; j < 4; j++) {
+        emitVex(e, MAP_0F, PP_NONE, 0x5f, YMM_ACC + j, YMM_ACC + j,
+            regOperand(YMM_ZERO));
+        emitVex(e, MAP_0F, PP_NONE, 0x5d, YMM_ACC + j, YMM_ACC + j,
+            regOperand(YMM_MAX));
+        emitVex(e, MAP_0F, PP_F3, 0x5b, YMM_ACC + j, 0,
+            regOperand(YMM_ACC + j));
+    }
+    emitVex(e, MAP_0F, PP_66, 0x6b, YMM_ACC, YMM_ACC, regOperand(YMM_ACC + 1));
+    emitVex(e, MAP_0F, PP_66, 0x6b, YMM_ACC + 2, YMM_ACC + 2,
+        regOperand(YMM_ACC + 3));
+    emitVex(e, MAP_0F, PP_66, 0x67, YMM_ACC, YMM_ACC, regOperand(YMM_ACC + 2));
+    emitVex(e, MAP_0F38, PP_66, 0x36, YMM_ACC, YMM_ORDER, regOperand(YMM_ACC));
+    emitVex(e, MAP_0F, PP_F3, 0x7f, YMM_ACC, 0, memOperand(RDI, RAX, 0));
+
+    // Next step
+    emitByte(e, 0x48);      // add rax, 32
+    emitByte(e, 0x83);
+    emitByte(e, 0xc0);
+    emitByte(e, JIT_STEP_BYTES);
+    emitByte(e, 0x48);      // cmp rax, rsi
+    emitByte(e, 0x39);
+    emitByte(e, 0xf0);
+    emitJump(e, 0x0c, loop);
+
+    // Return
+    patchJump(e, end, e->size);
+    emitByte(e, 0xc5);      // vzeroupper
+    emitByte(e, 0xf8);
+    emitByte(e, 0x77);
+    emitByte(e, 0xc3);      // ret
+}
+
+/******************************************************************************
+ * Creation / destruction
+ *****************************************************************************/
+
+/**
+ * Tells whether kernels can be generated: x86-64 Linux with AVX2 and FMA.
+ * @return int 1 if they can, 0 otherwise.
+ */
+int jit_isSupported()
+{
+#ifdef JIT_X86_64
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Generates the row kernel of a filter. The zero weights are skipped and the
+ *  taps of the same weight share a multiplication, so the results match the
+ *  vector kernels within one intensity level.
+ * @param const float *weights The flipped weights (k x k, row-major, see
+ *  conv_filter_t).
+ * @param int k The filter size.
+ * @param int pixelSize The pixel size in bytes.
+ * @return struct jit_kernel_t* The kernel or NULL (not supported, or out of
+ *  memory).
+ */
+struct jit_kernel_t* jit_makeRowKernel(const float *weights, int k,
+    int pixelSize)
+{
+#ifdef JIT_X86_64
+    int i, g, taps, amount, poolSize, poolPosition;
+    int *tapIdxs, *groups, *signs;
+    int order[8] = {0, 4, 1, 5, 2, 6, 3, 7};
+    float *groupWeights, *pool;
+    long pageSize;
+    unsigned long address;
+    Emitter e;
+    struct jit_kernel_t *retVal;
+    void *buffer;
+
+    // Check params
+    if (!jit_isSupported() || k < 1 || pixelSize < 1)
+        return NULL;
+
+    // Non-zero taps, grouped by weight (up to the sign)
+    tapIdxs = malloc(sizeof(int) * k * k);
+    groups = malloc(sizeof(int) * k * k);
+    signs = malloc(sizeof(int) * k * k);
+    groupWeights = malloc(sizeof(float) * k * k);
+    retVal = malloc(sizeof(struct jit_kernel_t));
+    e.capacity = CODE_BASE_SIZE + k * k * CODE_TAP_SIZE;
+    e.code = malloc(e.capacity);
+    e.size = 0;
+    if (tapIdxs == NULL || groups == NULL || signs == NULL
+        || groupWeights == NULL || retVal == NULL || e.code == NULL) {
+        free(tapIdxs);
+        free(groups);
+        free(signs);
+        free(groupWeights);
+        free(retVal);
+        free(e.code);
+        return NULL;
+    }
+    taps = 0;
+    amount = 0;
+    for (i = 0; i < k * k; i++) {
+        if (weights[i] == 0)
+            continue;
+        for (g = 0; g < amount && weights[i] != groupWeights[g]
+            && weights[i] != -groupWeights[g]; g++);
+        if (g == amount)
+            groupWeights[amount++] = weights[i];
+        tapIdxs[taps] = i;
+        groups[taps] = g;
+        signs[taps++] = (weights[i] == groupWeights[g]) ? 1 : -1;
+    }
+
+    // Code, after the constants
+    emitKernel(&e, tapIdxs, groups, signs, taps, amount, k, pixelSize,
+        &poolPosition);
+    poolSize = POOL_WEIGHTS + POOL_WEIGHT_SIZE * amount;
+    poolSize = (poolSize + 63) / 64 * 64;
+    pageSize = sysconf(_SC_PAGESIZE);
+    retVal->size = (poolSize + e.size + pageSize - 1) / pageSize * pageSize;
+    buffer = (e.size <= e.capacity) ? mmap(NULL, retVal->size,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+        : MAP_FAILED;
+    if (buffer == MAP_FAILED) {
+        free(tapIdxs);
+        free(groups);
+        free(signs);
+        free(groupWeights);
+        free(retVal);
+        free(e.code);
+        return NULL;
+    }
+    retVal->buffer = buffer;
+    memcpy(&(retVal->buffer[POOL_ORDER]), order, sizeof(order));
+    *((float *) &(retVal->buffer[POOL_MAX])) = 255;
+    pool = (float *) &(retVal->buffer[POOL_WEIGHTS]);
+    for (i = 0; i < amount * POOL_WEIGHT_SIZE / (int) sizeof(float); i++)
+        pool[i] = groupWeights[i * sizeof(float) / POOL_WEIGHT_SIZE];
+    address = (unsigned long) retVal->buffer;
+    for (i = 0; i < 8; i++)
+        e.code[poolPosition + i] = (address >> (8 * i)) & 0xff;
+    memcpy(&(retVal->buffer[poolSize]), e.code, e.size);
+
+    // Executable from now on, and no longer writable
+    if (mprotect(retVal->buffer, retVal->size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(retVal->buffer, retVal->size);
+        free(retVal);
+        retVal = NULL;
+    } else {
+        retVal->run = (JitRowKernel) (void *) &(retVal->buffer[poolSize]);
+        retVal->pixelSize = pixelSize;
+        retVal->taps = taps;
+        retVal->groups = amount;
+    }
+
+    // Clean up
+    free(tapIdxs);
+    free(groups);
+    free(signs);
+    free(groupWeights);
+    free(e.code);
+
+    return retVal;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Destroys a generated kernel.
+ * @param struct jit_kernel_t *kernel The kernel to destroy.
+ */
+void jit_destroyKernel(struct jit_kernel_t *kernel)
+{
+#ifdef JIT_X86_64
+    munmap(kernel->buffer, kernel->size);
+#endif
+    free(kernel);
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ * NAME:
+ *  jit.h
+ * DESCRIPTION:
+ *  Row kernels generated at runtime for a given filter header file.
+ *****************************************************************************/
+#ifndef _JIT
+#define _JIT
+
+#include <stddef.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Output bytes per step of the generated kernels (four vectors of 8 floats)
+#define JIT_STEP_BYTES 32
+
+/******************************************************************************
+ * Data structures
+ *****************************************************************************/
+
+/**
+ * Generated row kernel. Same as SimdRowKernel (see simd.h), the weights,
+ *  filter size and pixel size being part of the code. Only the output bytes
+ *  below n rounded down to JIT_STEP_BYTES are computed.
+ * @param unsigned char *out The output bytes.
+ * @param int n The amount of output bytes.
+ * @param const unsigned char **rows The input rows, pointing to the byte
+ *  under the leftmost tap of the first output byte.
+ */
+typedef void (*JitRowKernel)(unsigned char *out, int n,
+    const unsigned char **rows);
+
+struct jit_kernel_t {       // Machine code of a row kernel
+    // Executable mapping: the constants, then the code
+    unsigned char *buffer;
+    size_t size;
+    // Entry point, and the pixel size it was generated for
+    JitRowKernel run;
+    int pixelSize;
+    // Non-zero taps, and groups of them sharing a weight (up to the sign):
+    //  the bytes of a group are added up as integers and multiplied once
+    int taps;
+    int groups;
+};
+
+/******************************************************************************
+ * Creation / destruction
+ *****************************************************************************/
+
+/**
+ * Tells whether kernels can be generated: x86-64 Linux with AVX2 and FMA.
+ * @return int 1 if they can, 0 otherwise.
+ */
+int jit_isSupported();
+
+/**
+ * Generates the row kernel of a filter. The zero weights are skipped and the
+ *  taps of the same weight share a multiplication, so the results match the
+ *  vector kernels within one intensity level.
+ * @param const float *weights The flipped weights (k x k, row-major, see
+ *  conv_filter_t).
+ * @param int k The filter size.
+ * @param int pixelSize The pixel size in bytes.
+ * @return struct jit_kernel_t* The kernel or NULL (not supported, or out of
+ *  memory).
+ */
+struct jit_kernel_t* jit_makeRowKernel(const float *weights, int k,
+    int pixelSize);
+
+/**
+ * Destroys a generated kernel.
+ * @param struct jit_kernel_t *kernel The kernel to destroy.
+ */
+void jit_destroyKernel(struct jit_kernel_t *kernel);
+
+#endif
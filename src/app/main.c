@@ -5,6 +5,8 @@
  *  Image convolution main function.
  *****************************************************************************/
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <math.h>
 #include <util/log.h>
 #include <types/image.h>
@@ -12,6 +14,16 @@
 #include "cmd.h"
 #include "comm.h"
 #include "convolution.h"
+#include "simd.h"
+#include "jit.h"
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Chunks of the tiles run by the root process, which answers the requests of
+//  the workers in between
+#define ROOT_TILE_CHUNKS 4
 
 /******************************************************************************
  * Data
@@ -21,12 +33,56 @@
 static CmdRequest *req;
 // Input image
 static struct image_t *inImg;
-// Output image
-static struct image_t *outImg;
-// Filter (matrix)
-static struct matrix_t *filter;
-// Normalized filter (matrix)
-static struct matrix_t *normFilter;
+// Output images (one per filter)
+static struct image_t *outImgs[CONV_MAX_BANK_FILTERS];
+// Filters (matrices) of the bank
+static struct matrix_t **filters;
+static int filtersAmt;
+// Normalized filters (matrices)
+static struct matrix_t *normFilters[CONV_MAX_BANK_FILTERS];
+// Analysed filters
+static struct conv_filter_t *convFilters[CONV_MAX_BANK_FILTERS];
+// Halo exchanges of a resident strip, one per image (the input and output
+//  images of the iterations swap), and their depth
+static struct comm_exchange_t *exchanges[2];
+static struct image_t *exchangeImgs[2];
+static int exchangeDepths[2];
+// Rows of the strip of the root process (0 if it has none, as for blocks),
+//  and of the strips of the workers
+static int rootRows;
+static int stripRows;
+// Chunks of the strips streamed through the processes (a single one for
+//  whole strips), the rows done at a chunk lagging the filter radius behind
+//  the ones received
+static int chunksAmt;
+static int chunkLag;
+// Rows and amount of the tiles handed out on request
+static int tileRows;
+static int tilesAmt;
+
+/******************************************************************************
+ * Data structures
+ *****************************************************************************/
+
+struct part_t {             // Part of the image run by a process
+    // Rows and columns of the part in the images of the worker (the whole
+    //  image for strips, the block and its halos for blocks)
+    int rowIdx;
+    int colIdx;
+    int rows;
+    int cols;
+    // Neighbouring strips (COMM_NO_RANK if none), or whether the part is a
+    //  block of the grid of workers (with halos on the sides with a
+    //  neighbour)
+    int upRank;
+    int downRank;
+    int isBlock;
+    // Row of the whole image at the first row of the image of the process,
+    //  and depth of the halos it holds on the sides with a neighbour (-1 for
+    //  the whole image, as for the root process)
+    int originRowIdx;
+    int halo;
+};
 
 /******************************************************************************
  * Helpers
@@ -48,35 +104,24 @@ static int parseCmdRequest(int argc, char **argv)
     return 1;
 }
 
-static void clean()
-{
-    log_log(LOG_DEBUG, "[CLEANING] Cleaning the memory...");
-    if (filter != NULL) mat_destroy(filter);
-    if (normFilter != NULL) mat_destroy(normFilter);
-    if (inImg != NULL) img_destroy(inImg);
-    if (outImg != NULL) img_destroy(outImg);
-    if (req != NULL) cmd_destroyRequest(req);
-}
-
-/******************************************************************************
- * Root process code
- *****************************************************************************/
-
-static int root_validateRequest()
+static int validateRequest()
 {
     // Input files
     if (req->inputFile == NULL) {
         log_log(LOG_ERROR, "[CMD] Please provide an input image file path!");
         return 0;
     }
-    if (req->matrixFile == NULL) {
-        log_log(LOG_ERROR, "[CMD] Please provide a filter matrix file path!");
+    if (req->matrixFilesAmt == 0 && req->sigma <= 0) {
+        log_log(LOG_ERROR, "[CMD] Please provide a filter matrix file path or "
+            "a Gaussian sigma!");
         return 0;
     }
 
-    // Output file
-    if (req->outputFile == NULL) {
-        log_log(LOG_ERROR, "[CMD] Please provide an output image file path!");
+    // Gaussian by box passes
+    if (req->sigma > 0 && (req->boxPasses < 1
+        || req->boxPasses > CONV_MAX_BOX_PASSES)) {
+        log_log(LOG_ERROR, "[CMD] Box passes must be in [1, %d]!",
+            CONV_MAX_BOX_PASSES);
         return 0;
     }
 
@@ -90,14 +135,995 @@ static int root_validateRequest()
         return 0;
     }
 
+    // Fixed-point mode
+    if (req->fixedBits != 0 && (req->fixedBits < CONV_FIXED_MIN_BITS
+        || req->fixedBits > CONV_FIXED_MAX_BITS)) {
+        log_log(LOG_ERROR, "[CMD] Fixed-point bits must be in [%d, %d]!",
+            CONV_FIXED_MIN_BITS, CONV_FIXED_MAX_BITS);
+        return 0;
+    }
+
+    // Column blocks
+    if (req->tileWidth < 0) {
+        log_log(LOG_ERROR, "[CMD] The column block width must be positive!");
+        return 0;
+    }
+
+    // Threads
+    if (req->threads < 1) {
+        log_log(LOG_ERROR, "[CMD] Please provide at least one thread!");
+        return 0;
+    }
+
+    // Iterations
+    if (req->iterations < 1) {
+        log_log(LOG_ERROR, "[CMD] Please provide at least one iteration!");
+        return 0;
+    }
+    if (req->tolerance < 0) {
+        log_log(LOG_ERROR, "[CMD] The tolerance must not be negative!");
+        return 0;
+    }
+
+    // Fixed-point weights only apply to 8-bit samples
+    if (req->fixedBits > 0 && req->workSampleType != IMG_SAMPLE_U8) {
+        log_log(LOG_ERROR, "[CMD] The fixed-point mode needs 8-bit samples!");
+        return 0;
+    }
+
+    // Resident parts
+    if (req->resident && req->split == COMM_SPLIT_BLOCKS) {
+        log_log(LOG_ERROR, "[CMD] The resident mode splits the image into "
+            "strips!");
+        return 0;
+    }
+    if (req->split == COMM_SPLIT_TILES && (req->iterations > 1
+        || req->resident || req->mpiIo)) {
+        log_log(LOG_ERROR, "[CMD] The tiles run a single pass, the root "
+            "process holding the image!");
+        return 0;
+    }
+    if (req->chunkRows > 0 && (req->iterations > 1 || req->resident
+        || req->mpiIo || req->split == COMM_SPLIT_BLOCKS
+        || req->split == COMM_SPLIT_TILES)) {
+        log_log(LOG_ERROR, "[CMD] The chunks stream a single pass of the "
+            "strips, the root process holding the image!");
+        return 0;
+    }
+    if (req->chunkRows < 0 || req->tileRows < 0) {
+        log_log(LOG_ERROR, "[CMD] The rows of the chunks and tiles must be "
+            "positive!");
+        return 0;
+    }
+    if (req->mpiIo && req->outputFilesAmt == 0) {
+        log_log(LOG_ERROR, "[CMD] The parallel I/O needs output file "
+            "paths!");
+        return 0;
+    }
+    if (req->rootShare < 0) {
+        log_log(LOG_ERROR, "[CMD] The share of the root process must not be "
+            "negative!");
+        return 0;
+    }
+
     return 1;
 }
 
-static int root_parseFiles()
+static void getHaloPart(int offsetRowIdx, int limit, int depth,
+    int *haloOffsetRowIdx, int *haloLimit)
+{
+    int lastRowIdx;
+
+    // The part plus `depth` rows above and below (inside the image)
+    *haloOffsetRowIdx = (offsetRowIdx >= depth) ? offsetRowIdx - depth : 0;
+    lastRowIdx = offsetRowIdx + limit + depth;
+    if (lastRowIdx > req->imgHeight)
+        lastRowIdx = req->imgHeight;
+    *haloLimit = lastRowIdx - *haloOffsetRowIdx;
+}
+
+static int getPeriodRows(int period, int firstRowIdx, int lastRowIdx,
+    int *rowIdx)
+{
+    int start, end;
+
+    // The rows from firstRowIdx to lastRowIdx (exclusive) that fall in a
+    //  copy of the wrapped image (0 being the image, -1 the one above, 1 the
+    //  one below...), from row rowIdx of the image
+    start = period * req->imgHeight;
+    end = start + req->imgHeight;
+    if (firstRowIdx > start)
+        start = firstRowIdx;
+    if (lastRowIdx < end)
+        end = lastRowIdx;
+    *rowIdx = start - period * req->imgHeight;
+
+    return (end > start) ? end - start : 0;
+}
+
+static void getGrid(int workers, int filterOffset, int *dims)
+{
+    int rows, cols, swap;
+    double halo, minHalo;
+
+    // Strips: a single column of workers (the resident ones, the streamed
+    //  ones and the ones reading the files too)
+    dims[0] = workers;
+    dims[1] = 1;
+    if (req->split == COMM_SPLIT_STRIPS || req->resident || req->mpiIo
+        || req->chunkRows > 0 || workers <= 1)
+        return;
+
+    // Blocks: a balanced grid, with more blocks along the longer side
+    if (req->split == COMM_SPLIT_BLOCKS) {
+        comm_getGridDims(workers, dims);
+        if (req->imgWidth > req->imgHeight) {
+            swap = dims[0];
+            dims[0] = dims[1];
+            dims[1] = swap;
+        }
+        return;
+    }
+
+    // Automatic: the grid of the smallest halos (half the perimeter of a
+    //  part, along the split dimensions) with parts as thick as the filter
+    //  radius. Strips on a tie, they need fewer messages.
+    minHalo = req->imgWidth;
+    for (cols = 2; cols <= workers; cols++) {
+        rows = workers / cols;
+        if (rows * cols != workers || req->imgHeight / rows < filterOffset
+            || req->imgWidth / cols < filterOffset)
+            continue;
+        halo = req->imgHeight / (double) rows;
+        if (rows > 1)
+            halo += req->imgWidth / (double) cols;
+        if (halo < minHalo) {
+            minHalo = halo;
+            dims[0] = rows;
+            dims[1] = cols;
+        }
+    }
+}
+
+static void getBlock(const int *dims, const int *coords, int *rect)
+{
+    // Balanced blocks: their sizes differ by a pixel at most
+    rect[0] = (int) ((long long) coords[0] * req->imgHeight / dims[0]);
+    rect[1] = (int) ((long long) coords[1] * req->imgWidth / dims[1]);
+    rect[2] = (int) ((long long) (coords[0] + 1) * req->imgHeight / dims[0])
+        - rect[0];
+    rect[3] = (int) ((long long) (coords[1] + 1) * req->imgWidth / dims[1])
+        - rect[1];
+}
+
+static void splitStrips(const int *dims, int filterOffset)
+{
+    // Blocks: the root process only sends and receives them
+    rootRows = 0;
+    stripRows = 0;
+    chunksAmt = 1;
+    chunkLag = filterOffset;
+    if (dims[1] > 1)
+        return;
+
+    // No workers: the root process runs the whole image
+    if (dims[0] == 0) {
+        rootRows = req->imgHeight;
+        return;
+    }
+
+    // Strips of the same height but the last one, and a share of that height
+    //  for the root process at the top of the image, unless thinner than the
+    //  filter radius (the halos of its neighbours come from it)
+    if (req->rootShare > 0) {
+        stripRows = ceil(req->imgHeight / (dims[0] + req->rootShare));
+        rootRows = req->imgHeight - stripRows * dims[0];
+    }
+    if (rootRows < 1 || rootRows < filterOffset) {
+        rootRows = 0;
+        stripRows = ceil(req->imgHeight / (double) dims[0]);
+    }
+
+    // Chunks of the strips of the workers, the last one being thinner
+    if (req->chunkRows > 0 && stripRows > req->chunkRows)
+        chunksAmt = (stripRows + req->chunkRows - 1) / req->chunkRows;
+}
+
+static int splitTiles()
+{
+    int processes, rootRuns;
+
+    // Tiles of the requested height, or a few per process running them (the
+    //  root process too, unless it has no share and there are workers)
+    processes = comm_getSize();
+    rootRuns = req->rootShare > 0 || processes == 1;
+    if (!rootRuns)
+        processes--;
+    tileRows = req->tileRows;
+    if (tileRows == 0)
+        tileRows = ceil(req->imgHeight
+            / (double) (processes * CMD_DEFAULT_TILES_PER_PROCESS));
+    if (tileRows < 1)
+        tileRows = 1;
+    tilesAmt = (req->imgHeight + tileRows - 1) / tileRows;
+
+    return rootRuns;
+}
+
+static void getStripRows(int rank, int *offsetRowIdx, int *rows)
+{
+    // The strip of the root process, then the ones of the workers in order
+    //  (the ones beyond the image are empty)
+    *offsetRowIdx = (rank == 0) ? 0 : rootRows + stripRows * (rank - 1);
+    *rows = (rank == 0) ? rootRows : stripRows;
+    if (*offsetRowIdx + *rows > req->imgHeight)
+        *rows = req->imgHeight - *offsetRowIdx;
+    if (*rows < 0)
+        *rows = 0;
+}
+
+static void getChunkRows(int chunk, int rows, int *firstRowIdx, int *limit)
+{
+    int lastRowIdx, readyRows;
+
+    // The rows of a strip done at a chunk, the ones needing the halo below
+    //  waiting for the last one
+    readyRows = (rows > chunkLag) ? rows - chunkLag : 0;
+    *firstRowIdx = chunk * req->chunkRows - chunkLag;
+    lastRowIdx = *firstRowIdx + req->chunkRows;
+    if (chunk == 0 || *firstRowIdx < 0)
+        *firstRowIdx = 0;
+    *firstRowIdx = (*firstRowIdx < readyRows) ? *firstRowIdx : readyRows;
+    lastRowIdx = (lastRowIdx < readyRows) ? lastRowIdx : readyRows;
+    if (lastRowIdx < *firstRowIdx)
+        lastRowIdx = *firstRowIdx;
+    if (chunk == chunksAmt - 1)
+        lastRowIdx = rows;
+    *limit = lastRowIdx - *firstRowIdx;
+}
+
+static void getStripParts(int depth, int *offsetRowIdxs, int *limits)
+{
+    int i, offsetRowIdx, rows;
+
+    // The strips of the workers with their halos (the root process has the
+    //  whole image)
+    offsetRowIdxs[0] = 0;
+    limits[0] = 0;
+    for (i = 1; i < comm_getSize(); i++) {
+        getStripRows(i, &offsetRowIdx, &rows);
+        offsetRowIdxs[i] = 0;
+        limits[i] = 0;
+        if (rows > 0)
+            getHaloPart(offsetRowIdx, rows, depth, &offsetRowIdxs[i],
+                &limits[i]);
+    }
+}
+
+static void scatterStrips(int depth, int originRowIdx, int chunk)
+{
+    int i, rank, size, offsetRowIdx, rows, firstRowIdx, lastRowIdx;
+    int period, periods, *offsetRowIdxs, *limits;
+
+    // The strips and their halos, overlapping, in a single scatter (waited
+    //  for with comm_waitImgParts). The rows of the image of a worker start
+    //  at originRowIdx. A chunk has the next rows of the strips, with the
+    //  halo above for the first one and the one below for the last one.
+    rank = comm_getRank();
+    size = comm_getSize();
+    offsetRowIdxs = malloc(sizeof(int) * 2 * size);
+    limits = offsetRowIdxs + size;
+    getStripParts(depth, offsetRowIdxs, limits);
+    for (i = 1; i < size && chunksAmt > 1; i++) {
+        getStripRows(i, &offsetRowIdx, &rows);
+        lastRowIdx = offsetRowIdxs[i] + limits[i];
+        firstRowIdx = (chunk == 0)
+            ? offsetRowIdxs[i] : offsetRowIdx + chunk * req->chunkRows;
+        if (chunk < chunksAmt - 1
+            && offsetRowIdx + (chunk + 1) * req->chunkRows < lastRowIdx)
+            lastRowIdx = offsetRowIdx + (chunk + 1) * req->chunkRows;
+        offsetRowIdxs[i] = firstRowIdx;
+        limits[i] = (lastRowIdx > firstRowIdx) ? lastRowIdx - firstRowIdx : 0;
+    }
+    comm_scatterImgParts(inImg, offsetRowIdxs, limits,
+        offsetRowIdxs[rank] - originRowIdx);
+
+    // Wrapped border: the strips near the edges also need the rows of the
+    //  opposite one (but for a single strip, the whole image), with the
+    //  first and last chunks, a copy of the image at a time
+    periods = (req->borderMode == IMG_BORDER_WRAP)
+        ? (depth + req->imgHeight - 1) / req->imgHeight : 0;
+    for (period = -periods; period <= periods; period++) {
+        if (period == 0 || (period < 0 && chunk > 0)
+            || (period > 0 && chunk < chunksAmt - 1))
+            continue;
+        for (i = 0; i < size; i++) {
+            getStripRows(i, &offsetRowIdx, &rows);
+            limits[i] = getPeriodRows(period, offsetRowIdx - depth,
+                offsetRowIdx + rows + depth, &offsetRowIdxs[i]);
+            if (i == 0 || rows == 0 || rows == req->imgHeight)
+                limits[i] = 0;
+        }
+        comm_scatterImgParts(inImg, offsetRowIdxs, limits,
+            offsetRowIdxs[rank] + period * req->imgHeight - originRowIdx);
+    }
+    free(offsetRowIdxs);
+}
+
+static void gatherStrips(struct image_t *img, int rowIdx, int chunk)
+{
+    int i, size, firstRowIdx, *offsetRowIdxs, *limits;
+
+    // The strips only (the rows of a chunk of them), in a single gather,
+    //  from row rowIdx of the image of every worker
+    size = comm_getSize();
+    offsetRowIdxs = malloc(sizeof(int) * 2 * size);
+    limits = offsetRowIdxs + size;
+    getStripParts(0, offsetRowIdxs, limits);
+    for (i = 1; i < size && chunksAmt > 1; i++) {
+        getChunkRows(chunk, limits[i], &firstRowIdx, &limits[i]);
+        offsetRowIdxs[i] += firstRowIdx;
+    }
+    comm_gatherImgParts(img, offsetRowIdxs, limits, rowIdx);
+    free(offsetRowIdxs);
+}
+
+static int getThinnestPart(const int *dims)
+{
+    int strips, retVal;
+
+    // Strips (see splitStrips): the last one, or the one of the root process
+    //  (none without workers, as the whole image has no halos)
+    if (dims[1] == 1 && stripRows == 0)
+        return INT_MAX;
+    if (dims[1] == 1) {
+        strips = (req->imgHeight - rootRows + stripRows - 1) / stripRows;
+        retVal = req->imgHeight - rootRows - stripRows * (strips - 1);
+        return (rootRows > 0 && rootRows < retVal) ? rootRows : retVal;
+    }
+
+    // Blocks: along the split dimensions only
+    retVal = req->imgWidth / dims[1];
+    if (dims[0] > 1 && req->imgHeight / dims[0] < retVal)
+        retVal = req->imgHeight / dims[0];
+
+    return retVal;
+}
+
+static int getMaxHaloIterations(int filterOffset, int thinnest)
+{
+    int retVal;
+
+    // Single pass
+    if (req->iterations <= 1)
+        return 1;
+
+    // The halo of a round (filterOffset rows per iteration) must come from
+    //  the neighbouring parts only. 0 if even one iteration cannot.
+    retVal = (filterOffset > 0) ? thinnest / filterOffset : req->iterations;
+    if (req->haloIterations > 0 && req->haloIterations < retVal)
+        retVal = req->haloIterations;
+
+    return (retVal < req->iterations) ? retVal : req->iterations;
+}
+
+static struct image_t* convertImage(struct image_t *img, ImgLayout layout,
+    ImgSampleType sampleType)
+{
+    struct image_t *retVal, *converted;
+
+    // Copy with other samples, then another layout if needed
+    retVal = img_convertType(img, sampleType);
+    if (retVal == NULL || retVal->layout == layout)
+        return retVal;
+    converted = img_convertLayout(retVal, layout);
+    img_destroy(retVal);
+
+    return converted;
+}
+
+static int getFilterOffset()
+{
+    int i, retVal;
+
+    // The halo of the widest filter
+    retVal = 0;
+    for (i = 0; i < filtersAmt; i++)
+        if ((filters[i]->height - 1) / 2 > retVal)
+            retVal = (filters[i]->height - 1) / 2;
+
+    return retVal;
+}
+
+static void clean()
+{
+    int i;
+
+    log_log(LOG_DEBUG, "[CLEANING] Cleaning the memory...");
+    for (i = 0; i < 2; i++)
+        if (exchanges[i] != NULL) comm_destroyImgExchange(exchanges[i]);
+    for (i = 0; i < CONV_MAX_BANK_FILTERS; i++) {
+        if (convFilters[i] != NULL) conv_destroyFilter(convFilters[i]);
+        if (normFilters[i] != NULL) mat_destroy(normFilters[i]);
+        if (outImgs[i] != NULL) img_destroy(outImgs[i]);
+    }
+    for (i = 0; i < filtersAmt; i++)
+        mat_destroy(filters[i]);
+    free(filters);
+    if (inImg != NULL) img_destroy(inImg);
+    if (req != NULL) cmd_destroyRequest(req);
+}
+
+/******************************************************************************
+ * Part code (the workers, and the root process when it has a strip)
+ *****************************************************************************/
+
+static void prepareFilter(int i)
+{
+    int compiled;
+
+    // Normalize and analyse filter
+    normFilters[i] = conv_normalizeFilter(filters[i]);
+    convFilters[i] = conv_makeFilter(normFilters[i]);
+    convFilters[i]->border = req->borderMode;
+    convFilters[i]->engine = req->engine;
+    convFilters[i]->tileWidth = req->tileWidth;
+    convFilters[i]->threads = req->threads;
+    convFilters[i]->schedule = req->schedule;
+    if (req->sigma > 0)
+        conv_useBoxPasses(convFilters[i], req->sigma, req->boxPasses);
+    if (req->fixedBits > 0)
+        conv_quantizeFilter(convFilters[i], req->fixedBits);
+    else if (convFilters[i]->boxPasses > 0)
+        log_log(LOG_DEBUG, "[FILTER] Filter %d is made of %d box pass(es).",
+            i, convFilters[i]->boxPasses);
+    else if (convFilters[i]->separable)
+        log_log(LOG_DEBUG, "[FILTER] Filter %d is separable, using two "
+            "passes.", i);
+
+    // Generated kernel (the quantised filters keep the static ones, and the
+    //  wider samples the sparse engine)
+    if (req->jit && req->fixedBits == 0
+        && req->workSampleType == IMG_SAMPLE_U8) {
+        compiled = conv_compileFilter(convFilters[i],
+            (req->imgLayout == IMG_LAYOUT_PLANAR) ? 1 : req->imgPixelSize);
+        if (compiled > 0)
+            log_log(LOG_DEBUG, "[JIT] Generated the kernel of filter %d: %d "
+                "tap(s) in %d group(s).", i, convFilters[i]->jit->taps,
+                convFilters[i]->jit->groups);
+        else if (compiled == 0)
+            log_log(LOG_DEBUG, "[JIT] The static kernels are cheaper for "
+                "filter %d.", i);
+        else
+            log_log(LOG_WARNING, "[JIT] Failed to generate the kernel of "
+                "filter %d, using the static kernels.", i);
+    }
+
+    // Threads (MPI calls stay on the main thread)
+    if (convFilters[i]->threads > 1 && !comm_isThreaded())
+        convFilters[i]->threads = 1;
+}
+
+static void runRows(struct part_t *part, int firstRowIdx, int rows,
+    struct conv_delta_t *delta)
+{
+    int height;
+
+    // Rows outside the image wrap around, or are dropped (the ones outside
+    //  a block and its halos are always dropped)
+    height = inImg->height;
+    if (req->borderMode == IMG_BORDER_WRAP && !part->isBlock) {
+        if (rows > height)
+            rows = height;
+        firstRowIdx = (firstRowIdx % height + height) % height;
+        if (firstRowIdx + rows > height) {
+            conv_runFilterPartiallyDelta(inImg, 0,
+                firstRowIdx + rows - height, outImgs[0], convFilters[0],
+                delta);
+            rows = height - firstRowIdx;
+        }
+    } else if (firstRowIdx < 0) {
+        rows += firstRowIdx;
+        firstRowIdx = 0;
+    }
+    conv_runFilterPartiallyDelta(inImg, firstRowIdx, rows, outImgs[0],
+        convFilters[0], delta);
+}
+
+static void exchangeHalos(struct part_t *part, int depth)
+{
+    int height;
+
+    // Blocks: with the four neighbours of the grid
+    if (part->isBlock) {
+        comm_exchangeImgHalos(inImg, part->rowIdx, part->colIdx, part->rows,
+            part->cols, depth);
+        return;
+    }
+
+    // Strips: the first rows go up and the last ones down, while the halos
+    //  come from the other way round
+    height = inImg->height;
+    comm_exchangeImgParts(inImg, depth,
+        part->upRank, part->rowIdx,
+        (part->rowIdx - depth + height) % height,
+        part->downRank, part->rowIdx + part->rows - depth,
+        (part->rowIdx + part->rows) % height);
+}
+
+static void resizeHalos(struct part_t *part, int depth)
+{
+    int i, top, left, bottom, right;
+    struct image_t *img;
+
+    // Same sides as before (the ones with a neighbour), the halos being
+    //  filled by the next exchange
+    if (part->isBlock) {
+        top = (part->rowIdx > 0) ? depth : 0;
+        left = (part->colIdx > 0) ? depth : 0;
+        bottom = (part->rowIdx + part->rows < inImg->height) ? depth : 0;
+        right = (part->colIdx + part->cols < inImg->width) ? depth : 0;
+    } else {
+        top = (part->upRank != COMM_NO_RANK) ? depth : 0;
+        bottom = (part->downRank != COMM_NO_RANK) ? depth : 0;
+        left = right = 0;
+    }
+    img = img_makeWithType(part->cols + left + right,
+        part->rows + top + bottom, inImg->pixelSize, inImg->layout,
+        inImg->sampleType);
+    img_copyBlock(inImg, part->rowIdx, part->colIdx, img, top, left,
+        part->rows, part->cols);
+    img_destroy(inImg);
+    inImg = img;
+    if (outImgs[0] != NULL) {
+        img_destroy(outImgs[0]);
+        outImgs[0] = img_makeWithType(inImg->width, inImg->height,
+            inImg->pixelSize, inImg->layout, inImg->sampleType);
+    }
+    part->originRowIdx += part->rowIdx - top;
+    part->rowIdx = top;
+    part->colIdx = left;
+    part->halo = depth;
+
+    // The exchanges of the former images
+    for (i = 0; i < 2; i++) {
+        if (exchanges[i] != NULL)
+            comm_destroyImgExchange(exchanges[i]);
+        exchanges[i] = NULL;
+        exchangeImgs[i] = NULL;
+    }
+}
+
+static struct comm_exchange_t* startHalos(struct part_t *part, int depth)
+{
+    int i, height;
+
+    // Room for the halos
+    if (part->halo >= 0 && part->halo < depth)
+        resizeHalos(part, depth);
+
+    // The exchange of the input image, made again when the depth changes
+    i = (exchangeImgs[0] == inImg || exchangeImgs[0] == NULL) ? 0 : 1;
+    if (exchanges[i] != NULL && exchangeDepths[i] != depth) {
+        comm_destroyImgExchange(exchanges[i]);
+        exchanges[i] = NULL;
+    }
+    if (exchanges[i] == NULL) {
+        height = inImg->height;
+        exchanges[i] = comm_makeImgExchange(inImg, depth,
+            part->upRank, part->rowIdx,
+            (part->rowIdx - depth + height) % height,
+            part->downRank, part->rowIdx + part->rows - depth,
+            (part->rowIdx + part->rows) % height);
+        exchangeImgs[i] = inImg;
+        exchangeDepths[i] = depth;
+    }
+
+    // Out of memory: nothing in flight
+    if (exchanges[i] == NULL) {
+        exchangeHalos(part, depth);
+        return NULL;
+    }
+    comm_startImgExchange(exchanges[i]);
+
+    return exchanges[i];
+}
+
+static int chooseHaloIterations(struct part_t *part, int filterOffset,
+    int maxIterations, double pixelTime)
+{
+    int i, k, retVal;
+    double sTime, latency, byteTime, edge, edgeBytes, cost, minCost;
+
+    // No halos, or nothing to measure (idle strip)
+    if (filterOffset == 0)
+        return comm_reduceMin(maxIterations);
+    if (part->rows <= 0)
+        return comm_reduceMin(INT_MAX);
+
+    // Latency (empty exchanges) and bandwidth (exchanges of the halo of a
+    //  single iteration, which is valid data)
+    sTime = comm_wTime();
+    for (i = 0; i < 8; i++)
+        exchangeHalos(part, 0);
+    latency = (comm_wTime() - sTime) / 8;
+    edge = part->isBlock ? part->rows + part->cols : inImg->width;
+    edgeBytes = edge * inImg->pixelSize
+        * img_getSampleSize(inImg->sampleType);
+    sTime = comm_wTime();
+    for (i = 0; i < 2; i++)
+        exchangeHalos(part, filterOffset);
+    byteTime = ((comm_wTime() - sTime) / 2 - latency)
+        / (filterOffset * edgeBytes);
+    if (byteTime < 0)
+        byteTime = 0;
+
+    // Cost per iteration of a round of k iterations: an exchange of k halos
+    //  every k iterations, against the redundant pixels (filterOffset *
+    //  (k - 1) along the edge of the part on average)
+    retVal = 1;
+    minCost = 0;
+    for (k = 1; k <= maxIterations; k++) {
+        cost = (latency + byteTime * filterOffset * k * edgeBytes) / k
+            + filterOffset * (k - 1) * edge * pixelTime;
+        if (k == 1 || cost < minCost) {
+            minCost = cost;
+            retVal = k;
+        }
+    }
+    log_log(LOG_DEBUG, "[HALO] Latency %lf us, %lf MB/s, %lf us per row: "
+        "%d iteration(s) per exchange.", latency * 1e6,
+        (byteTime > 0) ? 1e-6 / byteTime : 0.0,
+        pixelTime * inImg->width * 1e6, retVal);
+
+    // Every part runs the same rounds
+    return comm_reduceMin(retVal);
+}
+
+static int hasConverged(struct conv_delta_t *delta)
+{
+    // The change of the whole image, in a single reduction (the one of the
+    //  criterion) over the processes with a part
+    if (req->criterion == CONV_CRITERION_L2)
+        delta->sumSquares = (rootRows > 0)
+            ? comm_reduceSum(delta->sumSquares)
+            : comm_reduceWorkersSum(delta->sumSquares);
+    else if (req->criterion == CONV_CRITERION_MAX)
+        delta->maxDiff = (rootRows > 0) ? comm_reduceMax(delta->maxDiff)
+            : comm_reduceWorkersMax(delta->maxDiff);
+    else
+        return 0;
+
+    return conv_hasConverged(delta, inImg->sampleType, req->criterion,
+        req->tolerance);
+}
+
+static void getStrip(int rank, struct part_t *part)
+{
+    int first, last;
+
+    // Neighbouring strips (rank = index, the first one being the one of the
+    //  root process if any), the ones beyond the image staying idle
+    getStripRows(rank, &(part->rowIdx), &(part->rows));
+    first = (rootRows > 0) ? 0 : 1;
+    last = (stripRows > 0)
+        ? (req->imgHeight - rootRows + stripRows - 1) / stripRows : 0;
+    part->colIdx = 0;
+    part->cols = req->imgWidth;
+    part->upRank = (rank > first) ? rank - 1 : last;
+    part->downRank = (rank < last) ? rank + 1 : first;
+    part->isBlock = 0;
+    part->originRowIdx = 0;
+    part->halo = -1;
+    if (req->borderMode != IMG_BORDER_WRAP || first == last) {
+        if (rank == first)
+            part->upRank = COMM_NO_RANK;
+        if (rank >= last)
+            part->downRank = COMM_NO_RANK;
+    }
+    if (part->rows == 0)
+        part->upRank = part->downRank = COMM_NO_RANK;
+}
+
+static void getTile(int tile, struct part_t *part)
+{
+    // A strip whose halos come from the root process, on the sides inside
+    //  the image (all around a wrapped one, but for a single tile)
+    part->rowIdx = tile * tileRows;
+    part->rows = req->imgHeight - part->rowIdx;
+    if (part->rows > tileRows)
+        part->rows = tileRows;
+    part->colIdx = 0;
+    part->cols = req->imgWidth;
+    part->upRank = part->downRank = COMM_NO_RANK;
+    if (part->rowIdx > 0
+        || (req->borderMode == IMG_BORDER_WRAP && tilesAmt > 1))
+        part->upRank = 0;
+    if (part->rowIdx + part->rows < req->imgHeight
+        || (req->borderMode == IMG_BORDER_WRAP && tilesAmt > 1))
+        part->downRank = 0;
+    part->isBlock = 0;
+    part->originRowIdx = 0;
+    part->halo = -1;
+}
+
+static void getHalos(const struct part_t *part, int depth, int *top,
+    int *bottom)
+{
+    // The rows around the strip on the sides with a neighbour, going on
+    //  with the ones of the opposite edge for a wrapped border, as many times
+    //  as needed for the halos deeper than the image (see getPeriodRows)
+    *top = 0;
+    *bottom = 0;
+    if (part->upRank != COMM_NO_RANK)
+        *top = (req->borderMode != IMG_BORDER_WRAP) ? part->rowIdx : depth;
+    if (part->downRank != COMM_NO_RANK)
+        *bottom = (req->borderMode != IMG_BORDER_WRAP)
+            ? req->imgHeight - part->rowIdx - part->rows : depth;
+    *top = (*top < depth) ? *top : depth;
+    *bottom = (*bottom < depth) ? *bottom : depth;
+}
+
+static void makeStripImage(struct part_t *part, int depth)
+{
+    int top, bottom, height;
+
+    // The strip and its halos (a row for the idle strips)
+    getHalos(part, depth, &top, &bottom);
+    height = top + part->rows + bottom;
+    inImg = img_makeWithType(req->imgWidth, (height > 0) ? height : 1,
+        req->imgPixelSize, req->imgLayout, req->workSampleType);
+    part->originRowIdx = part->rowIdx - top;
+    part->rowIdx = top;
+    part->halo = depth;
+}
+
+static void readStrip(struct part_t *part)
 {
+    int period, periods, rowIdx, rows;
+    struct image_t *img;
+    struct comm_file_t *file;
+
+    // The rows of the image of the strip, the ones above or below the image
+    //  coming from the opposite edge (a copy of the image at a time, the
+    //  same amount of reads on every process)
+    img = img_makeWithType(inImg->width, inImg->height, inImg->pixelSize,
+        IMG_LAYOUT_INTERLEAVED, req->imgSampleType);
+    file = comm_openImgFile(req->inputPath, 0);
+    if (img == NULL || file == NULL) {
+        log_log(LOG_ERROR, "[PARSING] Failed to read %s!", req->inputPath);
+        if (file != NULL) comm_closeImgFile(file);
+        if (img != NULL) img_destroy(img);
+        return;
+    }
+    periods = (req->borderMode == IMG_BORDER_WRAP)
+        ? (part->halo + req->imgHeight - 1) / req->imgHeight : 0;
+    for (period = -periods; period <= periods; period++) {
+        rows = getPeriodRows(period, part->originRowIdx,
+            part->originRowIdx + inImg->height, &rowIdx);
+        if (part->rows == 0)
+            rows = 0;
+        comm_readImgRows(file, img,
+            rowIdx + period * req->imgHeight - part->originRowIdx, rowIdx,
+            rows);
+    }
+    comm_closeImgFile(file);
+
+    // Samples and layout of the iterations
+    img_destroy(inImg);
+    inImg = convertImage(img, req->imgLayout, req->workSampleType);
+    img_destroy(img);
+}
+
+static void writeStrip(struct part_t *part)
+{
+    int i, amount;
+    struct image_t *merged, *img;
+    struct comm_file_t *file;
+
+    // One file per filter, or a single one for all of them, with the
+    //  samples and layout of the files
+    amount = (filtersAmt == 1 || req->outputFilesAmt == filtersAmt)
+        ? filtersAmt : 1;
+    merged = (amount < filtersAmt) ? img_merge(outImgs, filtersAmt) : NULL;
+    for (i = 0; i < amount; i++) {
+        img = NULL;
+        if (amount == filtersAmt || merged != NULL)
+            img = convertImage((merged != NULL) ? merged : outImgs[i],
+                IMG_LAYOUT_INTERLEAVED, req->imgSampleType);
+        if (img == NULL)
+            log_log(LOG_ERROR, "[WRITING] Failed to convert the output!");
+        file = comm_openImgFile(req->outputPaths[i], 1);
+        if (file == NULL) {
+            log_log(LOG_ERROR, "[WRITING] Failed to write %s!",
+                req->outputPaths[i]);
+        } else {
+            comm_writeImgRows(file, (img != NULL) ? img : outImgs[0],
+                part->rowIdx, part->originRowIdx + part->rowIdx,
+                (img != NULL) ? part->rows : 0);
+            comm_closeImgFile(file);
+        }
+        if (img != NULL) img_destroy(img);
+    }
+    if (merged != NULL) img_destroy(merged);
+}
+
+static void runRowsOverlapped(struct part_t *part,
+    struct comm_exchange_t *exchange, int firstRowIdx, int rows,
+    int filterOffset, struct conv_delta_t *delta)
+{
+    int inner;
+
+    // Nothing in flight
+    if (exchange == NULL) {
+        runRows(part, firstRowIdx, rows, delta);
+        return;
+    }
+
+    // The rows away from the halos while they come, then the other ones
+    inner = part->rows - 2 * filterOffset;
+    if (inner <= 0) {
+        comm_waitImgExchange(exchange);
+        runRows(part, firstRowIdx, rows, delta);
+        return;
+    }
+    runRows(part, part->rowIdx + filterOffset, inner, delta);
+    comm_waitImgExchange(exchange);
+    runRows(part, firstRowIdx,
+        part->rowIdx + filterOffset - firstRowIdx, delta);
+    runRows(part, part->rowIdx + part->rows - filterOffset,
+        firstRowIdx + rows - (part->rowIdx + part->rows - filterOffset),
+        delta);
+}
+
+static int iterate(struct part_t *part, int filterOffset, int maxIterations)
+{
+    int i, k, done, converged, tracked, retVal, pixelBytes;
+    double sTime, pixelTime;
+    struct image_t *tmp;
+    struct conv_delta_t delta;
+    struct comm_exchange_t *exchange;
+
+    // Bytes of a pixel in a row (of a single plane for planar images)
+    pixelBytes = img_getSampleSize(inImg->sampleType) * inImg->pixelSize
+        / ((inImg->layout == IMG_LAYOUT_PLANAR) ? inImg->pixelSize : 1);
+
+    // Rounds of k iterations: the halo is k times as deep, and the redundant
+    //  rows computed around the part shrink by filterOffset rows per
+    //  iteration
+    outImgs[0] = img_makeWithType(inImg->width, inImg->height,
+        inImg->pixelSize, inImg->layout, inImg->sampleType);
+    k = (req->haloIterations > 0) ? maxIterations : 1;
+    retVal = k;
+    done = 0;
+    converged = 0;
+    while (done < req->iterations && !converged) {
+        if (k > req->iterations - done)
+            k = req->iterations - done;
+        exchange = NULL;
+        if (req->resident)
+            exchange = startHalos(part, filterOffset * k);
+        else if (done > 0)
+            exchangeHalos(part, filterOffset * k);
+
+        // The last iteration of the round (the rows of the part only)
+        //  tracks the change of its pixels, within the columns of a block
+        //  (its rows are shared with its halos). The first one waits for the
+        //  halos of a resident strip.
+        delta.sumSquares = 0;
+        delta.maxDiff = 0;
+        delta.firstByte = part->isBlock ? part->colIdx * pixelBytes : 0;
+        delta.endByte = part->isBlock
+            ? (part->colIdx + part->cols) * pixelBytes : 0;
+        sTime = comm_wTime();
+        for (i = k - 1; i >= 0 && part->rows > 0; i--) {
+            tracked = i == 0 && req->criterion != CONV_CRITERION_NONE;
+            runRowsOverlapped(part, exchange,
+                part->rowIdx - i * filterOffset,
+                part->rows + 2 * i * filterOffset, filterOffset,
+                tracked ? &delta : NULL);
+            exchange = NULL;
+            tmp = inImg;
+            inImg = outImgs[0];
+            outImgs[0] = tmp;
+        }
+        if (exchange != NULL)
+            comm_waitImgExchange(exchange);
+        pixelTime = (part->rows > 0) ? (comm_wTime() - sTime)
+            / ((double) part->rows * inImg->width) : 0;
+        done += k;
+
+        // Measured costs of the first iteration (the halos of the parts of
+        //  the workers are then made as deep as a round needs)
+        if (done == 1 && req->haloIterations == 0) {
+            k = chooseHaloIterations(part, filterOffset,
+                maxIterations, pixelTime);
+            retVal = k;
+            if (part->halo >= 0 && part->halo != filterOffset * k)
+                resizeHalos(part, filterOffset * k);
+        }
+
+        // Stopping criterion, checked once per round: the rounds of k
+        //  iterations may run up to k - 1 iterations past convergence
+        if (done < req->iterations)
+            converged = hasConverged(&delta);
+    }
+    if (converged && comm_getRank() == 1)
+        log_log(LOG_DEBUG, "[ITERATIONS] Converged after %d iteration(s).",
+            done);
+
+    // The result is the last input
+    tmp = inImg;
+    inImg = outImgs[0];
+    outImgs[0] = tmp;
+
+    return retVal;
+}
+
+static void runBank(struct part_t *part, int filterOffset)
+{
+    int i, inner;
+    struct comm_exchange_t *exchange;
+
+    // Resident strip: the halos come while the rows away from them run
+    exchange = req->resident ? startHalos(part, filterOffset) : NULL;
+
+    // All the filters in a single pass
+    for (i = 0; i < filtersAmt; i++) {
+        log_log(LOG_DEBUG, "[FILTER] Using the %s engine for filter %d.",
+            conv_getEngineName((inImg->sampleType != IMG_SAMPLE_U8)
+                ? CONV_ENGINE_SPARSE : conv_chooseEngine(convFilters[i],
+                    inImg->width, part->rows, inImg->pixelSize)), i);
+        outImgs[i] = img_makeWithType(inImg->width, inImg->height,
+            inImg->pixelSize, inImg->layout, inImg->sampleType);
+    }
+
+    inner = part->rows - 2 * filterOffset;
+    if (exchange != NULL && inner > 0) {
+        conv_runBankPartially(inImg, part->rowIdx + filterOffset, inner,
+            outImgs, convFilters, filtersAmt);
+        comm_waitImgExchange(exchange);
+        conv_runBankPartially(inImg, part->rowIdx, filterOffset, outImgs,
+            convFilters, filtersAmt);
+        conv_runBankPartially(inImg, part->rowIdx + part->rows - filterOffset,
+            filterOffset, outImgs, convFilters, filtersAmt);
+        return;
+    }
+    if (exchange != NULL)
+        comm_waitImgExchange(exchange);
+    conv_runBankPartially(inImg, part->rowIdx, part->rows, outImgs,
+        convFilters, filtersAmt);
+}
+
+static void runChunk(struct part_t *part, int depth, int chunk)
+{
+    int i, firstRowIdx, limit;
+
+    // The rows of the chunk once its rows are in (the ones of the next chunk
+    //  coming meanwhile), then sent back at once
+    comm_waitImgParts();
+    if (chunk < chunksAmt - 1)
+        scatterStrips(depth, part->originRowIdx, chunk + 1);
+    getChunkRows(chunk, part->rows, &firstRowIdx, &limit);
+    if (limit > 0)
+        conv_runBankPartially(inImg, part->rowIdx + firstRowIdx, limit,
+            outImgs, convFilters, filtersAmt);
+    for (i = 0; i < filtersAmt; i++)
+        gatherStrips(outImgs[i], part->rowIdx + firstRowIdx, chunk);
+}
+
+/******************************************************************************
+ * Root process code
+ *****************************************************************************/
+
+static int root_parseImage()
+{
+    struct image_t *converted;
+
     // Parse input image
     inImg = img_makeFromFile(
-        req->inputFile, req->imgWidth, req->imgHeight, req->imgPixelSize
+        req->inputFile, req->imgWidth, req->imgHeight, req->imgPixelSize,
+        req->imgLayout, req->imgSampleType
     );
     if (inImg == NULL)
         return 0;
@@ -106,31 +1132,361 @@ static int root_parseFiles()
     log_log(LOG_DEBUG, "[PARSING] Image was parsed with:");
     log_log(LOG_DEBUG, "\twidth: %dpx,", req->imgWidth);
     log_log(LOG_DEBUG, "\theight: %dpx", req->imgHeight);
-    log_log(LOG_DEBUG, "\tand %d bytes per pixel.", req->imgPixelSize);
+    log_log(LOG_DEBUG, "\tand %d samples of %d byte(s) per pixel (%s).",
+        req->imgPixelSize, img_getSampleSize(req->imgSampleType),
+        (req->imgLayout == IMG_LAYOUT_PLANAR) ? "planar" : "interleaved");
+
+    // Samples of the iterations (the workers get them with the empty image)
+    if (req->workSampleType != req->imgSampleType) {
+        converted = img_convertType(inImg, req->workSampleType);
+        if (converted == NULL)
+            return 0;
+        img_destroy(inImg);
+        inImg = converted;
+    }
+
+    return 1;
+}
+
+static int root_parseFiles()
+{
+    int i;
+    struct matrix_t *mat;
 
-    // Parse matrix (filter)
-    filter = mat_makeFromFile(req->matrixFile);
-    if (filter == NULL)
+    // Parse input image (read by every process with the parallel I/O)
+    if (!req->mpiIo && !root_parseImage())
         return 0;
 
+    // Parse matrices (filters), or make the one of the Gaussian
+    filters = malloc(sizeof(struct matrix_t*) * CONV_MAX_BANK_FILTERS);
+    if (filters == NULL)
+        return 0;
+    if (req->sigma > 0) {
+        filters[0] = conv_makeGaussianMatrix(req->sigma, req->boxPasses);
+        if (filters[0] == NULL)
+            return 0;
+        filtersAmt = 1;
+    }
+    for (i = 0; i < req->matrixFilesAmt && req->sigma <= 0; i++)
+        while ((mat = mat_makeFromFile(req->matrixFiles[i])) != NULL) {
+            if (filtersAmt == CONV_MAX_BANK_FILTERS) {
+                log_log(LOG_ERROR, "[CMD] At most %d filters!",
+                    CONV_MAX_BANK_FILTERS);
+                mat_destroy(mat);
+                return 0;
+            }
+            filters[filtersAmt++] = mat;
+        }
+    if (filtersAmt == 0) {
+        log_log(LOG_ERROR, "[CMD] No filter matrix was found!");
+        return 0;
+    }
+
     // Log matrix messages
-    log_log(LOG_DEBUG, "Filter matrix is %dx%d.", filter->width,
-        filter->height);
+    for (i = 0; i < filtersAmt; i++)
+        log_log(LOG_DEBUG, "Filter matrix %d is %dx%d.", i, filters[i]->width,
+            filters[i]->height);
+
+    // Output files
+    if (req->outputFilesAmt > 1 && req->outputFilesAmt != filtersAmt) {
+        log_log(LOG_ERROR, "[CMD] Please provide one output file per filter "
+            "(%d) or a single one!", filtersAmt);
+        return 0;
+    }
+
+    // Iterations
+    if (req->iterations > 1 && filtersAmt > 1) {
+        log_log(LOG_ERROR, "[CMD] Iterations need a single filter!");
+        return 0;
+    }
+
+    return 1;
+}
+
+static int root_reportFixedPointError()
+{
+    int i;
+    double error;
+    struct matrix_t *normFilter;
+    struct conv_filter_t *convFilter;
+
+    // Quantise the filters the same way the workers do
+    for (i = 0; i < filtersAmt; i++) {
+        normFilter = conv_normalizeFilter(filters[i]);
+        convFilter = conv_makeFilter(normFilter);
+        error = conv_quantizeFilter(convFilter, req->fixedBits);
+        conv_destroyFilter(convFilter);
+        mat_destroy(normFilter);
+        if (error < 0) {
+            log_log(LOG_ERROR, "[FILTER] Failed to quantise filter %d to %d "
+                "bits!", i, req->fixedBits);
+            return 0;
+        }
+        log_log(LOG_INFO, "[FILTER] Fixed-point weights of filter %d with %d "
+            "bits, worst-case error: %lf levels.", i, req->fixedBits, error);
+    }
 
     return 1;
 }
 
+static void root_writeImage(struct image_t *img, FILE *file, int rowIdx)
+{
+    struct image_t *converted;
+
+    // At its rows of the file, if it can seek (the chunks of the outputs
+    //  are written as they come)
+    fseek(file, (long) rowIdx * img->width * img->pixelSize
+        * img_getSampleSize(req->imgSampleType), SEEK_SET);
+
+    // The iterations may have run with wider samples than the files
+    if (img->sampleType == req->imgSampleType) {
+        img_writeToFile(img, file);
+        return;
+    }
+    converted = img_convertType(img, req->imgSampleType);
+    if (converted == NULL) {
+        log_log(LOG_ERROR, "[WRITING] Failed to convert the output!");
+        return;
+    }
+    img_writeToFile(converted, file);
+    img_destroy(converted);
+}
+
+static void root_writeOutput(struct image_t **imgs, int rowIdx)
+{
+    int i;
+    struct image_t *merged;
+
+    // One file per filter
+    if (filtersAmt == 1 || req->outputFilesAmt == filtersAmt) {
+        for (i = 0; i < filtersAmt; i++)
+            root_writeImage(imgs[i], req->outputFiles[i], rowIdx);
+        return;
+    }
+
+    // A single file for all of them
+    merged = img_merge(imgs, filtersAmt);
+    if (merged == NULL) {
+        log_log(LOG_ERROR, "[WRITING] Failed to merge the outputs!");
+        return;
+    }
+    root_writeImage(merged, req->outputFiles[0], rowIdx);
+    img_destroy(merged);
+}
+
+static void root_writeChunk(int chunk)
+{
+    int i, f, offsetRowIdx, rows, firstRowIdx, limit, failed;
+    struct image_t *crops[CONV_MAX_BANK_FILTERS];
+
+    // The rows of the chunk of every strip, as images of their own
+    for (i = 0; i < comm_getSize(); i++) {
+        getStripRows(i, &offsetRowIdx, &rows);
+        getChunkRows(chunk, rows, &firstRowIdx, &limit);
+        if (limit == 0)
+            continue;
+        failed = 0;
+        for (f = 0; f < filtersAmt; f++) {
+            crops[f] = img_crop(outImgs[f], req->imgWidth, limit, 0,
+                offsetRowIdx + firstRowIdx);
+            failed |= crops[f] == NULL;
+        }
+        if (failed)
+            log_log(LOG_ERROR, "[WRITING] Failed to copy the output!");
+        else
+            root_writeOutput(crops, offsetRowIdx + firstRowIdx);
+        for (f = 0; f < filtersAmt; f++)
+            if (crops[f] != NULL) img_destroy(crops[f]);
+    }
+}
+
+static int root_runChunks(struct part_t *part, int depth)
+{
+    int i, chunk, written;
+
+    // Prepare the filters, as the workers do, for the strip of the root
+    //  process if any
+    for (i = 0; i < filtersAmt && rootRows > 0; i++)
+        prepareFilter(i);
+    if (rootRows > 0)
+        simd_init();
+    for (i = 0; i < filtersAmt; i++)
+        outImgs[i] = img_makeWithType(inImg->width, inImg->height,
+            inImg->pixelSize, inImg->layout, inImg->sampleType);
+
+    // Write every chunk as soon as it is back, if the files can seek to its
+    //  rows (the outputs are written at the end otherwise)
+    written = 1;
+    for (i = 0; i < req->outputFilesAmt || i == 0; i++)
+        if (ftell(req->outputFiles[i]) < 0)
+            written = 0;
+    for (chunk = 0; chunk < chunksAmt; chunk++) {
+        runChunk(part, depth, chunk);
+        if (written)
+            root_writeChunk(chunk);
+    }
+
+    return written;
+}
+
+static int root_runStrip(struct part_t *part, int filterOffset,
+    int haloIterations)
+{
+    int i;
+
+    // Prepare the filters, as the workers do
+    for (i = 0; i < filtersAmt; i++)
+        prepareFilter(i);
+    simd_init();
+
+    // Run the first rows while the strips of the workers are scattered. The
+    //  halo exchanges and the iterations write to the image, which waits for
+    //  the scatter then.
+    if (req->iterations > 1 || req->resident)
+        comm_waitImgParts();
+    if (req->iterations > 1)
+        haloIterations = iterate(part, filterOffset, haloIterations);
+    else
+        runBank(part, filterOffset);
+    comm_waitImgParts();
+
+    return haloIterations;
+}
+
+static void root_sendBlocks(const int *dims)
+{
+    int i, coords[2], rect[4];
+
+    // Blocks only, the workers exchange their halos
+    for (i = 1; i <= dims[0] * dims[1]; i++) {
+        coords[0] = (i - 1) / dims[1];
+        coords[1] = (i - 1) % dims[1];
+        getBlock(dims, coords, rect);
+        comm_sendImgBlock(inImg, rect[0], rect[1], rect[2], rect[3], i, 0);
+    }
+}
+
+static void root_recvBlocks(const int *dims)
+{
+    int i, f, coords[2], rect[4];
+
+    // The block of every filter, in order
+    for (i = 1; i <= dims[0] * dims[1]; i++) {
+        coords[0] = (i - 1) / dims[1];
+        coords[1] = (i - 1) % dims[1];
+        getBlock(dims, coords, rect);
+        for (f = 0; f < filtersAmt; f++)
+            comm_recvImgBlock(outImgs[f], rect[0], rect[1], rect[2], rect[3],
+                i, 1);
+    }
+}
+
+static void root_sendTile(int tile, int rank, int filterOffset)
+{
+    int i, rowIdx, rows, top, bottom, originRowIdx, height;
+    struct part_t part;
+
+    // The tile and its halos, in the rows of the image of the worker (see
+    //  makeStripImage), the ones above or below the image coming from the
+    //  opposite edge
+    getTile(tile, &part);
+    getHalos(&part, filterOffset, &top, &bottom);
+    originRowIdx = part.rowIdx - top;
+    height = top + part.rows + bottom;
+    for (i = 0; i < height; i += rows) {
+        rowIdx = ((originRowIdx + i) % req->imgHeight + req->imgHeight)
+            % req->imgHeight;
+        rows = req->imgHeight - rowIdx;
+        if (rows > height - i)
+            rows = height - i;
+        comm_sendImgPart(inImg, rowIdx, rows, rank, 0);
+    }
+}
+
+static void root_runTiles(int filterOffset)
+{
+    int i, f, rank, tile, next, stopped, workers, runs, busy;
+    int ownRowIdx, ownLimit, chunkRows, rows, *tiles;
+    struct part_t part;
+
+    // Tiles for the workers, and the root process if it runs some
+    workers = comm_getSize() - 1;
+    runs = splitTiles();
+    log_log(LOG_DEBUG, "[SPLIT] %d tile(s) of %d row(s).", tilesAmt,
+        tileRows);
+    if (runs) {
+        for (i = 0; i < filtersAmt; i++)
+            prepareFilter(i);
+        simd_init();
+    }
+    for (f = 0; f < filtersAmt; f++)
+        outImgs[f] = img_makeWithType(inImg->width, inImg->height,
+            inImg->pixelSize, inImg->layout, inImg->sampleType);
+
+    // Answer every request of a worker (with the tile it is done with, if
+    //  any) with the next tile, or none when they are all handed out. The
+    //  root process runs its own tiles by chunks in between, checking for
+    //  requests without waiting for them.
+    tiles = calloc(comm_getSize(), sizeof(int));
+    chunkRows = (tileRows + ROOT_TILE_CHUNKS - 1) / ROOT_TILE_CHUNKS;
+    next = 0;
+    stopped = 0;
+    ownRowIdx = ownLimit = 0;
+    for (;;) {
+        busy = ownRowIdx < ownLimit || (runs && next < tilesAmt);
+        if (stopped == workers && !busy)
+            break;
+        rank = (stopped < workers)
+            ? comm_probe(COMM_ANY_RANK, 2, !busy) : COMM_NO_RANK;
+        if (rank != COMM_NO_RANK) {
+            tile = comm_recvValue(rank, 2);
+            if (tile >= 0) {
+                getTile(tile, &part);
+                for (f = 0; f < filtersAmt; f++)
+                    comm_recvImgPart(outImgs[f], part.rowIdx, part.rows,
+                        rank, 1);
+            }
+            tile = (next < tilesAmt) ? next++ : -1;
+            comm_sendValue(tile, rank, 2);
+            if (tile >= 0) {
+                root_sendTile(tile, rank, filterOffset);
+                tiles[rank]++;
+            } else {
+                stopped++;
+            }
+            continue;
+        }
+        if (ownRowIdx == ownLimit) {
+            getTile(next++, &part);
+            ownRowIdx = part.rowIdx;
+            ownLimit = part.rowIdx + part.rows;
+            tiles[0]++;
+        }
+        rows = (ownLimit - ownRowIdx < chunkRows)
+            ? ownLimit - ownRowIdx : chunkRows;
+        conv_runBankPartially(inImg, ownRowIdx, rows, outImgs, convFilters,
+            filtersAmt);
+        ownRowIdx += rows;
+    }
+
+    // Tiles run by every process (the faster ones take more of them)
+    for (i = runs ? 0 : 1; i <= workers; i++)
+        log_log(LOG_INFO, "[TILES] Process %d ran %d tile(s).", i,
+            tiles[i]);
+    free(tiles);
+}
+
 static void root_run(int argc, char **argv)
 {
-    int i, size;
-    int filterOffset;
-    int offsetRowIdx, limit;
+    int f, workers, depth, written, dims[2];
+    int filterOffset, thinnest, haloIterations;
+    struct part_t part;
     double sTime, eTime;
 
     // Parse command line
     if (!parseCmdRequest(argc, argv))
         return;
-    if (!root_validateRequest()) {
+    if (!validateRequest()) {
         clean();
         return;
     }
@@ -140,46 +1496,106 @@ static void root_run(int argc, char **argv)
         clean();
         return;
     }
-    filterOffset = (filter->height - 1) / 2;
+    filterOffset = getFilterOffset();
 
-    // Send the filter matrix and the empty image to workers
-    comm_broadcastMatrix(filter);
-    comm_broadcastEmptyImg(inImg);
+    // Report the error of the fixed-point mode
+    if (req->fixedBits > 0 && !root_reportFixedPointError()) {
+        clean();
+        return;
+    }
+
+    // Send the filter matrices to workers
+    comm_broadcastMatrices(filters, &filtersAmt);
+
+    // Tiles handed out on request
+    if (req->split == COMM_SPLIT_TILES) {
+        sTime = comm_wTime();
+        root_runTiles(filterOffset);
+        eTime = comm_wTime();
+        log_log(LOG_INFO, "The process took %lf seconds!", (eTime - sTime));
+        root_writeOutput(outImgs, 0);
+        clean();
+        return;
+    }
+
+    // Split of the image and halos of the iterations (the workers check the
+    //  same). The blocks and the resident strips exchange the halo of the
+    //  first iteration too.
+    workers = comm_getSize() - 1;
+    getGrid(workers, filterOffset, dims);
+    splitStrips(dims, filterOffset);
+    thinnest = getThinnestPart(dims);
+    haloIterations = getMaxHaloIterations(filterOffset, thinnest);
+    if (haloIterations == 0
+        || ((dims[1] > 1 || req->resident) && thinnest < filterOffset)) {
+        log_log(LOG_ERROR, "[HALO] The parts are thinner than the filter "
+            "radius, please use fewer processes!");
+        clean();
+        return;
+    }
+    if (dims[1] > 1)
+        log_log(LOG_DEBUG, "[SPLIT] %dx%d blocks.", dims[0], dims[1]);
+    else
+        log_log(LOG_DEBUG, "[SPLIT] %d strip(s) of %d row(s), %d for the "
+            "root process.", dims[0], stripRows, rootRows);
 
     // Start timer
     sTime = comm_wTime();
 
-    // Send image parts
-    size = comm_getSize();
-    limit = ceil(inImg->height / (double) (size - 1));
-    offsetRowIdx = 0;
-    for (i = 1; i < size; i++) {
-        comm_sendImgPart(
-            inImg,
-            (offsetRowIdx >= filterOffset) ? offsetRowIdx - filterOffset : 0,
-            (offsetRowIdx + limit + (2 * filterOffset) < inImg->height)
-                ? limit + (2 * filterOffset)
-                : (inImg->height - offsetRowIdx),
-            i,  // rank
-            0   // tag
-        );
-        offsetRowIdx += limit;
-    }
-
-    // Receive results
-    outImg = img_make(inImg->width, inImg->height, inImg->pixelSize);
-    offsetRowIdx = 0;
-    for (i = 1; i < size; i++) {
-        comm_recvImgPart(outImg, offsetRowIdx, limit, i, 1);
-        offsetRowIdx += limit;
+    // Send image parts, with the halo of the first round of iterations (a
+    //  single iteration when their amount is picked from the measured costs),
+    //  or read the one of the root process like the workers do
+    if (req->haloIterations == 0)
+        haloIterations = 1;
+    depth = req->resident ? 0 : filterOffset * haloIterations;
+    if (dims[1] == 1)
+        getStrip(0, &part);
+    if (dims[1] > 1)
+        root_sendBlocks(dims);
+    else if (req->mpiIo) {
+        makeStripImage(&part, depth);
+        readStrip(&part);
+    } else
+        scatterStrips(depth, 0, 0);
+
+    // Run the strip of the root process, if any (chunk by chunk with the
+    //  workers when they are streamed, writing them as they come)
+    written = req->mpiIo;
+    if (chunksAmt > 1) {
+        written = root_runChunks(&part, depth);
+    } else if (rootRows > 0) {
+        haloIterations = root_runStrip(&part, filterOffset, haloIterations);
+    } else {
+        comm_waitImgParts();
+        if (req->iterations > 1 && req->haloIterations == 0)
+            haloIterations = comm_reduceMin(INT_MAX);
+        for (f = 0; f < filtersAmt; f++)
+            outImgs[f] = img_makeWithType(inImg->width, inImg->height,
+                inImg->pixelSize, inImg->layout, inImg->sampleType);
     }
 
+    // Iterations per halo exchange, picked by the processes with a part
+    if (req->iterations > 1)
+        log_log(LOG_DEBUG, "[HALO] %d iteration(s), %d per halo exchange.",
+            req->iterations, haloIterations);
+
+    // Receive results, or write the ones of the root process like the
+    //  workers do
+    if (dims[1] > 1)
+        root_recvBlocks(dims);
+    else if (req->mpiIo)
+        writeStrip(&part);
+    else if (chunksAmt == 1)
+        for (f = 0; f < filtersAmt; f++)
+            gatherStrips(outImgs[f], 0, 0);
+
     // End timer
     eTime = comm_wTime();
     log_log(LOG_INFO, "The process took %lf seconds!", (eTime - sTime));
 
-    // Write image
-    img_writeToFile(outImg, req->outputFile);
+    // Write images
+    if (!written)
+        root_writeOutput(outImgs, 0);
 
     // Clean
     clean();
@@ -189,44 +1605,210 @@ static void root_run(int argc, char **argv)
  * Worker process code
  *****************************************************************************/
 
+static void worker_runStrip(int rank, int filterOffset, int haloIterations)
+{
+    int i, depth;
+    struct part_t part;
+
+    // Get image part, with the halo of the first round of iterations (none
+    //  for the resident strips), in an image of its own
+    depth = filterOffset
+        * ((req->haloIterations == 0) ? 1 : haloIterations);
+    if (req->resident)
+        depth = 0;
+    getStrip(rank, &part);
+    makeStripImage(&part, depth);
+    if (req->mpiIo)
+        readStrip(&part);
+    else
+        scatterStrips(depth, part.originRowIdx, 0);
+
+    // Streamed strip: run and send back chunk by chunk
+    if (chunksAmt > 1) {
+        for (i = 0; i < filtersAmt; i++)
+            outImgs[i] = img_makeWithType(inImg->width, inImg->height,
+                inImg->pixelSize, inImg->layout, inImg->sampleType);
+        for (i = 0; i < chunksAmt; i++)
+            runChunk(&part, depth, i);
+        return;
+    }
+    comm_waitImgParts();
+
+    // Run iterations (their result is the first output), or the convolution
+    if (req->iterations > 1)
+        iterate(&part, filterOffset, haloIterations);
+    else
+        runBank(&part, filterOffset);
+
+    // Send back results, or write them
+    if (req->mpiIo)
+        writeStrip(&part);
+    else
+        for (i = 0; i < filtersAmt; i++)
+            gatherStrips(outImgs[i], part.rowIdx, 0);
+}
+
+static void worker_runBlock(const int *dims, int filterOffset,
+    int haloIterations)
+{
+    int i, depth, bottom, right;
+    int coords[2], periods[2], rect[4];
+    struct part_t part;
+
+    // Grid of workers: the blocks wrap around, but for a single row or
+    //  column of them (whole rows or columns of the image, whose border is
+    //  handled by the engines)
+    for (i = 0; i < 2; i++)
+        periods[i] = req->borderMode == IMG_BORDER_WRAP && dims[i] > 1;
+    comm_makeWorkersGrid(dims, periods, coords);
+    getBlock(dims, coords, rect);
+
+    // The block and the halos of the first round of iterations, on the sides
+    //  with a neighbour
+    depth = filterOffset
+        * ((req->haloIterations == 0) ? 1 : haloIterations);
+    part.rowIdx = (dims[0] > 1 && (coords[0] > 0 || periods[0])) ? depth : 0;
+    part.colIdx = (dims[1] > 1 && (coords[1] > 0 || periods[1])) ? depth : 0;
+    bottom = (dims[0] > 1 && (coords[0] < dims[0] - 1 || periods[0]))
+        ? depth : 0;
+    right = (dims[1] > 1 && (coords[1] < dims[1] - 1 || periods[1]))
+        ? depth : 0;
+    part.rows = rect[2];
+    part.cols = rect[3];
+    part.upRank = part.downRank = COMM_NO_RANK;
+    part.isBlock = 1;
+    part.originRowIdx = rect[0] - part.rowIdx;
+    part.halo = depth;
+    inImg = img_makeWithType(part.colIdx + part.cols + right,
+        part.rowIdx + part.rows + bottom, req->imgPixelSize, req->imgLayout,
+        req->workSampleType);
+
+    // Get the block, then its halos
+    comm_recvImgBlock(inImg, part.rowIdx, part.colIdx, part.rows, part.cols,
+        0, 0);
+    exchangeHalos(&part, depth);
+
+    // Run iterations
+    if (req->iterations > 1) {
+        iterate(&part, filterOffset, haloIterations);
+        comm_sendImgBlock(outImgs[0], part.rowIdx, part.colIdx, part.rows,
+            part.cols, 0, 1);
+        return;
+    }
+
+    // Run convolution and send back results
+    runBank(&part, filterOffset);
+    for (i = 0; i < filtersAmt; i++)
+        comm_sendImgBlock(outImgs[i], part.rowIdx, part.colIdx, part.rows,
+            part.cols, 0, 1);
+}
+
+static void worker_recvTile(struct part_t *part)
+{
+    int i, rowIdx, rows;
+
+    // The tile and its halos, in as many parts as sent (see root_sendTile)
+    for (i = 0; i < inImg->height; i += rows) {
+        rowIdx = ((part->originRowIdx + i) % req->imgHeight
+            + req->imgHeight) % req->imgHeight;
+        rows = req->imgHeight - rowIdx;
+        if (rows > inImg->height - i)
+            rows = inImg->height - i;
+        comm_recvImgPart(inImg, i, rows, 0, 0);
+    }
+}
+
+static void worker_runTiles(int filterOffset)
+{
+    int f, tile;
+    struct part_t part;
+
+    // Ask for a tile (sending back the results of the previous one) until
+    //  there are none left
+    splitTiles();
+    for (tile = -1;;) {
+        comm_sendValue(tile, 0, 2);
+        for (f = 0; tile >= 0 && f < filtersAmt; f++)
+            comm_sendImgPart(outImgs[f], part.rowIdx, part.rows, 0, 1);
+        tile = comm_recvValue(0, 2);
+        if (tile < 0)
+            return;
+
+        // The tile and its halos in images of their own
+        if (inImg != NULL)
+            img_destroy(inImg);
+        getTile(tile, &part);
+        makeStripImage(&part, filterOffset);
+        worker_recvTile(&part);
+        for (f = 0; f < filtersAmt; f++) {
+            if (outImgs[f] != NULL)
+                img_destroy(outImgs[f]);
+            outImgs[f] = img_makeWithType(inImg->width, inImg->height,
+                inImg->pixelSize, inImg->layout, inImg->sampleType);
+        }
+        conv_runBankPartially(inImg, part.rowIdx, part.rows, outImgs,
+            convFilters, filtersAmt);
+    }
+}
+
 static void worker_run(int rank, int argc, char **argv)
 {
-    int size;
-    int filterOffset;
-    int offsetRowIdx, limit;
+    int i, workers, dims[2];
+    int filterOffset, thinnest, haloIterations;
 
-    // Parse command line
+    // Parse command line (and reject the request as the root process does,
+    //  rather than wait for filters it will not send)
     if (!parseCmdRequest(argc, argv))
         return;
+    if (!validateRequest()) {
+        clean();
+        return;
+    }
 
-    // Get the filter matrix and the empty image
-    filter = comm_broadcastMatrix(NULL);
-    inImg = comm_broadcastEmptyImg(NULL);
-    filterOffset = (filter->height - 1) / 2;
+    // Get the filter matrices (the size of the image is the one of the
+    //  command line, the part of the worker being allocated alone)
+    filters = comm_broadcastMatrices(NULL, &filtersAmt);
+    filterOffset = getFilterOffset();
 
-    // Normalize filter
-    normFilter = conv_normalizeFilter(filter);
+    // Prepare the filters
+    for (i = 0; i < filtersAmt; i++)
+        prepareFilter(i);
+    log_log(LOG_DEBUG, "[FILTER] Using %s kernels.",
+        simd_getLevelName(simd_init()));
 
-    // Get image part
-    size = comm_getSize();
-    limit = ceil(inImg->height / (double) (size - 1));
-    offsetRowIdx = limit * (rank - 1);
-    comm_recvImgPart(
-        inImg,
-        (offsetRowIdx >= filterOffset) ? offsetRowIdx - filterOffset : 0,
-        (offsetRowIdx + limit + (2 * filterOffset) < inImg->height)
-            ? limit + (2 * filterOffset)
-            : (inImg->height - offsetRowIdx),
-        0,  // rank
-        0   // tag
-    );
+    // Threads
+    if (req->threads > 1 && !comm_isThreaded())
+        log_log(LOG_WARNING, "[THREADS] The MPI library does not support "
+            "threads, using a single one.");
+    log_log(LOG_DEBUG, "[THREADS] Using %d thread(s), %s scheduling.",
+        convFilters[0]->threads,
+        (req->schedule == CONV_SCHEDULE_DYNAMIC) ? "dynamic" : "static");
 
-    // Run convolution
-    outImg = img_make(inImg->width, inImg->height, inImg->pixelSize);
-    conv_runPartially(inImg, offsetRowIdx, limit, outImg, normFilter);
+    // Tiles handed out on request
+    if (req->split == COMM_SPLIT_TILES) {
+        worker_runTiles(filterOffset);
+        clean();
+        return;
+    }
+
+    // Split of the image and halos of the iterations (same as the root
+    //  process)
+    workers = comm_getSize() - 1;
+    getGrid(workers, filterOffset, dims);
+    splitStrips(dims, filterOffset);
+    thinnest = getThinnestPart(dims);
+    haloIterations = getMaxHaloIterations(filterOffset, thinnest);
+    if (haloIterations == 0
+        || ((dims[1] > 1 || req->resident) && thinnest < filterOffset)) {
+        clean();
+        return;
+    }
 
-    // Send back results
-    comm_sendImgPart(outImg, offsetRowIdx, limit, 0, 1);
+    // Run the part
+    if (dims[1] > 1)
+        worker_runBlock(dims, filterOffset, haloIterations);
+    else
+        worker_runStrip(rank, filterOffset, haloIterations);
 
     // Clean
     clean();
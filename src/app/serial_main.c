@@ -5,11 +5,14 @@
  *  Image convolution main function.
  *****************************************************************************/
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 #include <util/log.h>
 #include <types/image.h>
 #include <types/matrix.h>
 #include "cmd.h"
 #include "convolution.h"
+#include "jit.h"
 #include "timer.h"
 
 /******************************************************************************
@@ -20,17 +23,49 @@
 static CmdRequest *req;
 // Input image
 static struct image_t *inImg;
-// Filter (matrix)
-static struct matrix_t *filter;
+// Output images (one per filter)
+static struct image_t *outImgs[CONV_MAX_BANK_FILTERS];
+// Filters (matrices) of the bank
+static struct matrix_t *filters[CONV_MAX_BANK_FILTERS];
+static int filtersAmt;
+// Normalized filters (matrices)
+static struct matrix_t *normFilters[CONV_MAX_BANK_FILTERS];
+// Analysed filters
+static struct conv_filter_t *convFilters[CONV_MAX_BANK_FILTERS];
 
 /******************************************************************************
  * Helpers
  *****************************************************************************/
 
+static void writeImage(struct image_t *img, FILE *file)
+{
+    struct image_t *converted;
+
+    // The iterations may have run with wider samples than the files
+    if (img->sampleType == req->imgSampleType) {
+        img_writeToFile(img, file);
+        return;
+    }
+    converted = img_convertType(img, req->imgSampleType);
+    if (converted == NULL) {
+        log_log(LOG_ERROR, "[WRITING] Failed to convert the output!");
+        return;
+    }
+    img_writeToFile(converted, file);
+    img_destroy(converted);
+}
+
 static void clean()
 {
+    int i;
+
     log_log(LOG_DEBUG, "[CLEANING] Cleaning the memory...");
-    if (filter != NULL) mat_destroy(filter);
+    for (i = 0; i < CONV_MAX_BANK_FILTERS; i++) {
+        if (convFilters[i] != NULL) conv_destroyFilter(convFilters[i]);
+        if (filters[i] != NULL) mat_destroy(filters[i]);
+        if (normFilters[i] != NULL) mat_destroy(normFilters[i]);
+        if (outImgs[i] != NULL) img_destroy(outImgs[i]);
+    }
     if (inImg != NULL) img_destroy(inImg);
     if (req != NULL) cmd_destroyRequest(req);
 }
@@ -55,69 +90,244 @@ static int parseCmdRequest(int argc, char **argv)
 
 static int parseFiles()
 {
+    int i;
+    struct matrix_t *mat;
+    struct image_t *tmp;
+
     // Parse input image
     inImg = img_makeFromFile(
-        req->inputFile, req->imgWidth, req->imgHeight, req->imgPixelSize
+        req->inputFile, req->imgWidth, req->imgHeight, req->imgPixelSize,
+        req->imgLayout, req->imgSampleType
     );
     if (inImg == NULL) return 0;
     log_log(LOG_DEBUG, "[PARSING] Image was parsed with:");
     log_log(LOG_DEBUG, "\twidth: %dpx,", req->imgWidth);
     log_log(LOG_DEBUG, "\theight: %dpx", req->imgHeight);
-    log_log(LOG_DEBUG, "\tand %d bytes per pixel.", req->imgPixelSize);
+    log_log(LOG_DEBUG, "\tand %d samples of %d byte(s) per pixel (%s).",
+        req->imgPixelSize, img_getSampleSize(req->imgSampleType),
+        (req->imgLayout == IMG_LAYOUT_PLANAR) ? "planar" : "interleaved");
+
+    // Samples of the iterations
+    if (req->workSampleType != req->imgSampleType) {
+        tmp = img_convertType(inImg, req->workSampleType);
+        if (tmp == NULL) return 0;
+        img_destroy(inImg);
+        inImg = tmp;
+    }
 
-    // Parse matrix (filter)
-    filter = mat_makeFromFile(req->matrixFile);
-    if (filter == NULL) return 0;
-    log_log(LOG_DEBUG, "Filter matrix is %dx%d.", filter->width,
-        filter->height);
+    // Parse matrices (filters), or make the one of the Gaussian
+    if (req->sigma > 0) {
+        filters[0] = conv_makeGaussianMatrix(req->sigma, req->boxPasses);
+        if (filters[0] == NULL) return 0;
+        filtersAmt = 1;
+    }
+    for (i = 0; i < req->matrixFilesAmt && req->sigma <= 0; i++)
+        while ((mat = mat_makeFromFile(req->matrixFiles[i])) != NULL) {
+            if (filtersAmt == CONV_MAX_BANK_FILTERS) {
+                log_log(LOG_ERROR, "[CMD] At most %d filters!",
+                    CONV_MAX_BANK_FILTERS);
+                mat_destroy(mat);
+                return 0;
+            }
+            filters[filtersAmt++] = mat;
+        }
+    if (filtersAmt == 0) return 0;
+    for (i = 0; i < filtersAmt; i++)
+        log_log(LOG_DEBUG, "Filter matrix %d is %dx%d.", i, filters[i]->width,
+            filters[i]->height);
+
+    // Output files
+    if (req->outputFilesAmt > 1 && req->outputFilesAmt != filtersAmt) {
+        log_log(LOG_ERROR, "[CMD] Please provide one output file per filter "
+            "(%d) or a single one!", filtersAmt);
+        return 0;
+    }
+
+    // Iterations
+    if (req->iterations < 1 || (req->iterations > 1 && filtersAmt > 1)) {
+        log_log(LOG_ERROR, "[CMD] Iterations need a single filter!");
+        return 0;
+    }
+    if (req->tolerance < 0) {
+        log_log(LOG_ERROR, "[CMD] The tolerance must not be negative!");
+        return 0;
+    }
+
+    // Fixed-point weights only apply to 8-bit samples
+    if (req->fixedBits > 0 && req->workSampleType != IMG_SAMPLE_U8) {
+        log_log(LOG_ERROR, "[CMD] The fixed-point mode needs 8-bit samples!");
+        return 0;
+    }
 
     return 1;
 }
 
+static int prepareFilter(int i)
+{
+    int compiled;
+    double error;
+
+    // Normalize and analyse
+    normFilters[i] = conv_normalizeFilter(filters[i]);
+    if (normFilters[i] == NULL) return 0;
+    convFilters[i] = conv_makeFilter(normFilters[i]);
+    if (convFilters[i] == NULL) return 0;
+    convFilters[i]->border = req->borderMode;
+    convFilters[i]->engine = req->engine;
+    convFilters[i]->tileWidth = req->tileWidth;
+    convFilters[i]->threads = req->threads;
+    convFilters[i]->schedule = req->schedule;
+    if (req->sigma > 0
+        && !conv_useBoxPasses(convFilters[i], req->sigma, req->boxPasses)) {
+        log_log(LOG_ERROR, "[FILTER] Failed to make the box passes!");
+        return 0;
+    }
+
+    // Fixed-point mode
+    if (req->fixedBits > 0) {
+        error = conv_quantizeFilter(convFilters[i], req->fixedBits);
+        if (error < 0) {
+            log_log(LOG_ERROR, "[FILTER] Failed to quantise filter %d to %d "
+                "bits!", i, req->fixedBits);
+            return 0;
+        }
+        log_log(LOG_INFO, "[FILTER] Fixed-point weights of filter %d with %d "
+            "bits, worst-case error: %lf levels.", i, req->fixedBits, error);
+    }
+    // Generated kernel (the quantised filters keep the static ones, and the
+    //  wider samples the sparse engine)
+    if (req->jit && req->fixedBits == 0
+        && inImg->sampleType == IMG_SAMPLE_U8) {
+        compiled = conv_compileFilter(convFilters[i],
+            (inImg->layout == IMG_LAYOUT_PLANAR) ? 1 : inImg->pixelSize);
+        if (compiled > 0)
+            log_log(LOG_DEBUG, "[JIT] Generated the kernel of filter %d: %d "
+                "tap(s) in %d group(s).", i, convFilters[i]->jit->taps,
+                convFilters[i]->jit->groups);
+        else if (compiled == 0)
+            log_log(LOG_DEBUG, "[JIT] The static kernels are cheaper for "
+                "filter %d.", i);
+        else
+            log_log(LOG_WARNING, "[JIT] Failed to generate the kernel of "
+                "filter %d, using the static kernels.", i);
+    }
+    log_log(LOG_DEBUG, "[FILTER] Using the %s engine for filter %d.",
+        conv_getEngineName((inImg->sampleType != IMG_SAMPLE_U8)
+            ? CONV_ENGINE_SPARSE : conv_chooseEngine(convFilters[i],
+                inImg->width, inImg->height, inImg->pixelSize)), i);
+
+    return 1;
+}
+
+static void writeOutput()
+{
+    int i;
+    struct image_t *merged;
+
+    // One file per filter
+    if (filtersAmt == 1 || req->outputFilesAmt == filtersAmt) {
+        for (i = 0; i < filtersAmt; i++)
+            writeImage(outImgs[i], req->outputFiles[i]);
+        return;
+    }
+
+    // A single file for all of them
+    merged = img_merge(outImgs, filtersAmt);
+    if (merged == NULL) {
+        log_log(LOG_ERROR, "[WRITING] Failed to merge the outputs!");
+        return;
+    }
+    writeImage(merged, req->outputFiles[0]);
+    img_destroy(merged);
+}
+
 /******************************************************************************
  * Main function
  *****************************************************************************/
 
 int main(int argc, char **argv)
 {
-    struct image_t *outImg;
+    int i, loops;
     double dist;
-    int loops;
+    struct image_t *tmp;
+    struct conv_delta_t delta;
     double sTime, eTime;
 
     // Parsing command line
     if (!parseCmdRequest(argc, argv)) return 1;
 
     // Parse files
-    if (!parseFiles()) return 2;
+    if (!parseFiles()) {
+        clean();
+        return 2;
+    }
+
+    // Prepare filters
+    for (i = 0; i < filtersAmt; i++)
+        if (!prepareFilter(i)) {
+            clean();
+            return 3;
+        }
 
     // Start timer
     GET_TIME(sTime);
 
-    // Process image
-    outImg = NULL;
-    loops = 0;
-    do {
-        // Run convolution
-        log_log(LOG_DEBUG, "[RUNNING] Running convolution...");
-        outImg = conv_run(inImg, filter);
-        loops++;
+    // Process image, all the filters in a single pass per iteration
+    log_log(LOG_DEBUG, "[RUNNING] Running convolution...");
+    for (i = 0; i < filtersAmt; i++) {
+        outImgs[i] = img_makeWithType(inImg->width, inImg->height,
+            inImg->pixelSize, inImg->layout, inImg->sampleType);
+        if (outImgs[i] == NULL) {
+            clean();
+            return 4;
+        }
+    }
+    for (loops = 0; loops < req->iterations; loops++) {
+        // A single filter: the dissimilarity is gathered as the rows are
+        //  stored
+        delta.sumSquares = 0;
+        delta.maxDiff = 0;
+        delta.endByte = 0;
+        if (filtersAmt == 1) {
+            conv_runFilterPartiallyDelta(inImg, 0, inImg->height, outImgs[0],
+                convFilters[0], &delta);
+            log_log(LOG_DEBUG, "[RUNNING] New distance is %lf (largest "
+                "change %lf).", conv_getDeltaDistance(&delta,
+                inImg->sampleType), delta.maxDiff);
+        } else {
+            conv_runBankPartially(inImg, 0, inImg->height, outImgs,
+                convFilters, filtersAmt);
+
+            // Get dissimilarity
+            for (i = 0; i < filtersAmt; i++) {
+                dist = img_getDistance(inImg, outImgs[i]);
+                log_log(LOG_DEBUG, "[RUNNING] New distance of filter %d is "
+                    "%lf.", i, dist);
+            }
+        }
 
-        // Get dissimilarity
-        dist = img_getDistance(inImg, outImg);
-        log_log(LOG_DEBUG, "[RUNNING] New distance is %lf.", dist);
+        // Stopping criterion
+        if (loops + 1 < req->iterations && conv_hasConverged(&delta,
+            inImg->sampleType, req->criterion, req->tolerance)) {
+            log_log(LOG_DEBUG, "[RUNNING] Converged after %d iteration(s).",
+                loops + 1);
+            break;
+        }
 
-        // Remove previous in image
-        img_destroy(inImg);
-        inImg = outImg;
-    } while (dist > 1.0 && loops < 1);
+        // Iterations: the output is the next input (single filter)
+        if (loops + 1 < req->iterations) {
+            tmp = inImg;
+            inImg = outImgs[0];
+            outImgs[0] = tmp;
+        }
+    }
 
     // End timer
     GET_TIME(eTime);
     log_log(LOG_INFO, "The process took %lf seconds!", (eTime - sTime));
 
-    // Write output image
-    img_writeToFile(outImg, req->outputFile);
+    // Write output images
+    writeOutput();
 
     // Clean up and exit
     clean();
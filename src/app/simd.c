@@ -0,0 +1,603 @@
+/******************************************************************************
+ * NAME:
+ *  simd.c
+ * DESCRIPTION:
+ *  Vectorised convolution kernels implementation. Every kernel is compiled
+ *  for its own instruction set (function target attributes), so a single
+ *  binary runs on any x86-64 CPU and picks the best kernel at runtime.
+ *****************************************************************************/
+#include "simd.h"
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/******************************************************************************
+ * Specialisation
+ *****************************************************************************/
+
+// Kernel bodies are always inlined, so that the specialised kernels get
+//  constant filter and pixel sizes and their tap loops fully unrolled
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+// Defines `kernel`, the generic version of `kernel##Body`, and `kernel_R_P`,
+//  its versions for a filter radius R and a pixel size P (see simd.h)
+#define ROW_KERNEL(kernel, attr, radius, size) \
+    attr static void kernel##_##radius##_##size(unsigned char *out, int n, \
+        const unsigned char **rows, const float **weights, int k, \
+        int pixelSize) \
+    { \
+        kernel##Body(out, n, rows, weights, 2 * radius + 1, size); \
+    }
+#define ROW_KERNELS(kernel, attr) \
+    attr static void kernel(unsigned char *out, int n, \
+        const unsigned char **rows, const float **weights, int k, \
+        int pixelSize) \
+    { \
+        kernel##Body(out, n, rows, weights, k, pixelSize); \
+    } \
+    ROW_KERNEL(kernel, attr, 1, 1) ROW_KERNEL(kernel, attr, 1, 3) \
+    ROW_KERNEL(kernel, attr, 1, 4) ROW_KERNEL(kernel, attr, 2, 1) \
+    ROW_KERNEL(kernel, attr, 2, 3) ROW_KERNEL(kernel, attr, 2, 4) \
+    ROW_KERNEL(kernel, attr, 3, 1) ROW_KERNEL(kernel, attr, 3, 3) \
+    ROW_KERNEL(kernel, attr, 3, 4)
+
+// Same for the fixed-point kernels
+#define FIXED_ROW_KERNEL(kernel, attr, radius, size) \
+    attr static void kernel##_##radius##_##size(unsigned char *out, int n, \
+        const unsigned char **rows, const short **weights, int k, \
+        int pixelSize, int bits) \
+    { \
+        kernel##Body(out, n, rows, weights, 2 * radius + 1, size, bits); \
+    }
+#define FIXED_ROW_KERNELS(kernel, attr) \
+    attr static void kernel(unsigned char *out, int n, \
+        const unsigned char **rows, const short **weights, int k, \
+        int pixelSize, int bits) \
+    { \
+        kernel##Body(out, n, rows, weights, k, pixelSize, bits); \
+    } \
+    FIXED_ROW_KERNEL(kernel, attr, 1, 1) FIXED_ROW_KERNEL(kernel, attr, 1, 3) \
+    FIXED_ROW_KERNEL(kernel, attr, 1, 4) FIXED_ROW_KERNEL(kernel, attr, 2, 1) \
+    FIXED_ROW_KERNEL(kernel, attr, 2, 3) FIXED_ROW_KERNEL(kernel, attr, 2, 4) \
+    FIXED_ROW_KERNEL(kernel, attr, 3, 1) FIXED_ROW_KERNEL(kernel, attr, 3, 3) \
+    FIXED_ROW_KERNEL(kernel, attr, 3, 4)
+
+// Dispatch table of the specialised kernels, indexed by [radius][pixelSize]
+#define KERNEL_TABLE(kernel) { \
+    {NULL, NULL, NULL, NULL, NULL}, \
+    {NULL, kernel##_1_1, NULL, kernel##_1_3, kernel##_1_4}, \
+    {NULL, kernel##_2_1, NULL, kernel##_2_3, kernel##_2_4}, \
+    {NULL, kernel##_3_1, NULL, kernel##_3_3, kernel##_3_4} \
+}
+
+/******************************************************************************
+ * Global variables
+ *****************************************************************************/
+
+static int initialized = 0;
+static SimdLevel detectedLevel = SIMD_NONE;
+static SimdLevel level = SIMD_NONE;
+static char *levelName[4] = {"scalar", "SSE4.1", "AVX2", "AVX-512"};
+
+/******************************************************************************
+ * Scalar tail
+ *****************************************************************************/
+
+/**
+ * Scalar version of the row kernel, for the bytes that do not fill a vector.
+ * @param int i The first output byte.
+ * @see SimdRowKernel
+ */
+KERNEL_INLINE void rowKernelTail(unsigned char *out, int i, int n,
+    const unsigned char **rows, const float **weights, int k,
+    int pixelSize)
+{
+    int a, b;
+    float acc;
+
+    for (; i < n; i++) {
+        acc = 0;
+        #pragma GCC unroll 8
+        for (a = 0; a < k; a++)
+            #pragma GCC unroll 8
+            for (b = 0; b < k; b++)
+                acc += weights[a][b] * rows[a][i + b * pixelSize];
+        out[i] = (acc >= 255) ? 255 : (acc <= 0) ? 0 : (unsigned char) acc;
+    }
+}
+
+/**
+ * Scalar row kernel, the fallback of the vectorised ones.
+ * @see SimdRowKernel
+ */
+KERNEL_INLINE void rowKernelScalarBody(unsigned char *out, int n,
+    const unsigned char **rows, const float **weights, int k,
+    int pixelSize)
+{
+    rowKernelTail(out, 0, n, rows, weights, k, pixelSize);
+}
+
+/**
+ * Scalar version of the fixed-point row kernel.
+ * @param int i The first output byte.
+ * @see SimdFixedRowKernel
+ */
+KERNEL_INLINE void rowKernelFixedTail(unsigned char *out, int i, int n,
+    const unsigned char **rows, const short **weights, int k,
+    int pixelSize, int bits)
+{
+    int a, b;
+    int acc;
+
+    for (; i < n; i++) {
+        acc = 0;
+        #pragma GCC unroll 8
+        for (a = 0; a < k; a++)
+            #pragma GCC unroll 8
+            for (b = 0; b < k; b++)
+                acc += weights[a][b] * rows[a][i + b * pixelSize];
+        acc >>= bits;
+        out[i] = (acc > 255) ? 255 : (acc < 0) ? 0 : acc;
+    }
+}
+
+/**
+ * Scalar fixed-point row kernel, the fallback of the vectorised ones.
+ * @see SimdFixedRowKernel
+ */
+KERNEL_INLINE void rowKernelFixedScalarBody(unsigned char *out, int n,
+    const unsigned char **rows, const short **weights, int k,
+    int pixelSize, int bits)
+{
+    rowKernelFixedTail(out, 0, n, rows, weights, k, pixelSize, bits);
+}
+
+ROW_KERNELS(rowKernelScalar, )
+FIXED_ROW_KERNELS(rowKernelFixedScalar, )
+
+#ifdef SIMD_X86
+
+/**
+ * Packs two 16-bit weights into the 32-bit word expected by pmaddwd.
+ * @param short lo The weight of the first tap.
+ * @param short hi The weight of the second tap.
+ * @return int The packed weights.
+ */
+static inline int packWeights(short lo, short hi)
+{
+    return (int) (((unsigned int) (unsigned short) hi << 16)
+        | (unsigned short) lo);
+}
+
+/******************************************************************************
+ * SSE4.1
+ *****************************************************************************/
+
+__attribute__((target("sse4.1")))
+KERNEL_INLINE void rowKernelSse4Body(unsigned char *out, int n,
+    const unsigned char **rows, const float **weights, int k,
+    int pixelSize)
+{
+    int i, a, b;
+    const unsigned char *in;
+    __m128 acc0, acc1, acc2, acc3, w;
+    __m128i v, i0, i1, i2, i3;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max = _mm_set1_ps(255);
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        acc0 = acc1 = acc2 = acc3 = zero;
+
+        // Accumulate the taps
+        #pragma GCC unroll 8
+        for (a = 0; a < k; a++) {
+            in = rows[a] + i;
+            #pragma GCC unroll 8
+            for (b = 0; b < k; b++, in += pixelSize) {
+                w = _mm_set1_ps(weights[a][b]);
+                v = _mm_loadu_si128((const __m128i *) in);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(w,
+                    _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v))));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(w,
+                    _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4)))));
+                acc2 = _mm_add_ps(acc2, _mm_mul_ps(w,
+                    _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8)))));
+                acc3 = _mm_add_ps(acc3, _mm_mul_ps(w,
+                    _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12)))));
+            }
+        }
+
+        // Clamp, truncate and pack to bytes
+        i0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(acc0, zero), max));
+        i1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(acc1, zero), max));
+        i2 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(acc2, zero), max));
+        i3 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(acc3, zero), max));
+        _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(
+            _mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i3)));
+    }
+
+    rowKernelTail(out, i, n, rows, weights, k, pixelSize);
+}
+
+ROW_KERNELS(rowKernelSse4, __attribute__((target("sse4.1"))))
+
+/**
+ * Taps are processed in pairs, with their 16-bit pixels interleaved so that
+ *  a single multiply-add (pmaddwd) applies both weights.
+ */
+__attribute__((target("sse4.1")))
+KERNEL_INLINE void rowKernelFixedSse4Body(unsigned char *out, int n,
+    const unsigned char **rows, const short **weights, int k,
+    int pixelSize, int bits)
+{
+    int i, a, b;
+    const unsigned char *in;
+    __m128i acc0, acc1, acc2, acc3, w, x0, x1, lo0, lo1, hi0, hi1;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i shift = _mm_cvtsi32_si128(bits);
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        acc0 = acc1 = acc2 = acc3 = zero;
+
+        // Accumulate the taps, two at a time (the last one may be alone)
+        #pragma GCC unroll 8
+        for (a = 0; a < k; a++) {
+            in = rows[a] + i;
+            #pragma GCC unroll 8
+            for (b = 0; b < k; b += 2, in += 2 * pixelSize) {
+                x0 = _mm_loadu_si128((const __m128i *) in);
+                if (b + 1 < k) {
+                    x1 = _mm_loadu_si128((const __m128i *) (in + pixelSize));
+                    w = _mm_set1_epi32(
+                        packWeights(weights[a][b], weights[a][b + 1]));
+                } else {
+                    x1 = zero;
+                    w = _mm_set1_epi32(packWeights(weights[a][b], 0));
+                }
+                lo0 = _mm_unpacklo_epi8(x0, zero);
+                lo1 = _mm_unpacklo_epi8(x1, zero);
+                hi0 = _mm_unpackhi_epi8(x0, zero);
+                hi1 = _mm_unpackhi_epi8(x1, zero);
+                acc0 = _mm_add_epi32(acc0,
+                    _mm_madd_epi16(_mm_unpacklo_epi16(lo0, lo1), w));
+                acc1 = _mm_add_epi32(acc1,
+                    _mm_madd_epi16(_mm_unpackhi_epi16(lo0, lo1), w));
+                acc2 = _mm_add_epi32(acc2,
+                    _mm_madd_epi16(_mm_unpacklo_epi16(hi0, hi1), w));
+                acc3 = _mm_add_epi32(acc3,
+                    _mm_madd_epi16(_mm_unpackhi_epi16(hi0, hi1), w));
+            }
+        }
+
+        // Scale back, then pack to bytes (saturation does the clamping)
+        acc0 = _mm_sra_epi32(acc0, shift);
+        acc1 = _mm_sra_epi32(acc1, shift);
+        acc2 = _mm_sra_epi32(acc2, shift);
+        acc3 = _mm_sra_epi32(acc3, shift);
+        _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(
+            _mm_packs_epi32(acc0, acc1), _mm_packs_epi32(acc2, acc3)));
+    }
+
+    rowKernelFixedTail(out, i, n, rows, weights, k, pixelSize, bits);
+}
+
+FIXED_ROW_KERNELS(rowKernelFixedSse4, __attribute__((target("sse4.1"))))
+
+/******************************************************************************
+ * AVX2
+ *****************************************************************************/
+
+__attribute__((target("avx2")))
+KERNEL_INLINE void rowKernelAvx2Body(unsigned char *out, int n,
+    const unsigned char **rows, const float **weights, int k,
+    int pixelSize)
+{
+    int i, a, b;
+    const unsigned char *in;
+    __m256 acc0, acc1, acc2, acc3, w;
+    __m256i i0, i1, i2, i3, packed;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 max = _mm256_set1_ps(255);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        acc0 = acc1 = acc2 = acc3 = zero;
+
+        // Accumulate the taps
+        #pragma GCC unroll 8
+        for (a = 0; a < k; a++) {
+            in = rows[a] + i;
+            #pragma GCC unroll 8
+            for (b = 0; b < k; b++, in += pixelSize) {
+                w = _mm256_set1_ps(weights[a][b]);
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(w, _mm256_cvtepi32_ps(
+                    _mm256_cvtepu8_epi32(
+                        _mm_loadl_epi64((const __m128i *) in)))));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(w, _mm256_cvtepi32_ps(
+                    _mm256_cvtepu8_epi32(
+                        _mm_loadl_epi64((const __m128i *) (in + 8))))));
+                acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(w, _mm256_cvtepi32_ps(
+                    _mm256_cvtepu8_epi32(
+                        _mm_loadl_epi64((const __m128i *) (in + 16))))));
+                acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(w, _mm256_cvtepi32_ps(
+                    _mm256_cvtepu8_epi32(
+                        _mm_loadl_epi64((const __m128i *) (in + 24))))));
+            }
+        }
+
+        // Clamp, truncate and pack to bytes (packing works per 128-bit lane,
+        //  hence the final permutation)
+        i0 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(acc0, zero), max));
+        i1 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(acc1, zero), max));
+        i2 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(acc2, zero), max));
+        i3 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(acc3, zero), max));
+        packed = _mm256_packus_epi16(
+            _mm256_packs_epi32(i0, i1), _mm256_packs_epi32(i2, i3));
+        _mm256_storeu_si256((__m256i *) (out + i),
+            _mm256_permutevar8x32_epi32(packed, order));
+    }
+
+    rowKernelTail(out, i, n, rows, weights, k, pixelSize);
+}
+
+ROW_KERNELS(rowKernelAvx2, __attribute__((target("avx2"))))
+
+__attribute__((target("avx2")))
+KERNEL_INLINE void rowKernelFixedAvx2Body(unsigned char *out, int n,
+    const unsigned char **rows, const short **weights, int k,
+    int pixelSize, int bits)
+{
+    int i, a, b;
+    const unsigned char *in;
+    __m256i acc0, acc1, acc2, acc3, w, x0, x1, y0, y1;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m128i shift = _mm_cvtsi32_si128(bits);
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        acc0 = acc1 = acc2 = acc3 = zero;
+
+        // Accumulate the taps, two at a time (the last one may be alone).
+        //  Unpacking works per 128-bit lane, so acc0 holds bytes 0-3 and 8-11,
+        //  acc1 bytes 4-7 and 12-15, and so on.
+        #pragma GCC unroll 8
+        for (a = 0; a < k; a++) {
+            in = rows[a] + i;
+            #pragma GCC unroll 8
+            for (b = 0; b < k; b += 2, in += 2 * pixelSize) {
+                x0 = _mm256_cvtepu8_epi16(
+                    _mm_loadu_si128((const __m128i *) in));
+                y0 = _mm256_cvtepu8_epi16(
+                    _mm_loadu_si128((const __m128i *) (in + 16)));
+                if (b + 1 < k) {
+                    x1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                        (const __m128i *) (in + pixelSize)));
+                    y1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                        (const __m128i *) (in + pixelSize + 16)));
+                    w = _mm256_set1_epi32(
+                        packWeights(weights[a][b], weights[a][b + 1]));
+                } else {
+                    x1 = y1 = zero;
+                    w = _mm256_set1_epi32(packWeights(weights[a][b], 0));
+                }
+                acc0 = _mm256_add_epi32(acc0,
+                    _mm256_madd_epi16(_mm256_unpacklo_epi16(x0, x1), w));
+                acc1 = _mm256_add_epi32(acc1,
+                    _mm256_madd_epi16(_mm256_unpackhi_epi16(x0, x1), w));
+                acc2 = _mm256_add_epi32(acc2,
+                    _mm256_madd_epi16(_mm256_unpacklo_epi16(y0, y1), w));
+                acc3 = _mm256_add_epi32(acc3,
+                    _mm256_madd_epi16(_mm256_unpackhi_epi16(y0, y1), w));
+            }
+        }
+
+        // Scale back, then pack to bytes (saturation does the clamping)
+        acc0 = _mm256_packs_epi32(_mm256_sra_epi32(acc0, shift),
+            _mm256_sra_epi32(acc1, shift));
+        acc2 = _mm256_packs_epi32(_mm256_sra_epi32(acc2, shift),
+            _mm256_sra_epi32(acc3, shift));
+        _mm256_storeu_si256((__m256i *) (out + i), _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(acc0, acc2), 0xd8));
+    }
+
+    rowKernelFixedTail(out, i, n, rows, weights, k, pixelSize, bits);
+}
+
+FIXED_ROW_KERNELS(rowKernelFixedAvx2, __attribute__((target("avx2"))))
+
+/******************************************************************************
+ * AVX-512
+ *****************************************************************************/
+
+__attribute__((target("avx512f")))
+KERNEL_INLINE void rowKernelAvx512Body(unsigned char *out, int n,
+    const unsigned char **rows, const float **weights, int k,
+    int pixelSize)
+{
+    int i, j, a, b;
+    const unsigned char *in;
+    __m512 acc[4], w;
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 max = _mm512_set1_ps(255);
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        for (j = 0; j < 4; j++)
+            acc[j] = zero;
+
+        // Accumulate the taps
+        #pragma GCC unroll 8
+        for (a = 0; a < k; a++) {
+            in = rows[a] + i;
+            #pragma GCC unroll 8
+            for (b = 0; b < k; b++, in += pixelSize) {
+                w = _mm512_set1_ps(weights[a][b]);
+                for (j = 0; j < 4; j++)
+                    acc[j] = _mm512_add_ps(acc[j], _mm512_mul_ps(w,
+                        _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+                            _mm_loadu_si128((const __m128i *) (in + 16 * j))
+                        ))));
+            }
+        }
+
+        // Clamp, truncate and narrow to bytes
+        for (j = 0; j < 4; j++)
+            _mm_storeu_si128((__m128i *) (out + i + 16 * j),
+                _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(
+                    _mm512_min_ps(_mm512_max_ps(acc[j], zero), max))));
+    }
+
+    rowKernelTail(out, i, n, rows, weights, k, pixelSize);
+}
+
+ROW_KERNELS(rowKernelAvx512, __attribute__((target("avx512f"))))
+
+#endif
+
+/******************************************************************************
+ * Dispatch tables
+ *****************************************************************************/
+
+#ifdef SIMD_X86
+static const SimdRowKernel genericRowKernels[4] = {
+    rowKernelScalar, rowKernelSse4, rowKernelAvx2, rowKernelAvx512
+};
+static const SimdRowKernel rowKernels[4][SIMD_MAX_SPECIALISED_RADIUS + 1]
+    [SIMD_MAX_SPECIALISED_PIXEL_SIZE + 1] = {
+    KERNEL_TABLE(rowKernelScalar), KERNEL_TABLE(rowKernelSse4),
+    KERNEL_TABLE(rowKernelAvx2), KERNEL_TABLE(rowKernelAvx512)
+};
+
+// The AVX2 fixed-point kernels are also used on AVX-512 CPUs
+static const SimdFixedRowKernel genericFixedRowKernels[4] = {
+    rowKernelFixedScalar, rowKernelFixedSse4, rowKernelFixedAvx2,
+    rowKernelFixedAvx2
+};
+static const SimdFixedRowKernel fixedRowKernels[4]
+    [SIMD_MAX_SPECIALISED_RADIUS + 1][SIMD_MAX_SPECIALISED_PIXEL_SIZE + 1] = {
+    KERNEL_TABLE(rowKernelFixedScalar), KERNEL_TABLE(rowKernelFixedSse4),
+    KERNEL_TABLE(rowKernelFixedAvx2), KERNEL_TABLE(rowKernelFixedAvx2)
+};
+#else
+static const SimdRowKernel genericRowKernels[1] = {rowKernelScalar};
+static const SimdRowKernel rowKernels[1][SIMD_MAX_SPECIALISED_RADIUS + 1]
+    [SIMD_MAX_SPECIALISED_PIXEL_SIZE + 1] = {KERNEL_TABLE(rowKernelScalar)};
+static const SimdFixedRowKernel genericFixedRowKernels[1] = {
+    rowKernelFixedScalar
+};
+static const SimdFixedRowKernel fixedRowKernels[1]
+    [SIMD_MAX_SPECIALISED_RADIUS + 1][SIMD_MAX_SPECIALISED_PIXEL_SIZE + 1] = {
+    KERNEL_TABLE(rowKernelFixedScalar)
+};
+#endif
+
+/******************************************************************************
+ * CPU dispatching
+ *****************************************************************************/
+
+/**
+ * Detects the best instruction set supported by the CPU and selects it. Safe
+ *  to call more than once.
+ * @return SimdLevel The detected level.
+ */
+SimdLevel simd_init()
+{
+    if (initialized)
+        return detectedLevel;
+    initialized = 1;
+
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        detectedLevel = SIMD_AVX512;
+    else if (__builtin_cpu_supports("avx2"))
+        detectedLevel = SIMD_AVX2;
+    else if (__builtin_cpu_supports("sse4.1"))
+        detectedLevel = SIMD_SSE4;
+#endif
+    level = detectedLevel;
+
+    return detectedLevel;
+}
+
+/**
+ * Limits the level to use, e.g. to compare kernels. Levels above the detected
+ *  one are ignored.
+ * @param SimdLevel level The maximum level to use.
+ * @return SimdLevel The level now in use.
+ */
+SimdLevel simd_setLevel(SimdLevel newLevel)
+{
+    simd_init();
+    level = (newLevel < detectedLevel) ? newLevel : detectedLevel;
+
+    return level;
+}
+
+/**
+ * Returns the level in use.
+ * @return SimdLevel The level in use.
+ */
+SimdLevel simd_getLevel()
+{
+    simd_init();
+
+    return level;
+}
+
+/**
+ * Returns a printable name of a level.
+ * @param SimdLevel level The level.
+ * @return const char* The name.
+ */
+const char* simd_getLevelName(SimdLevel someLevel)
+{
+    return levelName[someLevel];
+}
+
+/**
+ * Tells whether there are kernels specialised for a filter radius and pixel
+ *  size.
+ * @param int radius The filter radius.
+ * @param int pixelSize The pixel size in bytes.
+ * @return int 1 if there are, 0 if the generic kernels are used.
+ */
+int simd_isSpecialised(int radius, int pixelSize)
+{
+    return radius >= 1 && radius <= SIMD_MAX_SPECIALISED_RADIUS
+        && pixelSize >= 1 && pixelSize <= SIMD_MAX_SPECIALISED_PIXEL_SIZE
+        && rowKernels[SIMD_NONE][radius][pixelSize] != NULL;
+}
+
+/**
+ * Returns the row kernel of the level in use. There is always one, the scalar
+ *  version being the fallback.
+ * @param int radius The filter radius.
+ * @param int pixelSize The pixel size in bytes.
+ * @return SimdRowKernel The kernel.
+ */
+SimdRowKernel simd_getRowKernel(int radius, int pixelSize)
+{
+    simd_init();
+
+    if (simd_isSpecialised(radius, pixelSize))
+        return rowKernels[level][radius][pixelSize];
+    return genericRowKernels[level];
+}
+
+/**
+ * Returns the fixed-point row kernel of the level in use. There is always
+ *  one, the scalar version being the fallback.
+ * @param int radius The filter radius.
+ * @param int pixelSize The pixel size in bytes.
+ * @return SimdFixedRowKernel The kernel.
+ */
+SimdFixedRowKernel simd_getFixedRowKernel(int radius, int pixelSize)
+{
+    simd_init();
+
+    if (simd_isSpecialised(radius, pixelSize))
+        return fixedRowKernels[level][radius][pixelSize];
+    return genericFixedRowKernels[level];
+}
@@ -0,0 +1,123 @@
+/******************************************************************************
+ * NAME:
+ *  simd.h
+ * DESCRIPTION:
+ *  Vectorised convolution kernels header file.
+ *****************************************************************************/
+#ifndef _SIMD
+#define _SIMD
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Kernels are specialised at compile time (constant filter and pixel sizes,
+//  fully unrolled taps) for radii 1 to 3 (3x3, 5x5 and 7x7 filters) and for
+//  1, 3 and 4 byte pixels. Anything else uses the generic kernels.
+#define SIMD_MAX_SPECIALISED_RADIUS 3
+#define SIMD_MAX_SPECIALISED_PIXEL_SIZE 4
+
+/******************************************************************************
+ * Data structures
+ *****************************************************************************/
+
+typedef enum {
+    SIMD_NONE = 0,          // Scalar code only
+    SIMD_SSE4 = 1,          // SSE4.1, 16 bytes per step
+    SIMD_AVX2 = 2,          // AVX2, 32 bytes per step
+    SIMD_AVX512 = 3         // AVX-512F, 64 bytes per step
+} SimdLevel;
+
+/**
+ * Row kernel. Computes n consecutive output bytes of a row as
+ *  out[i] = clamp(sum_a sum_b weights[a][b] * rows[a][i + b * pixelSize])
+ *  truncated towards zero and clamped to [0, 255].
+ * @param unsigned char *out The output bytes.
+ * @param int n The amount of output bytes.
+ * @param const unsigned char **rows The input rows, pointing to the byte
+ *  under the leftmost tap of the first output byte.
+ * @param const float **weights The weights (k values) of each input row.
+ * @param int k The filter size (k input rows of k taps).
+ * @param int pixelSize The pixel size in bytes (distance between taps).
+ */
+typedef void (*SimdRowKernel)(unsigned char *out, int n,
+    const unsigned char **rows, const float **weights, int k, int pixelSize);
+
+/**
+ * Fixed-point row kernel. Same as SimdRowKernel, but with integer weights
+ *  scaled by 2^bits: the sums are accumulated in 32-bit integers and scaled
+ *  back (floor) once per output byte.
+ * @param unsigned char *out The output bytes.
+ * @param int n The amount of output bytes.
+ * @param const unsigned char **rows The input rows, pointing to the byte
+ *  under the leftmost tap of the first output byte.
+ * @param const short **weights The scaled weights (k values) of each input
+ *  row.
+ * @param int k The filter size (k input rows of k taps).
+ * @param int pixelSize The pixel size in bytes (distance between taps).
+ * @param int bits The scale of the weights (fractional bits).
+ */
+typedef void (*SimdFixedRowKernel)(unsigned char *out, int n,
+    const unsigned char **rows, const short **weights, int k, int pixelSize,
+    int bits);
+
+/******************************************************************************
+ * CPU dispatching
+ *****************************************************************************/
+
+/**
+ * Detects the best instruction set supported by the CPU and selects it. Safe
+ *  to call more than once.
+ * @return SimdLevel The detected level.
+ */
+SimdLevel simd_init();
+
+/**
+ * Limits the level to use, e.g. to compare kernels. Levels above the detected
+ *  one are ignored.
+ * @param SimdLevel level The maximum level to use.
+ * @return SimdLevel The level now in use.
+ */
+SimdLevel simd_setLevel(SimdLevel level);
+
+/**
+ * Returns the level in use.
+ * @return SimdLevel The level in use.
+ */
+SimdLevel simd_getLevel();
+
+/**
+ * Returns a printable name of a level.
+ * @param SimdLevel level The level.
+ * @return const char* The name.
+ */
+const char* simd_getLevelName(SimdLevel level);
+
+/**
+ * Tells whether there are kernels specialised for a filter radius and pixel
+ *  size.
+ * @param int radius The filter radius.
+ * @param int pixelSize The pixel size in bytes.
+ * @return int 1 if there are, 0 if the generic kernels are used.
+ */
+int simd_isSpecialised(int radius, int pixelSize);
+
+/**
+ * Returns the row kernel of the level in use. There is always one, the scalar
+ *  version being the fallback.
+ * @param int radius The filter radius.
+ * @param int pixelSize The pixel size in bytes.
+ * @return SimdRowKernel The kernel.
+ */
+SimdRowKernel simd_getRowKernel(int radius, int pixelSize);
+
+/**
+ * Returns the fixed-point row kernel of the level in use. There is always
+ *  one, the scalar version being the fallback.
+ * @param int radius The filter radius.
+ * @param int pixelSize The pixel size in bytes.
+ * @return SimdFixedRowKernel The kernel.
+ */
+SimdFixedRowKernel simd_getFixedRowKernel(int radius, int pixelSize);
+
+#endif
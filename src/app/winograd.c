@@ -0,0 +1,229 @@
+/******************************************************************************
+ * NAME:
+ *  winograd.c
+ * DESCRIPTION:
+ *  Winograd minimal filtering F(2x2, 3x3) implementation.
+ *****************************************************************************/
+#include "winograd.h"
+
+/******************************************************************************
+ * Internals
+ *****************************************************************************/
+
+// The tile loops are compiled for several instruction sets, the best one
+//  being picked when the program is loaded
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define WINOGRAD_CLONES \
+    __attribute__((target_clones("avx512f", "avx2", "default")))
+#define WINOGRAD_INLINE static inline __attribute__((always_inline))
+#else
+#define WINOGRAD_CLONES
+#define WINOGRAD_INLINE static inline
+#endif
+
+/**
+ * Same as winograd_transformRow, inlined with a constant pixel size so that
+ *  the loads of the pixels of every tile get a constant stride.
+ * @see winograd_transformRow
+ */
+WINOGRAD_INLINE void transformRow(const unsigned char *in, int nTiles,
+    int pixelSize, float *restrict h)
+{
+    int t, c, n;
+    float d0, d1, d2, d3;
+    const unsigned char *p;
+    float *restrict h0, *restrict h1, *restrict h2, *restrict h3;
+
+    n = nTiles * pixelSize;
+    for (t = 0; t < nTiles; t++) {
+        p = &(in[2 * t * pixelSize]);
+        h0 = &(h[t * pixelSize]);
+        h1 = &(h[n + t * pixelSize]);
+        h2 = &(h[2 * n + t * pixelSize]);
+        h3 = &(h[3 * n + t * pixelSize]);
+        for (c = 0; c < pixelSize; c++) {
+            d0 = p[c];
+            d1 = p[pixelSize + c];
+            d2 = p[2 * pixelSize + c];
+            d3 = p[3 * pixelSize + c];
+            h0[c] = d0 - d2;
+            h1[c] = d1 + d2;
+            h2[c] = d2 - d1;
+            h3[c] = d1 - d3;
+        }
+    }
+}
+
+/**
+ * Truncates a value towards zero and clamps it to [0, 255].
+ * @param float v The value.
+ * @return unsigned char The byte.
+ */
+WINOGRAD_INLINE unsigned char clampByte(float v)
+{
+    return (v >= 255) ? 255 : (v <= 0) ? 0 : (unsigned char) v;
+}
+
+/**
+ * Same as winograd_storeRow, inlined with a constant pixel size.
+ * @see winograd_storeRow
+ */
+WINOGRAD_INLINE void storeRow(const float *left, const float *right,
+    int width, int pixelSize, unsigned char *restrict out)
+{
+    int t, c;
+    unsigned char *p;
+
+    // Whole tiles
+    for (t = 0; t < width / 2; t++) {
+        p = &(out[2 * t * pixelSize]);
+        for (c = 0; c < pixelSize; c++) {
+            p[c] = clampByte(left[t * pixelSize + c]);
+            p[pixelSize + c] = clampByte(right[t * pixelSize + c]);
+        }
+    }
+
+    // Left half of the last one
+    if (width % 2)
+        for (c = 0; c < pixelSize; c++)
+            out[2 * t * pixelSize + c] = clampByte(left[t * pixelSize + c]);
+}
+
+/******************************************************************************
+ * Transforms
+ *****************************************************************************/
+
+/**
+ * Transforms a 3x3 filter: u = G g G^T.
+ * @param const float *g The filter (3 x 3, row-major), applied as a
+ *  correlation: output (i, j) is the sum of g[a][b] * input (i + a, j + b).
+ * @param float *u Filled with the transformed filter (4 x 4, row-major).
+ */
+void winograd_transformFilter(const float *g, float *u)
+{
+    int i, j, a, b;
+    static const float G[4][3] = {
+        {1, 0, 0},
+        {0.5f, 0.5f, 0.5f},
+        {0.5f, -0.5f, 0.5f},
+        {0, 0, 1}
+    };
+
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 4; j++) {
+            u[i * 4 + j] = 0;
+            for (a = 0; a < 3; a++)
+                for (b = 0; b < 3; b++)
+                    u[i * 4 + j] += G[i][a] * g[a * 3 + b] * G[j][b];
+        }
+}
+
+/**
+ * Transforms an input row along the rows of the tiles: d B, d being the 4
+ *  pixels of every tile (tile t starting at pixel 2t).
+ * @param const unsigned char *in The input row (2 * nTiles + 2 pixels).
+ * @param int nTiles The amount of tiles.
+ * @param int pixelSize The pixel size in bytes.
+ * @param float *h Filled with the 4 transformed values of every tile byte,
+ *  as 4 arrays of nTiles * pixelSize values.
+ */
+WINOGRAD_CLONES
+void winograd_transformRow(const unsigned char *in, int nTiles, int pixelSize,
+    float *h)
+{
+    switch (pixelSize) {
+        case 1:
+            transformRow(in, nTiles, 1, h);
+            break;
+        case 3:
+            transformRow(in, nTiles, 3, h);
+            break;
+        case 4:
+            transformRow(in, nTiles, 4, h);
+            break;
+        default:
+            transformRow(in, nTiles, pixelSize, h);
+    }
+}
+
+/**
+ * Computes a row of tiles from 4 transformed input rows: the transform along
+ *  the columns, the product with the transformed filter and the output
+ *  transform.
+ * @param const float *h0 The first transformed row (see
+ *  winograd_transformRow).
+ * @param const float *h1 The second transformed row.
+ * @param const float *h2 The third transformed row.
+ * @param const float *h3 The fourth transformed row.
+ * @param const float *u The transformed filter.
+ * @param int n The amount of tile bytes (nTiles * pixelSize).
+ * @param float *y Filled with the 4 output values of every tile byte, as 4
+ *  arrays of n values: top left, top right, bottom left and bottom right.
+ */
+WINOGRAD_CLONES
+void winograd_runTiles(const float *restrict h0, const float *restrict h1,
+    const float *restrict h2, const float *restrict h3,
+    const float *restrict u, int n, float *restrict y)
+{
+    int i, j;
+    float w[16], v[4][4], m[4][4], z[2][4];
+    float *restrict out;
+
+    // The filter stays in registers
+    for (j = 0; j < 16; j++)
+        w[j] = u[j];
+
+    out = y;
+    for (i = 0; i < n; i++) {
+        // Transform along the columns (B^T d B), and product
+        for (j = 0; j < 4; j++) {
+            v[0][j] = h0[j * n + i] - h2[j * n + i];
+            v[1][j] = h1[j * n + i] + h2[j * n + i];
+            v[2][j] = h2[j * n + i] - h1[j * n + i];
+            v[3][j] = h1[j * n + i] - h3[j * n + i];
+            m[0][j] = w[j] * v[0][j];
+            m[1][j] = w[4 + j] * v[1][j];
+            m[2][j] = w[8 + j] * v[2][j];
+            m[3][j] = w[12 + j] * v[3][j];
+        }
+
+        // Output transform (A^T m A)
+        for (j = 0; j < 4; j++) {
+            z[0][j] = m[0][j] + m[1][j] + m[2][j];
+            z[1][j] = m[1][j] - m[2][j] - m[3][j];
+        }
+        out[i] = z[0][0] + z[0][1] + z[0][2];
+        out[n + i] = z[0][1] - z[0][2] - z[0][3];
+        out[2 * n + i] = z[1][0] + z[1][1] + z[1][2];
+        out[3 * n + i] = z[1][1] - z[1][2] - z[1][3];
+    }
+}
+
+/**
+ * Stores a row of outputs of the tiles, truncated towards zero and clamped to
+ *  [0, 255].
+ * @param const float *left The left output of every tile byte.
+ * @param const float *right The right output of every tile byte.
+ * @param int width The row width in pixels (2 per tile, the last one of the
+ *  last tile being dropped when it is odd).
+ * @param int pixelSize The pixel size in bytes.
+ * @param unsigned char *out The output row.
+ */
+WINOGRAD_CLONES
+void winograd_storeRow(const float *left, const float *right, int width,
+    int pixelSize, unsigned char *out)
+{
+    switch (pixelSize) {
+        case 1:
+            storeRow(left, right, width, 1, out);
+            break;
+        case 3:
+            storeRow(left, right, width, 3, out);
+            break;
+        case 4:
+            storeRow(left, right, width, 4, out);
+            break;
+        default:
+            storeRow(left, right, width, pixelSize, out);
+    }
+}
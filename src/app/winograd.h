@@ -0,0 +1,73 @@
+/******************************************************************************
+ * NAME:
+ *  winograd.h
+ * DESCRIPTION:
+ *  Winograd minimal filtering F(2x2, 3x3) header file.
+ *****************************************************************************/
+#ifndef _WINOGRAD
+#define _WINOGRAD
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Every tile of 4 x 4 input pixels gives 2 x 2 output pixels, with 16
+//  multiplications instead of 36
+#define WINOGRAD_TILE 2
+#define WINOGRAD_INPUT_TILE 4
+
+/******************************************************************************
+ * Transforms
+ *****************************************************************************/
+
+/**
+ * Transforms a 3x3 filter: u = G g G^T.
+ * @param const float *g The filter (3 x 3, row-major), applied as a
+ *  correlation: output (i, j) is the sum of g[a][b] * input (i + a, j + b).
+ * @param float *u Filled with the transformed filter (4 x 4, row-major).
+ */
+void winograd_transformFilter(const float *g, float *u);
+
+/**
+ * Transforms an input row along the rows of the tiles: d B, d being the 4
+ *  pixels of every tile (tile t starting at pixel 2t).
+ * @param const unsigned char *in The input row (2 * nTiles + 2 pixels).
+ * @param int nTiles The amount of tiles.
+ * @param int pixelSize The pixel size in bytes.
+ * @param float *h Filled with the 4 transformed values of every tile byte,
+ *  as 4 arrays of nTiles * pixelSize values.
+ */
+void winograd_transformRow(const unsigned char *in, int nTiles, int pixelSize,
+    float *h);
+
+/**
+ * Computes a row of tiles from 4 transformed input rows: the transform along
+ *  the columns, the product with the transformed filter and the output
+ *  transform.
+ * @param const float *h0 The first transformed row (see
+ *  winograd_transformRow).
+ * @param const float *h1 The second transformed row.
+ * @param const float *h2 The third transformed row.
+ * @param const float *h3 The fourth transformed row.
+ * @param const float *u The transformed filter.
+ * @param int n The amount of tile bytes (nTiles * pixelSize).
+ * @param float *y Filled with the 4 output values of every tile byte, as 4
+ *  arrays of n values: top left, top right, bottom left and bottom right.
+ */
+void winograd_runTiles(const float *h0, const float *h1, const float *h2,
+    const float *h3, const float *u, int n, float *y);
+
+/**
+ * Stores a row of outputs of the tiles, truncated towards zero and clamped to
+ *  [0, 255].
+ * @param const float *left The left output of every tile byte.
+ * @param const float *right The right output of every tile byte.
+ * @param int width The row width in pixels (2 per tile, the last one of the
+ *  last tile being dropped when it is odd).
+ * @param int pixelSize The pixel size in bytes.
+ * @param unsigned char *out The output row.
+ */
+void winograd_storeRow(const float *left, const float *right, int width,
+    int pixelSize, unsigned char *out);
+
+#endif
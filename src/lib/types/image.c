@@ -10,6 +10,223 @@
 #include <string.h>
 #include <math.h>
 
+/******************************************************************************
+ * Internals
+ *****************************************************************************/
+
+/**
+ * Reads a sample of any type.
+ * @param const unsigned char *data The samples.
+ * @param long idx The sample index.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @return double The value.
+ */
+static inline double getSample(const unsigned char *data, long idx,
+    ImgSampleType sampleType)
+{
+    switch (sampleType) {
+        case IMG_SAMPLE_U16:
+            return ((const unsigned short *) data)[idx];
+        case IMG_SAMPLE_F32:
+            return ((const float *) data)[idx];
+        default:
+            return data[idx];
+    }
+}
+
+/**
+ * Writes a sample of any type, truncated towards zero and clamped to the
+ *  range of integer samples.
+ * @param unsigned char *data The samples.
+ * @param long idx The sample index.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @param double v The value.
+ */
+static inline void setSample(unsigned char *data, long idx,
+    ImgSampleType sampleType, double v)
+{
+    switch (sampleType) {
+        case IMG_SAMPLE_U16:
+            ((unsigned short *) data)[idx] = (v >= 65535) ? 65535
+                : (v <= 0) ? 0 : (unsigned short) v;
+            break;
+        case IMG_SAMPLE_F32:
+            ((float *) data)[idx] = v;
+            break;
+        default:
+            data[idx] = (v >= 255) ? 255 : (v <= 0) ? 0 : (unsigned char) v;
+    }
+}
+
+/**
+ * Splits an interleaved row into the rows of the planes of an image. The
+ *  common pixel sizes get loops with a constant stride, which the compiler
+ *  turns into shuffles.
+ * @param const unsigned char *in The interleaved row.
+ * @param struct image_t *img The planar image.
+ * @param int rowIdx The row index.
+ */
+static void deinterleaveRow(const unsigned char *in, struct image_t *img,
+    int rowIdx)
+{
+    int j, c, size;
+    unsigned char *p0, *p1, *p2, *p3;
+
+    // Wider samples: sample by sample
+    size = img_getSampleSize(img->sampleType);
+    if (size > 1) {
+        for (c = 0; c < img->pixelSize; c++) {
+            p0 = img->rows[c * img->height + rowIdx];
+            for (j = 0; j < img->width; j++)
+                memcpy(&(p0[j * size]),
+                    &(in[(j * img->pixelSize + c) * size]), size);
+        }
+        return;
+    }
+
+    p0 = img->rows[rowIdx];
+    switch (img->pixelSize) {
+        case 1:
+            memcpy(p0, in, img->width);
+            break;
+
+        case 3:
+            p1 = img->rows[img->height + rowIdx];
+            p2 = img->rows[2 * img->height + rowIdx];
+            for (j = 0; j < img->width; j++) {
+                p0[j] = in[3 * j];
+                p1[j] = in[3 * j + 1];
+                p2[j] = in[3 * j + 2];
+            }
+            break;
+
+        case 4:
+            p1 = img->rows[img->height + rowIdx];
+            p2 = img->rows[2 * img->height + rowIdx];
+            p3 = img->rows[3 * img->height + rowIdx];
+            for (j = 0; j < img->width; j++) {
+                p0[j] = in[4 * j];
+                p1[j] = in[4 * j + 1];
+                p2[j] = in[4 * j + 2];
+                p3[j] = in[4 * j + 3];
+            }
+            break;
+
+        default:
+            for (c = 0; c < img->pixelSize; c++) {
+                p0 = img->rows[c * img->height + rowIdx];
+                for (j = 0; j < img->width; j++)
+                    p0[j] = in[j * img->pixelSize + c];
+            }
+    }
+}
+
+/**
+ * Merges the rows of the planes of an image into an interleaved row.
+ * @param struct image_t *img The planar image.
+ * @param int rowIdx The row index.
+ * @param unsigned char *out The interleaved row.
+ */
+static void interleaveRow(struct image_t *img, int rowIdx,
+    unsigned char *out)
+{
+    int j, c, size;
+    const unsigned char *p0, *p1, *p2, *p3;
+
+    // Wider samples: sample by sample
+    size = img_getSampleSize(img->sampleType);
+    if (size > 1) {
+        for (c = 0; c < img->pixelSize; c++) {
+            p0 = img->rows[c * img->height + rowIdx];
+            for (j = 0; j < img->width; j++)
+                memcpy(&(out[(j * img->pixelSize + c) * size]),
+                    &(p0[j * size]), size);
+        }
+        return;
+    }
+
+    p0 = img->rows[rowIdx];
+    switch (img->pixelSize) {
+        case 1:
+            memcpy(out, p0, img->width);
+            break;
+
+        case 3:
+            p1 = img->rows[img->height + rowIdx];
+            p2 = img->rows[2 * img->height + rowIdx];
+            for (j = 0; j < img->width; j++) {
+                out[3 * j] = p0[j];
+                out[3 * j + 1] = p1[j];
+                out[3 * j + 2] = p2[j];
+            }
+            break;
+
+        case 4:
+            p1 = img->rows[img->height + rowIdx];
+            p2 = img->rows[2 * img->height + rowIdx];
+            p3 = img->rows[3 * img->height + rowIdx];
+            for (j = 0; j < img->width; j++) {
+                out[4 * j] = p0[j];
+                out[4 * j + 1] = p1[j];
+                out[4 * j + 2] = p2[j];
+                out[4 * j + 3] = p3[j];
+            }
+            break;
+
+        default:
+            for (c = 0; c < img->pixelSize; c++) {
+                p0 = img->rows[c * img->height + rowIdx];
+                for (j = 0; j < img->width; j++)
+                    out[j * img->pixelSize + c] = p0[j];
+            }
+    }
+}
+
+/**
+ * Fills a padded strip of an interleaved image (see img_makePadded).
+ * @param struct image_t *img The image.
+ * @param int offsetRowIdx The first row of the strip.
+ * @param int padding The amount of ghost pixels on each side.
+ * @param ImgBorderMode mode How the ghost pixels outside the image are made
+ *  up.
+ * @param struct image_t *padded The zero filled padded strip.
+ */
+static void copyPadded(struct image_t *img, int offsetRowIdx, int padding,
+    ImgBorderMode mode, struct image_t *padded)
+{
+    int i, j, inRowIdx, inPixelIdx;
+    int pixelSize = img->pixelSize * img_getSampleSize(img->sampleType);
+
+    // Copy rows, left and right ghost pixels
+    for (i = 0; i < padded->height; i++) {
+        inRowIdx = img_getBorderIndex(offsetRowIdx - padding + i, img->height,
+            mode);
+        if (inRowIdx < 0)
+            continue;
+        memcpy(
+            padded->rows[i] + pixelSize * padding,
+            img->rows[inRowIdx],
+            pixelSize * img->width
+        );
+        for (j = 0; j < padding; j++) {
+            inPixelIdx = img_getBorderIndex(j - padding, img->width, mode);
+            if (inPixelIdx >= 0)
+                memcpy(
+                    padded->rows[i] + pixelSize * j,
+                    img->rows[inRowIdx] + pixelSize * inPixelIdx,
+                    pixelSize
+                );
+            inPixelIdx = img_getBorderIndex(img->width + j, img->width, mode);
+            if (inPixelIdx >= 0)
+                memcpy(
+                    padded->rows[i] + pixelSize * (padding + img->width + j),
+                    img->rows[inRowIdx] + pixelSize * inPixelIdx,
+                    pixelSize
+                );
+        }
+    }
+}
+
 /******************************************************************************
  * Creation / destruction
  *****************************************************************************/
@@ -24,7 +241,37 @@
  */
 struct image_t* img_make(int width, int height, int pixelSize)
 {
-    int i, j;
+    return img_makeWithLayout(width, height, pixelSize,
+        IMG_LAYOUT_INTERLEAVED);
+}
+
+/**
+ * Creates an empty image with a given layout.
+ * @param int width Width in pixels.
+ * @param int height Height in pixels.
+ * @param int pixelSize The size of a pixel in number of bytes.
+ * @param ImgLayout layout The layout of the data.
+ * @return struct image_t* The image or NULL.
+ */
+struct image_t* img_makeWithLayout(int width, int height, int pixelSize,
+    ImgLayout layout)
+{
+    return img_makeWithType(width, height, pixelSize, layout, IMG_SAMPLE_U8);
+}
+
+/**
+ * Creates an empty image with a given layout and sample type.
+ * @param int width Width in pixels.
+ * @param int height Height in pixels.
+ * @param int pixelSize The amount of samples of a pixel.
+ * @param ImgLayout layout The layout of the data.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @return struct image_t* The image or NULL.
+ */
+struct image_t* img_makeWithType(int width, int height, int pixelSize,
+    ImgLayout layout, ImgSampleType sampleType)
+{
+    int i, j, nRows, rowSize, sampleSize;
     struct image_t *retVal;
 
     // Allocate space
@@ -35,26 +282,37 @@ struct image_t* img_make(int width, int height, int pixelSize)
     retVal->height = height;
     retVal->width = width;
     retVal->pixelSize = pixelSize;
+    retVal->layout = layout;
+    retVal->sampleType = sampleType;
+    sampleSize = img_getSampleSize(sampleType);
 
     // Allocate space for the data
-    retVal->data = malloc(sizeof(unsigned char*) * height * width * pixelSize);
+    retVal->data = malloc(sizeof(unsigned char) * height * width * pixelSize
+        * sampleSize);
     if (retVal->data == NULL) {
         free(retVal);
         return NULL;
     }
 
-    // Align data into rows
-    retVal->rows = malloc(sizeof(unsigned char*) * height);
+    // Align data into rows (of every plane)
+    if (layout == IMG_LAYOUT_PLANAR) {
+        nRows = height * pixelSize;
+        rowSize = width * sampleSize;
+    } else {
+        nRows = height;
+        rowSize = width * pixelSize * sampleSize;
+    }
+    retVal->rows = malloc(sizeof(unsigned char*) * nRows);
     if (retVal->rows == NULL) {
         free(retVal->data);
         free(retVal);
         return NULL;
     }
-    for (i = 0; i < height; i++) {
-        retVal->rows[i] = &(retVal->data[i * width * pixelSize]);
+    for (i = 0; i < nRows; i++) {
+        retVal->rows[i] = &(retVal->data[i * rowSize]);
 
         // Initialize
-        for (j = 0; j < pixelSize * width; j++)
+        for (j = 0; j < rowSize; j++)
             retVal->rows[i][j] = 0;
     }
 
@@ -77,51 +335,255 @@ void img_destroy(struct image_t *img)
  *****************************************************************************/
 
 /**
- * Creates an image from a file.
+ * Creates an image from a file. The file is always interleaved: planar images
+ *  are deinterleaved row by row while reading. The samples are raw, in the
+ *  native byte order.
  * @param FILE *file The input file.
  * @param int width Width in pixels.
  * @param int height Height in pixels.
- * @param int pixelSize The size of a pixel in number of bytes.
+ * @param int pixelSize The amount of samples of a pixel.
+ * @param ImgLayout layout The layout of the image.
+ * @param ImgSampleType sampleType The type of the samples of the file.
  * @return struct image_t* The image or NULL.
  */
 struct image_t* img_makeFromFile(FILE *file, int width, int height,
-    int pixelSize)
+    int pixelSize, ImgLayout layout, ImgSampleType sampleType)
 {
     struct image_t *img;
-    int i;
+    unsigned char *buffer;
+    int i, size;
 
     // Make image
-    img = img_make(width, height, pixelSize);
+    img = img_makeWithType(width, height, pixelSize, layout, sampleType);
     if (img == NULL) {
         return NULL;
     }
 
+    // Row buffer of planar images
+    buffer = NULL;
+    size = pixelSize * img_getSampleSize(sampleType);
+    if (layout == IMG_LAYOUT_PLANAR) {
+        buffer = malloc(width * size);
+        if (buffer == NULL) {
+            img_destroy(img);
+            return NULL;
+        }
+    }
+
     // Read file
     for (i = 0; i < img->height; i++) {
-        if (fread(img->rows[i], pixelSize, img->width, file) !=
-            (size_t) img->width) {
+        if (fread((buffer != NULL) ? buffer : img->rows[i], size,
+            img->width, file) != (size_t) img->width) {
+            free(buffer);
             img_destroy(img);
             return NULL;
         }
+        if (buffer != NULL)
+            deinterleaveRow(buffer, img, i);
     }
 
-
+    free(buffer);
     return img;
 }
 
 /**
- * Writes an image.
+ * Writes an image. Planar images are interleaved row by row while writing,
+ *  and the samples are written as they are (see img_convertType).
  * @param struct image_t* img The image.
  * @param FILE *file The output file.
  */
 void img_writeToFile(struct image_t *img, FILE *file)
 {
-    int i;
+    int i, size;
+    unsigned char *buffer;
+
+    // Interleaved images are written as they are
+    size = img->pixelSize * img_getSampleSize(img->sampleType);
+    if (img->layout != IMG_LAYOUT_PLANAR) {
+        for (i = 0; i < img->height; i++) {
+            fwrite(img->rows[i], size, img->width, file);
+        }
+        return;
+    }
 
     // Write file
+    buffer = malloc(img->width * size);
+    if (buffer == NULL)
+        return;
     for (i = 0; i < img->height; i++) {
-        fwrite(img->rows[i], img->pixelSize, img->width, file);
+        interleaveRow(img, i, buffer);
+        fwrite(buffer, size, img->width, file);
     }
+    free(buffer);
+}
+
+/******************************************************************************
+ * Layout
+ *****************************************************************************/
+
+/**
+ * Copies an image into another layout, in a single pass over the data.
+ * @param struct image_t *img The image.
+ * @param ImgLayout layout The layout of the copy.
+ * @return struct image_t* The copy or NULL.
+ */
+struct image_t* img_convertLayout(struct image_t *img, ImgLayout layout)
+{
+    int i;
+    struct image_t *retVal;
+
+    // Make new image
+    retVal = img_makeWithType(img->width, img->height, img->pixelSize,
+        layout, img->sampleType);
+    if (retVal == NULL) {
+        return NULL;
+    }
+
+    // Copy, (de)interleaving the rows on the way
+    if (img->layout == layout)
+        memcpy(retVal->data, img->data, (size_t) img->height * img->width
+            * img->pixelSize * img_getSampleSize(img->sampleType));
+    else if (layout == IMG_LAYOUT_PLANAR)
+        for (i = 0; i < img->height; i++)
+            deinterleaveRow(img->rows[i], retVal, i);
+    else
+        for (i = 0; i < img->height; i++)
+            interleaveRow(img, i, retVal->rows[i]);
+
+    return retVal;
+}
+
+/**
+ * Makes a view of a channel of a planar image, i.e. an interleaved image of
+ *  single sample pixels sharing the data of the plane. The view is filled in
+ *  place and must not be destroyed.
+ * @param struct image_t *img The planar image.
+ * @param int channel The channel.
+ * @param struct image_t *plane The view to fill.
+ */
+void img_getPlane(struct image_t *img, int channel, struct image_t *plane)
+{
+    plane->width = img->width;
+    plane->height = img->height;
+    plane->pixelSize = 1;
+    plane->layout = IMG_LAYOUT_INTERLEAVED;
+    plane->sampleType = img->sampleType;
+    plane->data = &(img->data[(size_t) channel * img->height * img->width
+        * img_getSampleSize(img->sampleType)]);
+    plane->rows = &(img->rows[channel * img->height]);
+}
+
+/**
+ * Merges images of the same size into a single one, whose pixels are made of
+ *  the channels of the pixels of every image, one image after the other
+ *  (e.g. two rgb images make rgbrgb pixels).
+ * @param struct image_t **imgs The images (same size, layout and sample
+ *  type).
+ * @param int amount The amount of images.
+ * @return struct image_t* The merged image, with the layout of the images,
+ *  or NULL.
+ */
+struct image_t* img_merge(struct image_t **imgs, int amount)
+{
+    int i, j, k, pixelSize, offset, size;
+    struct image_t *retVal;
+
+    // Check params
+    if (amount <= 0) return NULL;
+    pixelSize = 0;
+    for (k = 0; k < amount; k++) {
+        if (imgs[k]->width != imgs[0]->width
+            || imgs[k]->height != imgs[0]->height
+            || imgs[k]->layout != imgs[0]->layout
+            || imgs[k]->sampleType != imgs[0]->sampleType) return NULL;
+        pixelSize += imgs[k]->pixelSize;
+    }
+
+    // Make new image (sizes in bytes from now on)
+    retVal = img_makeWithType(imgs[0]->width, imgs[0]->height, pixelSize,
+        imgs[0]->layout, imgs[0]->sampleType);
+    if (retVal == NULL) {
+        return NULL;
+    }
+    size = img_getSampleSize(retVal->sampleType);
+    pixelSize *= size;
+
+    // Planar images: the planes of every image, one after the other
+    if (retVal->layout == IMG_LAYOUT_PLANAR) {
+        offset = 0;
+        for (k = 0; k < amount; k++) {
+            memcpy(&(retVal->data[offset]), imgs[k]->data,
+                imgs[k]->height * imgs[k]->width * imgs[k]->pixelSize * size);
+            offset += imgs[k]->height * imgs[k]->width * imgs[k]->pixelSize
+                * size;
+        }
+        return retVal;
+    }
+
+    // Interleaved images: pixel by pixel
+    for (i = 0; i < retVal->height; i++) {
+        offset = 0;
+        for (k = 0; k < amount; k++) {
+            for (j = 0; j < retVal->width; j++)
+                memcpy(&(retVal->rows[i][j * pixelSize + offset]),
+                    &(imgs[k]->rows[i][j * imgs[k]->pixelSize * size]),
+                    imgs[k]->pixelSize * size);
+            offset += imgs[k]->pixelSize * size;
+        }
+    }
+
+    return retVal;
+}
+
+/******************************************************************************
+ * Samples
+ *****************************************************************************/
+
+/**
+ * Returns the size of a sample.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @return int The size in bytes.
+ */
+int img_getSampleSize(ImgSampleType sampleType)
+{
+    switch (sampleType) {
+        case IMG_SAMPLE_U16:
+            return sizeof(unsigned short);
+        case IMG_SAMPLE_F32:
+            return sizeof(float);
+        default:
+            return 1;
+    }
+}
+
+/**
+ * Copies an image with another sample type, in a single pass over the data.
+ *  Integer samples keep their value, and the values that do not fit them
+ *  are truncated towards zero and clamped (as the convolution does).
+ * @param struct image_t *img The image.
+ * @param ImgSampleType sampleType The type of the samples of the copy.
+ * @return struct image_t* The copy, with the layout of the image, or NULL.
+ */
+struct image_t* img_convertType(struct image_t *img,
+    ImgSampleType sampleType)
+{
+    long idx, n;
+    struct image_t *retVal;
+
+    // Make new image
+    retVal = img_makeWithType(img->width, img->height, img->pixelSize,
+        img->layout, sampleType);
+    if (retVal == NULL) {
+        return NULL;
+    }
+
+    // Same layout: the samples are in the same order
+    n = (long) img->height * img->width * img->pixelSize;
+    for (idx = 0; idx < n; idx++)
+        setSample(retVal->data, idx, sampleType,
+            getSample(img->data, idx, img->sampleType));
+
+    return retVal;
 }
 
 /******************************************************************************
@@ -140,32 +602,159 @@ void img_writeToFile(struct image_t *img, FILE *file)
 struct image_t* img_crop(struct image_t *img, int width, int height,
     int widthOffset, int heightOffset)
 {
-    int i, newI;
+    int i, c, newI, size;
     struct image_t *retVal;
+    struct image_t inPlane, outPlane;
 
     // Check params
     if (widthOffset + width > img->width
         || heightOffset + height > img->height) return NULL;
 
     // Make new image
-    retVal = img_make(width, height, img->pixelSize);
+    retVal = img_makeWithType(width, height, img->pixelSize, img->layout,
+        img->sampleType);
     if (retVal == NULL) {
         return NULL;
     }
+    size = img_getSampleSize(img->sampleType);
+
+    // Planar images are cropped plane by plane
+    if (img->layout == IMG_LAYOUT_PLANAR) {
+        for (c = 0; c < img->pixelSize; c++) {
+            img_getPlane(img, c, &inPlane);
+            img_getPlane(retVal, c, &outPlane);
+            for (i = 0; i < height; i++)
+                memcpy(outPlane.rows[i],
+                    inPlane.rows[heightOffset + i] + widthOffset * size,
+                    width * size);
+        }
+        return retVal;
+    }
 
     // Read from old image
     newI = 0;
     for (i = heightOffset; i < heightOffset + height; i++) {
         memcpy(
             retVal->rows[newI++],
-            img->rows[i] + (img->pixelSize * widthOffset),
-            img->pixelSize * width
+            img->rows[i] + (img->pixelSize * size * widthOffset),
+            img->pixelSize * size * width
         );
     }
 
     return retVal;
 }
 
+/**
+ * Copies a block of an image into another image of the same layout and
+ *  sample type, at any place.
+ * @param struct image_t *src The source image.
+ * @param int srcRowIdx The first row of the block in the source image.
+ * @param int srcColIdx The first column of the block in the source image.
+ * @param struct image_t *dst The destination image.
+ * @param int dstRowIdx The first row of the block in the destination image.
+ * @param int dstColIdx The first column of the block in the destination
+ *  image.
+ * @param int rows The amount of rows of the block.
+ * @param int cols The amount of columns of the block.
+ */
+void img_copyBlock(struct image_t *src, int srcRowIdx, int srcColIdx,
+    struct image_t *dst, int dstRowIdx, int dstColIdx, int rows, int cols)
+{
+    int i, c, planes, pixelBytes;
+
+    // Planes of rows (a single plane for interleaved images)
+    planes = (src->layout == IMG_LAYOUT_PLANAR) ? src->pixelSize : 1;
+    pixelBytes = img_getSampleSize(src->sampleType) * src->pixelSize / planes;
+    for (c = 0; c < planes; c++)
+        for (i = 0; i < rows; i++)
+            memcpy(dst->rows[c * dst->height + dstRowIdx + i]
+                + dstColIdx * pixelBytes,
+                src->rows[c * src->height + srcRowIdx + i]
+                + srcColIdx * pixelBytes, cols * pixelBytes);
+}
+
+/**
+ * Maps a (row or pixel) index that may be outside the image to the index of
+ *  the pixel it mirrors, repeats or wraps to.
+ * @param int idx The index.
+ * @param int size The image size along that dimension.
+ * @param ImgBorderMode mode The border mode.
+ * @return int The index inside the image or -1 for a zero pixel.
+ */
+int img_getBorderIndex(int idx, int size, ImgBorderMode mode)
+{
+    int period;
+
+    // Inside
+    if (idx >= 0 && idx < size)
+        return idx;
+
+    switch (mode) {
+        case IMG_BORDER_CLAMP:
+            return (idx < 0) ? 0 : size - 1;
+
+        case IMG_BORDER_MIRROR:
+            // Reflect without repeating the edge pixel
+            period = 2 * (size - 1);
+            if (period == 0)
+                return 0;
+            idx = ((idx % period) + period) % period;
+            return (idx < size) ? idx : period - idx;
+
+        case IMG_BORDER_WRAP:
+            return ((idx % size) + size) % size;
+
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Copies a horizontal strip of an image, padded with ghost pixels on all
+ *  sides, so that it can be read up to `padding` pixels out of its bounds
+ *  without any checks.
+ * @param struct image_t *img The image.
+ * @param int offsetRowIdx The first row of the strip.
+ * @param int limit The amount of rows of the strip.
+ * @param int padding The amount of ghost pixels on each side.
+ * @param ImgBorderMode mode How the ghost pixels outside the image are made
+ *  up. The ones inside the image (above and below the strip) are copied.
+ * @return struct image_t* The padded strip (row 0 is strip row -padding) or
+ *  NULL.
+ */
+struct image_t* img_makePadded(struct image_t *img, int offsetRowIdx,
+    int limit, int padding, ImgBorderMode mode)
+{
+    int c;
+    struct image_t *retVal;
+    struct image_t inPlane, outPlane;
+
+    // Check params
+    if (offsetRowIdx + limit > img->height)
+        limit = img->height - offsetRowIdx;
+    if (limit < 0)
+        limit = 0;
+
+    // Make new image (zero filled)
+    retVal = img_makeWithType(img->width + 2 * padding,
+        limit + 2 * padding, img->pixelSize, img->layout, img->sampleType);
+    if (retVal == NULL) {
+        return NULL;
+    }
+
+    // Copy (plane by plane)
+    if (img->layout == IMG_LAYOUT_PLANAR)
+        for (c = 0; c < img->pixelSize; c++) {
+            img_getPlane(img, c, &inPlane);
+            img_getPlane(retVal, c, &outPlane);
+            copyPadded(&inPlane, offsetRowIdx, padding, mode, &outPlane);
+        }
+    else
+        copyPadded(img, offsetRowIdx, padding, mode, retVal);
+
+    return retVal;
+}
+
 /******************************************************************************
  * Distance
  *****************************************************************************/
@@ -179,25 +768,56 @@ struct image_t* img_crop(struct image_t *img, int width, int height,
 double img_getDistance(struct image_t *imgA, struct image_t *imgB)
 {
     int i, j, k;
-    double retVal;
+    long idx, n;
+    double diff, retVal;
+    struct image_t *converted;
 
     // Check images properties are the same
     if (imgA->width != imgB->width || imgA->height != imgB->height
-        || imgA->pixelSize != imgB->pixelSize)
+        || imgA->pixelSize != imgB->pixelSize
+        || imgA->sampleType != imgB->sampleType)
         return -1;
 
-    // Go through all bytes
+    // Wider samples: in the same order once in the same layout
     retVal = 0.0;
+    if (imgA->sampleType != IMG_SAMPLE_U8) {
+        converted = NULL;
+        if (imgA->layout != imgB->layout) {
+            converted = img_convertLayout(imgB, imgA->layout);
+            if (converted == NULL)
+                return -1;
+            imgB = converted;
+        }
+        n = (long) imgA->height * imgA->width * imgA->pixelSize;
+        for (idx = 0; idx < n; idx++) {
+            diff = getSample(imgA->data, idx, imgA->sampleType)
+                - getSample(imgB->data, idx, imgB->sampleType);
+            retVal += diff * diff;
+        }
+        if (converted != NULL)
+            img_destroy(converted);
+        return sqrt(retVal);
+    }
+
+    // Same layout: the bytes are in the same order
+    if (imgA->layout == imgB->layout) {
+        n = (long) imgA->height * imgA->width * imgA->pixelSize;
+        for (idx = 0; idx < n; idx++) {
+            diff = imgA->data[idx] - imgB->data[idx];
+            retVal += diff * diff;
+        }
+        return sqrt(retVal);
+    }
+
+    // Go through all bytes
     for (i = 0; i < imgA->height; i++)
         for (j = 0; j < imgA->width; j++)
-            for (k = 0; k < imgA->pixelSize; k++)
-                retVal += pow(
-                    imgA->rows[i][j * imgA->pixelSize + k]
-                    - imgB->rows[i][j * imgA->pixelSize + k],
-                    2
-                );
+            for (k = 0; k < imgA->pixelSize; k++) {
+                diff = IMG_GET_PIXEL_BYTE(imgA, i, j, k)
+                    - IMG_GET_PIXEL_BYTE(imgB, i, j, k);
+                retVal += diff * diff;
+            }
 
     // Return
     return sqrt(retVal);
 }
-
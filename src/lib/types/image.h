@@ -13,28 +13,57 @@
  * Data structures
  *****************************************************************************/
 
+typedef enum {              // How the bytes of the pixels are stored
+    IMG_LAYOUT_INTERLEAVED = 0, // Pixel by pixel (rgbrgb...)
+    IMG_LAYOUT_PLANAR = 1   // One contiguous plane per channel (rr..gg..bb..)
+} ImgLayout;
+
+typedef enum {              // Type of the samples (channels of the pixels)
+    IMG_SAMPLE_U8 = 0,      // Unsigned 8-bit integers
+    IMG_SAMPLE_U16 = 1,     // Unsigned 16-bit integers (native byte order)
+    IMG_SAMPLE_F32 = 2      // Single precision floats
+} ImgSampleType;
+
 struct image_t {            // Image
     int width;
     int height;
+    // Samples per pixel (i.e. bytes for 8-bit samples)
     int pixelSize;
+    ImgLayout layout;
+    ImgSampleType sampleType;
     // Data
     unsigned char *data;
-    // Data aligned as rows
+    // Data aligned as rows. Planar images have the rows of every plane, one
+    //  plane after the other (row i of channel c is rows[c * height + i]).
+    //  Rows of wider samples are cast to their type.
     unsigned char **rows;
 };
 
+typedef enum {              // How pixels outside the image are made up
+    IMG_BORDER_ZERO = 0,    // All zero
+    IMG_BORDER_CLAMP = 1,   // Repeat the edge pixel (aaa|abc)
+    IMG_BORDER_MIRROR = 2,  // Reflect around the edge pixel (cb|abc)
+    IMG_BORDER_WRAP = 3     // Wrap around to the opposite edge (bc|abc)
+} ImgBorderMode;
+
 /******************************************************************************
  * Macros
  *****************************************************************************/
 
+// Pixel pointers only make sense for interleaved images, the byte macros
+//  work with both layouts (8-bit samples only)
 #define IMG_GET_PIXEL_PTR(img, height, width) \
     &(img->rows[height][width * img->pixelSize])
+#define IMG_GET_BYTE_PTR(img, rowIdx, pixelIdx, i) \
+    ((img)->layout == IMG_LAYOUT_PLANAR \
+        ? &((img)->rows[(i) * (img)->height + (rowIdx)][pixelIdx]) \
+        : &((img)->rows[rowIdx][(pixelIdx) * (img)->pixelSize + (i)]))
 #define IMG_GET_PIXEL_BYTE(img, height, width, i) \
-    img->rows[height][width * img->pixelSize + i]
+    (*IMG_GET_BYTE_PTR(img, height, width, i))
 #define IMG_SET_PIXEL_BYTE(img, height, width, i, newVal) \
-    img->rows[height][width * img->pixelSize + i] = newVal
+    (*IMG_GET_BYTE_PTR(img, height, width, i) = newVal)
 #define IMG_APPEND_PIXEL_BYTE(img, height, width, i, newVal) \
-    img->rows[height][width * img->pixelSize + i] += newVal
+    (*IMG_GET_BYTE_PTR(img, height, width, i) += newVal)
 
 /******************************************************************************
  * Creation / destruction
@@ -50,6 +79,29 @@ struct image_t {            // Image
  */
 struct image_t* img_make(int width, int height, int pixelSize);
 
+/**
+ * Creates an empty image with a given layout.
+ * @param int width Width in pixels.
+ * @param int height Height in pixels.
+ * @param int pixelSize The size of a pixel in number of bytes.
+ * @param ImgLayout layout The layout of the data.
+ * @return struct image_t* The image or NULL.
+ */
+struct image_t* img_makeWithLayout(int width, int height, int pixelSize,
+    ImgLayout layout);
+
+/**
+ * Creates an empty image with a given layout and sample type.
+ * @param int width Width in pixels.
+ * @param int height Height in pixels.
+ * @param int pixelSize The amount of samples of a pixel.
+ * @param ImgLayout layout The layout of the data.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @return struct image_t* The image or NULL.
+ */
+struct image_t* img_makeWithType(int width, int height, int pixelSize,
+    ImgLayout layout, ImgSampleType sampleType);
+
 /**
  * Destroys an image.
  * @param struct image_t* img The image to destroy.
@@ -61,23 +113,84 @@ void img_destroy(struct image_t *img);
  *****************************************************************************/
 
 /**
- * Creates an image from a file.
+ * Creates an image from a file. The file is always interleaved: planar images
+ *  are deinterleaved row by row while reading. The samples are raw, in the
+ *  native byte order.
  * @param FILE *file The input file.
  * @param int width Width in pixels.
  * @param int height Height in pixels.
- * @param int pixelSize The size of a pixel in number of bytes.
+ * @param int pixelSize The amount of samples of a pixel.
+ * @param ImgLayout layout The layout of the image.
+ * @param ImgSampleType sampleType The type of the samples of the file.
  * @return struct image_t* The image or NULL.
  */
 struct image_t* img_makeFromFile(FILE *file, int width, int height,
-    int pixelSize);
+    int pixelSize, ImgLayout layout, ImgSampleType sampleType);
 
 /**
- * Writes an image.
+ * Writes an image. Planar images are interleaved row by row while writing,
+ *  and the samples are written as they are (see img_convertType).
  * @param struct image_t* img The image.
  * @param FILE *file The output file.
  */
 void img_writeToFile(struct image_t *img, FILE *file);
 
+/******************************************************************************
+ * Layout
+ *****************************************************************************/
+
+/**
+ * Copies an image into another layout, in a single pass over the data.
+ * @param struct image_t *img The image.
+ * @param ImgLayout layout The layout of the copy.
+ * @return struct image_t* The copy or NULL.
+ */
+struct image_t* img_convertLayout(struct image_t *img, ImgLayout layout);
+
+/**
+ * Makes a view of a channel of a planar image, i.e. an interleaved image of
+ *  single sample pixels sharing the data of the plane. The view is filled in
+ *  place and must not be destroyed.
+ * @param struct image_t *img The planar image.
+ * @param int channel The channel.
+ * @param struct image_t *plane The view to fill.
+ */
+void img_getPlane(struct image_t *img, int channel, struct image_t *plane);
+
+/**
+ * Merges images of the same size into a single one, whose pixels are made of
+ *  the channels of the pixels of every image, one image after the other
+ *  (e.g. two rgb images make rgbrgb pixels).
+ * @param struct image_t **imgs The images (same size, layout and sample
+ *  type).
+ * @param int amount The amount of images.
+ * @return struct image_t* The merged image, with the layout of the images,
+ *  or NULL.
+ */
+struct image_t* img_merge(struct image_t **imgs, int amount);
+
+/******************************************************************************
+ * Samples
+ *****************************************************************************/
+
+/**
+ * Returns the size of a sample.
+ * @param ImgSampleType sampleType The type of the samples.
+ * @return int The size in bytes.
+ */
+int img_getSampleSize(ImgSampleType sampleType);
+
+/**
+ * Copies an image with another sample type, in a single pass over the data.
+ *  Integer samples keep their value, and the values that do not fit them
+ *  are truncated towards zero and clamped (as the convolution does).
+ * @param struct image_t *img The image.
+ * @param ImgSampleType sampleType The type of the samples of the copy.
+ * @return struct image_t* The copy, with the layout of the image, or NULL.
+ */
+struct image_t* img_convertType(struct image_t *img,
+    ImgSampleType sampleType);
+
 /******************************************************************************
  * Operations
  *****************************************************************************/
@@ -94,6 +207,48 @@ void img_writeToFile(struct image_t *img, FILE *file);
 struct image_t* img_crop(struct image_t *img, int width, int height,
     int widthOffset, int heightOffset);
 
+/**
+ * Copies a block of an image into another image of the same layout and
+ *  sample type, at any place.
+ * @param struct image_t *src The source image.
+ * @param int srcRowIdx The first row of the block in the source image.
+ * @param int srcColIdx The first column of the block in the source image.
+ * @param struct image_t *dst The destination image.
+ * @param int dstRowIdx The first row of the block in the destination image.
+ * @param int dstColIdx The first column of the block in the destination
+ *  image.
+ * @param int rows The amount of rows of the block.
+ * @param int cols The amount of columns of the block.
+ */
+void img_copyBlock(struct image_t *src, int srcRowIdx, int srcColIdx,
+    struct image_t *dst, int dstRowIdx, int dstColIdx, int rows, int cols);
+
+/**
+ * Maps a (row or pixel) index that may be outside the image to the index of
+ *  the pixel it mirrors, repeats or wraps to.
+ * @param int idx The index.
+ * @param int size The image size along that dimension.
+ * @param ImgBorderMode mode The border mode.
+ * @return int The index inside the image or -1 for a zero pixel.
+ */
+int img_getBorderIndex(int idx, int size, ImgBorderMode mode);
+
+/**
+ * Copies a horizontal strip of an image, padded with ghost pixels on all
+ *  sides, so that it can be read up to `padding` pixels out of its bounds
+ *  without any checks.
+ * @param struct image_t *img The image.
+ * @param int offsetRowIdx The first row of the strip.
+ * @param int limit The amount of rows of the strip.
+ * @param int padding The amount of ghost pixels on each side.
+ * @param ImgBorderMode mode How the ghost pixels outside the image are made
+ *  up. The ones inside the image (above and below the strip) are copied.
+ * @return struct image_t* The padded strip (row 0 is strip row -padding),
+ *  with the layout of the image, or NULL.
+ */
+struct image_t* img_makePadded(struct image_t *img, int offsetRowIdx,
+    int limit, int padding, ImgBorderMode mode);
+
 /******************************************************************************
  * Distance
  *****************************************************************************/
@@ -101,7 +256,7 @@ struct image_t* img_crop(struct image_t *img, int width, int height,
 /**
  * Gets the Euclidean distance between two images.
  * @param struct image_t *imgA The image.
- * @param struct image_t *imgB The image.
+ * @param struct image_t *imgB The image (same sample type).
  * @return double The distance or -1 in case of error.
  */
 double img_getDistance(struct image_t *imgA, struct image_t *imgB);
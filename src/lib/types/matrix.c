@@ -30,24 +30,21 @@ struct matrix_t *mat_make(int width, int height)
     retVal->height = height;
     retVal->width = width;
 
-    // Allocate space for the filter values
-    // Not optimal!
-    retVal->values = malloc(sizeof(double*) * retVal->height);
+    // Allocate space for the filter values: a single block, row after row
+    //  (values[0] is the whole matrix), and the rows pointing into it
+    retVal->values = malloc(sizeof(double*) * (height > 0 ? height : 1));
     if (retVal->values == NULL) {
         free(retVal);
         return NULL;
     }
-    for (i = 0; i < retVal->height; i++) {
-        retVal->values[i] = malloc(sizeof(double) * retVal->width);
-        if (retVal->values[i] == NULL) {
-            for (i -= 1; i >= 0; i--) {
-                free(retVal->values[i]);
-            }
-            free(retVal->values);
-            free(retVal);
-            return NULL;
-        }
+    retVal->values[0] = malloc(sizeof(double) * width * height);
+    if (retVal->values[0] == NULL && width * height > 0) {
+        free(retVal->values);
+        free(retVal);
+        return NULL;
     }
+    for (i = 1; i < retVal->height; i++)
+        retVal->values[i] = retVal->values[0] + i * width;
 
     return retVal;
 }
@@ -58,11 +55,7 @@ struct matrix_t *mat_make(int width, int height)
  */
 void mat_destroy(struct matrix_t *mat)
 {
-    int i;
-
-    for (i = 0; i < mat->height; i++) {
-        free(mat->values[i]);
-    }
+    free(mat->values[0]);
     free(mat->values);
     free(mat);
 }
@@ -72,9 +65,10 @@ void mat_destroy(struct matrix_t *mat)
  *****************************************************************************/
 
 /**
- * Creates a matrix from a file.
+ * Creates a matrix from a file. A blank line after its rows ends the matrix,
+ *  so that a file may hold several matrices, read by successive calls.
  * @param FILE *file The input file.
- * @return struct matrix_t* The matrix or NULL.
+ * @return struct matrix_t* The matrix or NULL (e.g. at the end of the file).
  */
 struct matrix_t* mat_makeFromFile(FILE *file)
 {
@@ -104,10 +98,17 @@ struct matrix_t* mat_makeFromFile(FILE *file)
             }
             value = strtok(NULL, " \t");
         }
+        if (rowSize == 0 && rowsAmt > 0) break;
         if (rowSize > maxRowSize) maxRowSize = rowSize;
         if (rowSize > 0) rowsAmt++;
     }
 
+    // Nothing left
+    if (rowsAmt == 0) {
+        free(vList);
+        return NULL;
+    }
+
     // Allocate matrix
     retVal = mat_make(maxRowSize, rowsAmt);
     if (retVal == NULL) {
@@ -16,6 +16,7 @@
 struct matrix_t {           // A matrix
     int width;
     int height;
+    // Rows of the values, which are contiguous (values[0] holds them all)
     double **values;
 };
 
@@ -42,9 +43,10 @@ void mat_destroy(struct matrix_t *mat);
  *****************************************************************************/
 
 /**
- * Creates a matrix from a file.
+ * Creates a matrix from a file. A blank line after its rows ends the matrix,
+ *  so that a file may hold several matrices, read by successive calls.
  * @param FILE *file The input file.
- * @return struct matrix_t* The matrix or NULL.
+ * @return struct matrix_t* The matrix or NULL (e.g. at the end of the file).
  */
 struct matrix_t* mat_makeFromFile(FILE *file);
 
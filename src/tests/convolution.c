@@ -1,11 +1,1255 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <types/matrix.h>
 #include <types/image.h>
 #include "../app/convolution.h"
+#include "../app/simd.h"
+#include "../app/jit.h"
+#include "../app/timer.h"
+
+/*******************************************************************************
+ * Helpers
+ ******************************************************************************/
+
+static struct image_t* makeSyntheticImage(int width, int height, int pixelSize)
+{
+    int i, j;
+    struct image_t *img;
+
+    img = img_make(width, height, pixelSize);
+    if (img == NULL)
+        return NULL;
+    srand(42);
+    for (i = 0; i < img->height; i++)
+        for (j = 0; j < img->width * img->pixelSize; j++)
+            img->rows[i][j] = rand() % 256;
+
+    return img;
+}
+
+static int getMaxDifference(struct image_t *imgA, struct image_t *imgB)
+{
+    int i, j, diff, retVal;
+
+    retVal = 0;
+    for (i = 0; i < imgA->height; i++)
+        for (j = 0; j < imgA->width * imgA->pixelSize; j++) {
+            diff = abs(imgA->rows[i][j] - imgB->rows[i][j]);
+            if (diff > retVal)
+                retVal = diff;
+        }
+
+    return retVal;
+}
+
+static void convolveReference(struct image_t *img, struct matrix_t *mat,
+    ImgBorderMode mode, struct image_t *outImg)
+{
+    int i, j, c, p, q, s, inI, inJ;
+    double acc;
+
+    s = (mat->width - 1) / 2;
+    for (i = 0; i < img->height; i++)
+        for (j = 0; j < img->width; j++)
+            for (c = 0; c < img->pixelSize; c++) {
+                acc = 0;
+                for (p = -s; p <= s; p++)
+                    for (q = -s; q <= s; q++) {
+                        inI = img_getBorderIndex(i - p, img->height, mode);
+                        inJ = img_getBorderIndex(j - q, img->width, mode);
+                        if (inI >= 0 && inJ >= 0)
+                            acc += IMG_GET_PIXEL_BYTE(img, inI, inJ, c)
+                                * mat->values[p + s][q + s];
+                    }
+                IMG_SET_PIXEL_BYTE(outImg, i, j, c,
+                    (acc >= 255) ? 255 : (acc <= 0) ? 0 : (int) acc);
+            }
+}
+
+/*******************************************************************************
+ * Separable filters
+ ******************************************************************************/
+
+static int testSeparable()
+{
+    int i, j, diff;
+    double binomial[5] = {1, 4, 6, 4, 1};
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *directImg, *separableImg;
+
+    // 5x5 Gaussian (binomial) filter
+    mat = mat_make(5, 5);
+    for (i = 0; i < 5; i++)
+        for (j = 0; j < 5; j++)
+            mat->values[i][j] = binomial[i] * binomial[j] / 256;
+    filter = conv_makeFilter(mat);
+    if (!filter->separable) {
+        printf("Gaussian filter was not detected as separable!\n");
+        return 0;
+    }
+
+    // Compare with the direct method
+    img = makeSyntheticImage(101, 67, 3);
+    directImg = img_make(img->width, img->height, img->pixelSize);
+    separableImg = img_make(img->width, img->height, img->pixelSize);
+    conv_runDirectPartially(img, 0, img->height, directImg, mat);
+    conv_runSeparablePartially(img, 0, img->height, separableImg, filter);
+    diff = getMaxDifference(directImg, separableImg);
+    printf("Separable vs direct max difference: %d\n", diff);
+
+    // A non rank-1 filter must not be detected
+    mat->values[0][0] += 0.01;
+    if (conv_isSeparable(mat, CONV_SEPARABLE_TOLERANCE, NULL, NULL)) {
+        printf("Perturbed filter was detected as separable!\n");
+        diff = 256;
+    }
+
+    // Clean
+    img_destroy(separableImg);
+    img_destroy(directImg);
+    img_destroy(img);
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return diff <= 1;
+}
+
+/*******************************************************************************
+ * Vectorised kernels
+ ******************************************************************************/
+
+static int testVector()
+{
+    int i, j, k, radius, pixelSize, diff, maxDiff;
+    SimdLevel level;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *directImg, *vectorImg;
+
+    // Compare every supported kernel with the direct method, both the
+    //  specialised (radius up to 3) and the generic ones
+    maxDiff = 0;
+    for (radius = 1; radius <= 4; radius++) {
+        // Non-separable filter
+        k = 2 * radius + 1;
+        mat = mat_make(k, k);
+        for (i = 0; i < k; i++)
+            for (j = 0; j < k; j++)
+                mat->values[i][j] = ((i * k + j) % 7 - 3) / 10.0;
+        filter = conv_makeFilter(mat);
+
+        for (pixelSize = 1; pixelSize <= 4; pixelSize++) {
+            img = makeSyntheticImage(131, 23, pixelSize);
+            directImg = img_make(img->width, img->height, img->pixelSize);
+            vectorImg = img_make(img->width, img->height, img->pixelSize);
+            conv_runDirectPartially(img, 0, img->height, directImg, mat);
+            for (level = SIMD_NONE; level <= simd_init(); level++) {
+                simd_setLevel(level);
+                conv_runVectorPartially(img, 0, img->height, vectorImg,
+                    filter);
+                diff = getMaxDifference(directImg, vectorImg);
+                printf("%s kernel (%dx%d, pixel size %d%s) vs direct max "
+                    "difference: %d\n", simd_getLevelName(level), k, k,
+                    pixelSize,
+                    simd_isSpecialised(radius, pixelSize) ? ", specialised"
+                        : "",
+                    diff);
+                if (diff > maxDiff)
+                    maxDiff = diff;
+            }
+            simd_setLevel(SIMD_AVX512);
+            img_destroy(vectorImg);
+            img_destroy(directImg);
+            img_destroy(img);
+        }
+
+        // Clean
+        conv_destroyFilter(filter);
+        mat_destroy(mat);
+    }
+
+    return maxDiff <= 1;
+}
+
+/*******************************************************************************
+ * Fixed-point filters
+ ******************************************************************************/
+
+static int testFixed()
+{
+    int i, j, bits, diff, failed;
+    double error;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *directImg, *fixedImg;
+
+    // Non-separable 5x5 filter
+    mat = mat_make(5, 5);
+    for (i = 0; i < 5; i++)
+        for (j = 0; j < 5; j++)
+            mat->values[i][j] = ((i * 5 + j) % 7 - 3) / 10.0;
+    filter = conv_makeFilter(mat);
+    img = makeSyntheticImage(131, 23, 3);
+    directImg = img_make(img->width, img->height, img->pixelSize);
+    fixedImg = img_make(img->width, img->height, img->pixelSize);
+    conv_runDirectPartially(img, 0, img->height, directImg, mat);
+
+    // The difference must stay within the reported error, for both the
+    //  16-bit (vectorised) and the wide weights
+    failed = 0;
+    for (bits = 4; bits <= 24; bits += 4) {
+        error = conv_quantizeFilter(filter, bits);
+        conv_runFixedPartially(img, 0, img->height, fixedImg, filter);
+        diff = getMaxDifference(directImg, fixedImg);
+        printf("Fixed-point (%d bits, worst-case error %lf) vs direct max "
+            "difference: %d\n", bits, error, diff);
+        if (diff > floor(error) + 1)
+            failed = 1;
+    }
+
+    // Clean
+    img_destroy(fixedImg);
+    img_destroy(directImg);
+    img_destroy(img);
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Border modes
+ ******************************************************************************/
+
+static int testBorders()
+{
+    int i, j, diff, maxDiff;
+    ImgBorderMode mode;
+    char *modeName[4] = {"zero", "clamp", "mirror", "wrap"};
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *refImg, *outImg;
+
+    // Non-separable 7x7 filter, on an image narrower than twice its radius
+    //  in one test
+    mat = mat_make(7, 7);
+    for (i = 0; i < 7; i++)
+        for (j = 0; j < 7; j++)
+            mat->values[i][j] = ((i * 7 + j) % 5 - 1) / 20.0;
+    filter = conv_makeFilter(mat);
+    maxDiff = 0;
+    for (mode = IMG_BORDER_ZERO; mode <= IMG_BORDER_WRAP; mode++) {
+        filter->border = mode;
+        for (i = 0; i < 2; i++) {
+            img = makeSyntheticImage(i ? 5 : 61, i ? 4 : 37, 3);
+            refImg = img_make(img->width, img->height, img->pixelSize);
+            outImg = img_make(img->width, img->height, img->pixelSize);
+            convolveReference(img, mat, mode, refImg);
+            conv_runVectorPartially(img, 0, img->height, outImg, filter);
+            diff = getMaxDifference(refImg, outImg);
+            printf("Border mode %s (%dx%d) max difference: %d\n",
+                modeName[mode], img->width, img->height, diff);
+            if (diff > maxDiff)
+                maxDiff = diff;
+            img_destroy(outImg);
+            img_destroy(refImg);
+            img_destroy(img);
+        }
+    }
+
+    // Clean
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return maxDiff <= 1;
+}
+
+/*******************************************************************************
+ * Column blocks
+ ******************************************************************************/
+
+static int testTiles()
+{
+    int i, j, method, diff, maxDiff;
+    double binomial[5] = {1, 4, 6, 4, 1};
+    char *methodName[3] = {"vector", "fixed-point", "separable"};
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *wholeImg, *tiledImg;
+
+    // 5x5 Gaussian (binomial) filter, so that every method applies
+    mat = mat_make(5, 5);
+    for (i = 0; i < 5; i++)
+        for (j = 0; j < 5; j++)
+            mat->values[i][j] = binomial[i] * binomial[j] / 256;
+    filter = conv_makeFilter(mat);
+    filter->border = IMG_BORDER_MIRROR;
+    img = makeSyntheticImage(103, 29, 3);
+    wholeImg = img_make(img->width, img->height, img->pixelSize);
+    tiledImg = img_make(img->width, img->height, img->pixelSize);
+
+    // Blocks must not change a single byte, whatever their width
+    maxDiff = 0;
+    for (method = 0; method < 3; method++) {
+        if (method == 1)
+            conv_quantizeFilter(filter, 14);
+        for (i = 0; i < 2; i++) {
+            filter->tileWidth = i ? 10 : img->width;
+            if (method == 2)
+                conv_runSeparablePartially(img, 0, img->height,
+                    i ? tiledImg : wholeImg, filter);
+            else if (method == 1)
+                conv_runFixedPartially(img, 0, img->height,
+                    i ? tiledImg : wholeImg, filter);
+            else
+                conv_runVectorPartially(img, 0, img->height,
+                    i ? tiledImg : wholeImg, filter);
+        }
+        if (method == 1)
+            filter->fixedBits = 0;
+        diff = getMaxDifference(wholeImg, tiledImg);
+        printf("Tiled vs whole rows (%s) max difference: %d\n",
+            methodName[method], diff);
+        if (diff > maxDiff)
+            maxDiff = diff;
+    }
+
+    // Blocks picked from the cache sizes
+    filter->tileWidth = 0;
+    i = conv_getTileWidth(filter, 100000, 3);
+    printf("Automatic column block width: %d\n", i);
+    if (i < CONV_MIN_TILE_WIDTH || i % CONV_MIN_TILE_WIDTH) {
+        printf("Invalid column block width!\n");
+        maxDiff = 256;
+    }
+
+    // Clean
+    img_destroy(tiledImg);
+    img_destroy(wholeImg);
+    img_destroy(img);
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return maxDiff == 0;
+}
+
+/*******************************************************************************
+ * Threads
+ ******************************************************************************/
+
+static int testThreads()
+{
+    int i, j, engine, diff, failed;
+    ConvSchedule schedule;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *singleImg, *threadedImg;
+
+    // Non-separable 9x9 filter
+    mat = mat_make(9, 9);
+    for (i = 0; i < 9; i++)
+        for (j = 0; j < 9; j++)
+            mat->values[i][j] = ((i * 9 + j) % 7 - 2) / 80.0;
+    filter = conv_makeFilter(mat);
+    filter->border = IMG_BORDER_CLAMP;
+    img = makeSyntheticImage(77, 150, 3);
+    singleImg = img_make(img->width, img->height, img->pixelSize);
+    threadedImg = img_make(img->width, img->height, img->pixelSize);
+    memset(singleImg->data, 0, img->width * img->height * 3);
+
+    // Threads must not change a single byte, whatever the scheduling
+    failed = 0;
+    for (engine = CONV_ENGINE_DIRECT; engine <= CONV_ENGINE_FFT; engine++) {
+        filter->engine = engine;
+        filter->threads = 1;
+        conv_runFilterPartially(img, 3, 140, singleImg, filter);
+        for (schedule = CONV_SCHEDULE_STATIC;
+            schedule <= CONV_SCHEDULE_DYNAMIC; schedule++) {
+            filter->threads = 3;
+            filter->schedule = schedule;
+            memset(threadedImg->data, 0, img->width * img->height * 3);
+            conv_runFilterPartially(img, 3, 140, threadedImg, filter);
+            diff = getMaxDifference(singleImg, threadedImg);
+            printf("Threads (%s engine, %s scheduling) vs single thread max "
+                "difference: %d\n", conv_getEngineName(engine),
+                schedule ? "dynamic" : "static", diff);
+            if (diff > 0)
+                failed = 1;
+        }
+    }
+
+    // Clean
+    img_destroy(threadedImg);
+    img_destroy(singleImg);
+    img_destroy(img);
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * FFT engine
+ ******************************************************************************/
+
+static int testFft()
+{
+    int i, j, diff, maxDiff;
+    ImgBorderMode mode;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *refImg, *outImg;
+
+    // Non-separable 17x17 filter
+    mat = mat_make(17, 17);
+    for (i = 0; i < 17; i++)
+        for (j = 0; j < 17; j++)
+            mat->values[i][j] = ((i * 17 + j) % 11 - 3) / 400.0;
+    filter = conv_makeFilter(mat);
+
+    // Compare with the reference, on an odd number of tiles per strip and on
+    //  an image smaller than the filter
+    maxDiff = 0;
+    for (mode = IMG_BORDER_ZERO; mode <= IMG_BORDER_WRAP; mode++) {
+        filter->border = mode;
+        for (i = 0; i < 2; i++) {
+            img = makeSyntheticImage(i ? 5 : 131, i ? 4 : 53, i ? 1 : 3);
+            refImg = img_make(img->width, img->height, img->pixelSize);
+            outImg = img_make(img->width, img->height, img->pixelSize);
+            convolveReference(img, mat, mode, refImg);
+            conv_runFftPartially(img, 0, 20, outImg, filter);
+            conv_runFftPartially(img, 20, img->height, outImg, filter);
+            diff = getMaxDifference(refImg, outImg);
+            printf("FFT (border mode %d, %dx%d) max difference: %d\n", mode,
+                img->width, img->height, diff);
+            if (diff > maxDiff)
+                maxDiff = diff;
+            img_destroy(outImg);
+            img_destroy(refImg);
+            img_destroy(img);
+        }
+    }
+
+    // Small filters stay direct, large ones go to the FFT engine (only the
+    //  radius matters)
+    filter->radius = 20;
+    if (conv_chooseEngine(filter, 1920, 2520, 3) != CONV_ENGINE_FFT) {
+        printf("FFT engine was not chosen for a 41x41 filter!\n");
+        maxDiff = 256;
+    }
+    filter->radius = 1;
+    if (conv_chooseEngine(filter, 1920, 2520, 3) != CONV_ENGINE_DIRECT) {
+        printf("FFT engine was chosen for a 3x3 filter!\n");
+        maxDiff = 256;
+    }
+    filter->radius = 8;
+
+    // Clean
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return maxDiff <= 1;
+}
+
+/*******************************************************************************
+ * Planar layout
+ ******************************************************************************/
+
+static int testPlanar()
+{
+    int i, j, method, diff, maxDiff;
+    double binomial[5] = {1, 4, 6, 4, 1};
+    char *methodName[4] = {"vector", "fixed-point", "separable", "FFT"};
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *planarImg, *outImg, *planarOutImg, *tmpImg;
+
+    // 5x5 Gaussian (binomial) filter, so that every method applies
+    mat = mat_make(5, 5);
+    for (i = 0; i < 5; i++)
+        for (j = 0; j < 5; j++)
+            mat->values[i][j] = binomial[i] * binomial[j] / 256;
+    filter = conv_makeFilter(mat);
+    filter->border = IMG_BORDER_CLAMP;
+    img = makeSyntheticImage(71, 23, 3);
+    planarImg = img_convertLayout(img, IMG_LAYOUT_PLANAR);
+    outImg = img_make(img->width, img->height, img->pixelSize);
+    planarOutImg = img_makeWithLayout(img->width, img->height,
+        img->pixelSize, IMG_LAYOUT_PLANAR);
+
+    // Conversions, crop and distance must not depend on the layout
+    maxDiff = 0;
+    tmpImg = img_convertLayout(planarImg, IMG_LAYOUT_INTERLEAVED);
+    diff = getMaxDifference(img, tmpImg);
+    printf("Planar round trip max difference: %d\n", diff);
+    if (diff > maxDiff)
+        maxDiff = diff;
+    img_destroy(tmpImg);
+    if (IMG_GET_PIXEL_BYTE(planarImg, 5, 7, 2) != img->rows[5][7 * 3 + 2]
+        || img_getDistance(img, planarImg) != 0) {
+        printf("Planar pixel access or distance mismatch!\n");
+        maxDiff = 256;
+    }
+    tmpImg = img_crop(planarImg, 30, 10, 20, 5);
+    for (i = 0; i < 10; i++)
+        for (j = 0; j < 30 * 3; j++)
+            if (IMG_GET_PIXEL_BYTE(tmpImg, i, j / 3, j % 3)
+                != img->rows[5 + i][20 * 3 + j]) {
+                printf("Planar crop mismatch!\n");
+                maxDiff = 256;
+                i = 10;
+                break;
+            }
+    img_destroy(tmpImg);
+
+    // Every method, on both layouts (two partial calls)
+    for (method = 0; method < 4; method++) {
+        if (method == 1)
+            conv_quantizeFilter(filter, 14);
+        filter->engine = (method == 3) ? CONV_ENGINE_FFT : CONV_ENGINE_DIRECT;
+        for (i = 0; i < 2; i++) {
+            tmpImg = i ? planarImg : img;
+            if (method == 0) {
+                conv_runVectorPartially(tmpImg, 0, 9,
+                    i ? planarOutImg : outImg, filter);
+                conv_runVectorPartially(tmpImg, 9, 14,
+                    i ? planarOutImg : outImg, filter);
+            } else {
+                conv_runFilterPartially(tmpImg, 0, 9,
+                    i ? planarOutImg : outImg, filter);
+                conv_runFilterPartially(tmpImg, 9, 14,
+                    i ? planarOutImg : outImg, filter);
+            }
+        }
+        if (method == 1)
+            filter->fixedBits = 0;
+        tmpImg = img_convertLayout(planarOutImg, IMG_LAYOUT_INTERLEAVED);
+        diff = getMaxDifference(outImg, tmpImg);
+        img_destroy(tmpImg);
+        printf("Planar vs interleaved (%s) max difference: %d\n",
+            methodName[method], diff);
+        if (diff > ((method == 3) ? 1 : 0))
+            maxDiff = 256;
+    }
+
+    // Clean
+    img_destroy(planarOutImg);
+    img_destroy(outImg);
+    img_destroy(planarImg);
+    img_destroy(img);
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return maxDiff == 0;
+}
+
+/*******************************************************************************
+ * Box filters
+ ******************************************************************************/
+
+static int testBox()
+{
+    int i, j, diff, maxDiff;
+    ImgBorderMode mode;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *refImg, *outImg;
+
+    maxDiff = 0;
+    for (i = 0; i < 2; i++) {
+        // 7x7 box, then a Gaussian (sigma 2.5) made of 3 boxes
+        if (i == 0) {
+            mat = mat_make(7, 7);
+            for (j = 0; j < 49; j++)
+                mat->values[j / 7][j % 7] = 1 / 49.0;
+            filter = conv_makeFilter(mat);
+        } else {
+            mat = conv_makeGaussianMatrix(2.5, 3);
+            filter = conv_makeFilter(mat);
+            if (!conv_useBoxPasses(filter, 2.5, 3))
+                filter->boxPasses = 0;
+        }
+        if (filter->boxPasses != (i ? 3 : 1)
+            || conv_chooseEngine(filter, 1920, 2520, 3) != CONV_ENGINE_BOX) {
+            printf("Box filter was not detected (%dx%d)!\n", mat->width,
+                mat->height);
+            maxDiff = 256;
+        }
+
+        // Compare with the reference in two partial calls
+        for (mode = IMG_BORDER_ZERO; mode <= IMG_BORDER_WRAP; mode++) {
+            filter->border = mode;
+            img = makeSyntheticImage(97, 41, 3);
+            refImg = img_make(img->width, img->height, img->pixelSize);
+            outImg = img_make(img->width, img->height, img->pixelSize);
+            convolveReference(img, mat, mode, refImg);
+            conv_runBoxPartially(img, 0, 17, outImg, filter);
+            conv_runBoxPartially(img, 17, img->height, outImg, filter);
+            diff = getMaxDifference(refImg, outImg);
+            printf("Box (%d pass(es), %dx%d filter, border mode %d) max "
+                "difference: %d\n", filter->boxPasses, mat->width,
+                mat->height, mode, diff);
+            if (diff > maxDiff)
+                maxDiff = diff;
+            img_destroy(outImg);
+            img_destroy(refImg);
+            img_destroy(img);
+        }
+
+        // Clean
+        conv_destroyFilter(filter);
+        mat_destroy(mat);
+    }
+
+    return maxDiff <= 1;
+}
+
+/*******************************************************************************
+ * Winograd
+ ******************************************************************************/
+
+static int testWinograd()
+{
+    int i, diff, maxDiff;
+    double emboss[9] = {-2, -1, 0, -1, 1, 1, 0, 1, 2};
+    ImgBorderMode mode;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *refImg, *outImg;
+
+    // Emboss filter (not separable)
+    mat = mat_make(3, 3);
+    for (i = 0; i < 9; i++)
+        mat->values[i / 3][i % 3] = emboss[i];
+    filter = conv_makeFilter(mat);
+
+    // Compare with the reference, on odd and even sizes, in two partial calls
+    //  (the first one of an odd amount of rows)
+    maxDiff = 0;
+    for (mode = IMG_BORDER_ZERO; mode <= IMG_BORDER_WRAP; mode++) {
+        filter->border = mode;
+        for (i = 0; i < 3; i++) {
+            img = makeSyntheticImage(i ? 6 + i : 37, i ? 5 : 19, i ? i : 3);
+            refImg = img_make(img->width, img->height, img->pixelSize);
+            outImg = img_make(img->width, img->height, img->pixelSize);
+            convolveReference(img, mat, mode, refImg);
+            conv_runWinogradPartially(img, 0, 3, outImg, filter);
+            conv_runWinogradPartially(img, 3, img->height, outImg, filter);
+            diff = getMaxDifference(refImg, outImg);
+            printf("Winograd (border mode %d, %dx%dx%d) max difference: %d\n",
+                mode, img->width, img->height, img->pixelSize, diff);
+            if (diff > maxDiff)
+                maxDiff = diff;
+            img_destroy(outImg);
+            img_destroy(refImg);
+            img_destroy(img);
+        }
+    }
+
+    // Clean
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return maxDiff <= 1;
+}
+
+/*******************************************************************************
+ * Filter banks
+ ******************************************************************************/
+
+static int testBank()
+{
+    int i, j, f, diff, maxDiff;
+    int sizes[3] = {3, 7, 5};
+    struct matrix_t *mats[3];
+    struct conv_filter_t *filters[3];
+    struct image_t *img, *refImg, *outImgs[3], *merged;
+
+    // Two random filters of the vector method and a box
+    srand(7);
+    for (f = 0; f < 3; f++) {
+        mats[f] = mat_make(sizes[f], sizes[f]);
+        for (i = 0; i < sizes[f]; i++)
+            for (j = 0; j < sizes[f]; j++)
+                mats[f]->values[i][j] = (f == 2) ? 1 / 25.0
+                    : (rand() % 200 - 50) / (100.0 * sizes[f] * sizes[f]);
+        filters[f] = conv_makeFilter(mats[f]);
+        filters[f]->border = IMG_BORDER_MIRROR;
+    }
+
+    // Same result as the filters one by one, with both layouts
+    maxDiff = 0;
+    for (i = 0; i < 2; i++) {
+        refImg = makeSyntheticImage(97, 41, 3);
+        img = img_convertLayout(refImg, i ? IMG_LAYOUT_PLANAR
+            : IMG_LAYOUT_INTERLEAVED);
+        img_destroy(refImg);
+        for (f = 0; f < 3; f++)
+            outImgs[f] = img_makeWithLayout(img->width, img->height,
+                img->pixelSize, img->layout);
+        conv_runBankPartially(img, 0, 17, outImgs, filters, 3);
+        conv_runBankPartially(img, 17, img->height, outImgs, filters, 3);
+        for (f = 0; f < 3; f++) {
+            refImg = conv_runFilter(img, filters[f]);
+            diff = img_getDistance(refImg, outImgs[f]) == 0 ? 0 : 256;
+            printf("Bank (%s, %dx%d filter) difference: %d\n",
+                i ? "planar" : "interleaved", sizes[f], sizes[f], diff);
+            if (diff > maxDiff)
+                maxDiff = diff;
+            img_destroy(refImg);
+        }
+
+        // Merged outputs: the channels of every filter, one after the other
+        merged = img_merge(outImgs, 3);
+        if (merged == NULL || merged->pixelSize != 9
+            || IMG_GET_PIXEL_BYTE(merged, 40, 96, 7)
+                != IMG_GET_PIXEL_BYTE(outImgs[2], 40, 96, 1)) {
+            printf("Bank outputs were not merged!\n");
+            maxDiff = 256;
+        }
+        if (merged != NULL)
+            img_destroy(merged);
+        for (f = 0; f < 3; f++)
+            img_destroy(outImgs[f]);
+        img_destroy(img);
+    }
+
+    // Clean
+    for (f = 0; f < 3; f++) {
+        conv_destroyFilter(filters[f]);
+        mat_destroy(mats[f]);
+    }
+
+    return maxDiff == 0;
+}
+
+/*******************************************************************************
+ * Sparse taps
+ ******************************************************************************/
+
+static int testSparse()
+{
+    int i, j, diff, maxDiff;
+    ImgBorderMode mode;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *refImg, *outImg;
+
+    // Dilated 3x3 filter (9 taps out of 121)
+    srand(5);
+    mat = mat_make(11, 11);
+    for (i = 0; i < 11; i++)
+        for (j = 0; j < 11; j++)
+            mat->values[i][j] = (i % 5 || j % 5) ? 0
+                : (rand() % 100 + 10) / 500.0;
+    filter = conv_makeFilter(mat);
+    if (filter->nTaps != 9 || conv_chooseEngine(filter, 1920, 2520, 3)
+        != CONV_ENGINE_SPARSE) {
+        printf("Sparse engine was not picked (%d taps)!\n", filter->nTaps);
+        conv_destroyFilter(filter);
+        mat_destroy(mat);
+        return 0;
+    }
+
+    // Compare with the reference, in two partial calls
+    maxDiff = 0;
+    for (mode = IMG_BORDER_ZERO; mode <= IMG_BORDER_WRAP; mode++) {
+        filter->border = mode;
+        img = makeSyntheticImage(53, 31, 3);
+        refImg = img_make(img->width, img->height, img->pixelSize);
+        outImg = img_make(img->width, img->height, img->pixelSize);
+        convolveReference(img, mat, mode, refImg);
+        conv_runSparsePartially(img, 0, 12, outImg, filter);
+        conv_runSparsePartially(img, 12, img->height, outImg, filter);
+        diff = getMaxDifference(refImg, outImg);
+        printf("Sparse (border mode %d) max difference: %d\n", mode, diff);
+        if (diff > maxDiff)
+            maxDiff = diff;
+        img_destroy(outImg);
+        img_destroy(refImg);
+        img_destroy(img);
+    }
+
+    // Clean
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return maxDiff <= 1;
+}
+
+/*******************************************************************************
+ * Generated kernels
+ ******************************************************************************/
+
+static struct matrix_t* makeJitMatrix(int kind, int k)
+{
+    int i, j;
+    struct matrix_t *mat;
+
+    // 0: dilated (taps every 5 pixels), 1: separable, 2: dense random
+    mat = mat_make(k, k);
+    srand(13);
+    for (i = 0; i < k; i++)
+        for (j = 0; j < k; j++)
+            if (kind == 0)
+                mat->values[i][j] = (i % 5 || j % 5) ? 0
+                    : (rand() % 3 + 1) / 20.0;
+            else if (kind == 1)
+                mat->values[i][j] = (k - abs(2 * i - k + 1))
+                    * (k - abs(2 * j - k + 1)) / (double) (k * k * k);
+            else
+                mat->values[i][j] = (rand() % 200 - 50) / (100.0 * k * k);
+
+    return mat;
+}
+
+static int testJit()
+{
+    int kind, p, diff, maxDiff;
+    int ks[3] = {11, 5, 7};
+    int pixelSizes[3] = {1, 3, 4};
+    double sTime, eTime, staticTime, jitTime;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter, *jitFilter;
+    struct image_t *img, *planar, *outImg, *jitImg;
+
+    if (!jit_isSupported()) {
+        printf("Generated kernels are not supported, skipping.\n");
+        return 1;
+    }
+
+    // Same output as the static kernels, with tails shorter than a step
+    maxDiff = 0;
+    for (kind = 0; kind < 3; kind++)
+        for (p = 0; p < 3; p++) {
+            mat = makeJitMatrix(kind, ks[kind]);
+            filter = conv_makeFilter(mat);
+            jitFilter = conv_makeFilter(mat);
+            filter->border = jitFilter->border = IMG_BORDER_MIRROR;
+            jitFilter->jit = jit_makeRowKernel(jitFilter->weights, ks[kind],
+                pixelSizes[p]);
+            img = makeSyntheticImage(53, 31, pixelSizes[p]);
+            outImg = img_make(img->width, img->height, img->pixelSize);
+            jitImg = img_make(img->width, img->height, img->pixelSize);
+            conv_runVectorPartially(img, 0, img->height, outImg, filter);
+            conv_runVectorPartially(img, 0, 12, jitImg, jitFilter);
+            conv_runVectorPartially(img, 12, img->height, jitImg, jitFilter);
+            diff = getMaxDifference(outImg, jitImg);
+            printf("Generated kernel (filter %d, pixel size %d, %d taps in %d "
+                "groups) max difference: %d\n", kind, pixelSizes[p],
+                jitFilter->jit->taps, jitFilter->jit->groups, diff);
+            if (diff > maxDiff)
+                maxDiff = diff;
+
+            // Planes fall back to the static kernels (other pixel size)
+            if (pixelSizes[p] > 1) {
+                planar = img_convertLayout(img, IMG_LAYOUT_PLANAR);
+                img_destroy(jitImg);
+                jitImg = img_makeWithLayout(img->width, img->height,
+                    img->pixelSize, IMG_LAYOUT_PLANAR);
+                conv_runVectorPartially(planar, 0, img->height, jitImg,
+                    jitFilter);
+                img_destroy(planar);
+                planar = img_convertLayout(jitImg, IMG_LAYOUT_INTERLEAVED);
+                diff = getMaxDifference(outImg, planar);
+                if (diff > maxDiff)
+                    maxDiff = diff;
+                img_destroy(planar);
+            }
+            img_destroy(jitImg);
+            img_destroy(outImg);
+            img_destroy(img);
+            conv_destroyFilter(jitFilter);
+            conv_destroyFilter(filter);
+            mat_destroy(mat);
+        }
+
+    // Benchmark against the static dispatch (the separable filter also uses
+    //  the vector kernels, like a filter with a generated kernel does)
+    img = makeSyntheticImage(1920, 1080, 3);
+    outImg = img_make(img->width, img->height, img->pixelSize);
+    for (kind = 0; kind < 3; kind++) {
+        mat = makeJitMatrix(kind, ks[kind]);
+        filter = conv_makeFilter(mat);
+        GET_TIME(sTime);
+        conv_runVectorPartially(img, 0, img->height, outImg, filter);
+        GET_TIME(eTime);
+        staticTime = eTime - sTime;
+        filter->jit = jit_makeRowKernel(filter->weights, ks[kind],
+            img->pixelSize);
+        GET_TIME(sTime);
+        conv_runVectorPartially(img, 0, img->height, outImg, filter);
+        GET_TIME(eTime);
+        jitTime = eTime - sTime;
+        printf("Generated kernel (filter %d, %dx%d) took %lf s, static "
+            "kernels %lf s (%s kept)\n", kind, ks[kind], ks[kind], jitTime,
+            staticTime, (conv_compileFilter(filter, img->pixelSize) == 1)
+                ? "generated" : "static");
+        conv_destroyFilter(filter);
+        mat_destroy(mat);
+    }
+    img_destroy(outImg);
+    img_destroy(img);
+
+    return maxDiff <= 1;
+}
+
+/*******************************************************************************
+ * Change of the iterations
+ ******************************************************************************/
+
+static int testDelta()
+{
+    int i, j, t, k, d, bytes, maxDiff, failed;
+    long long sumSquares;
+    double dist, vec[5];
+    ConvEngine engines[7] = {CONV_ENGINE_DIRECT, CONV_ENGINE_DIRECT,
+        CONV_ENGINE_DIRECT, CONV_ENGINE_DIRECT, CONV_ENGINE_FFT,
+        CONV_ENGINE_BOX, CONV_ENGINE_WINOGRAD};
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct conv_delta_t delta, window;
+    struct image_t *img, *inImg, *outImg;
+
+    // Every engine: the direct one with the vector, planar and threaded,
+    //  separable and fixed-point kernels, a box for the box engine and a 3x3
+    //  filter for Winograd
+    failed = 0;
+    srand(11);
+    for (i = 0; i < 5; i++)
+        vec[i] = (rand() % 100 + 10) / 300.0;
+    for (t = 0; t < 7; t++) {
+        k = (engines[t] == CONV_ENGINE_WINOGRAD) ? 3 : 5;
+        mat = mat_make(k, k);
+        for (i = 0; i < k; i++)
+            for (j = 0; j < k; j++)
+                mat->values[i][j] = (engines[t] == CONV_ENGINE_BOX)
+                    ? 1.0 / (k * k) : (t == 2) ? vec[i] * vec[j]
+                    : (rand() % 200 - 50) / (100.0 * k * k);
+        filter = conv_makeFilter(mat);
+        filter->engine = engines[t];
+        filter->border = IMG_BORDER_CLAMP;
+        if (t == 1) {
+            filter->threads = 2;
+            filter->schedule = CONV_SCHEDULE_DYNAMIC;
+        }
+        if (t == 3)
+            conv_quantizeFilter(filter, 12);
+        img = makeSyntheticImage(61, 29, 3);
+        inImg = img_convertLayout(img, (t == 1) ? IMG_LAYOUT_PLANAR
+            : IMG_LAYOUT_INTERLEAVED);
+        outImg = img_makeWithLayout(img->width, img->height, img->pixelSize,
+            inImg->layout);
+
+        // Same change as a separate pass over the images, in two calls
+        delta.sumSquares = 0;
+        delta.maxDiff = 0;
+        delta.endByte = 0;
+        conv_runFilterPartiallyDelta(inImg, 0, 10, outImg, filter, &delta);
+        conv_runFilterPartiallyDelta(inImg, 10, inImg->height, outImg, filter,
+            &delta);
+
+        // Change within some columns only (e.g. of a block)
+        bytes = (inImg->layout == IMG_LAYOUT_PLANAR) ? 1 : inImg->pixelSize;
+        window.sumSquares = 0;
+        window.maxDiff = 0;
+        window.firstByte = 7 * bytes;
+        window.endByte = 40 * bytes;
+        conv_runFilterPartiallyDelta(inImg, 0, 10, outImg, filter, &window);
+        conv_runFilterPartiallyDelta(inImg, 10, inImg->height, outImg, filter,
+            &window);
+        sumSquares = 0;
+        maxDiff = 0;
+        for (i = 0; i < inImg->height * inImg->pixelSize / bytes; i++)
+            for (j = window.firstByte; j < window.endByte; j++) {
+                d = abs(outImg->rows[i][j] - inImg->rows[i][j]);
+                sumSquares += d * d;
+                maxDiff = (d > maxDiff) ? d : maxDiff;
+            }
+        printf("Change (%s engine, case %d, columns 7 to 39) distance: %lld "
+            "(%lld), largest: %g (%d)\n", conv_getEngineName(engines[t]), t,
+            window.sumSquares, sumSquares, window.maxDiff, maxDiff);
+        failed |= window.sumSquares != sumSquares
+            || window.maxDiff != maxDiff;
+        dist = img_getDistance(inImg, outImg);
+        img_destroy(img);
+        img = img_convertLayout(outImg, IMG_LAYOUT_INTERLEAVED);
+        img_destroy(outImg);
+        outImg = img_convertLayout(inImg, IMG_LAYOUT_INTERLEAVED);
+        maxDiff = getMaxDifference(outImg, img);
+        printf("Change (%s engine, case %d) distance: %lf (%lf), largest: %g "
+            "(%d)\n", conv_getEngineName(engines[t]), t,
+            conv_getDeltaDistance(&delta, IMG_SAMPLE_U8),
+            dist, delta.maxDiff, maxDiff);
+        failed |= fabs(conv_getDeltaDistance(&delta, IMG_SAMPLE_U8) - dist)
+            > 1e-9 || delta.maxDiff != maxDiff || maxDiff == 0;
+        img_destroy(outImg);
+        img_destroy(inImg);
+        img_destroy(img);
+        conv_destroyFilter(filter);
+        mat_destroy(mat);
+    }
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Sample types
+ ******************************************************************************/
+
+static int testSamples()
+{
+    int i, j, t, diff, maxDiff;
+    ImgSampleType types[2] = {IMG_SAMPLE_U16, IMG_SAMPLE_F32};
+    FILE *file;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct image_t *img, *refImg, *wideImg, *planar, *outImg, *backImg;
+
+    // Random 5x5 filter, negative weights included
+    srand(17);
+    mat = mat_make(5, 5);
+    for (i = 0; i < 5; i++)
+        for (j = 0; j < 5; j++)
+            mat->values[i][j] = (rand() % 200 - 50) / 2500.0;
+    filter = conv_makeFilter(mat);
+    filter->border = IMG_BORDER_MIRROR;
+    img = makeSyntheticImage(47, 23, 3);
+    refImg = img_make(img->width, img->height, img->pixelSize);
+    conv_runFilterPartially(img, 0, img->height, refImg, filter);
+
+    // Wider samples (planar for floats), read back from a file, and brought
+    //  back to 8 bits after the convolution
+    maxDiff = 0;
+    for (t = 0; t < 2; t++) {
+        wideImg = img_convertType(img, types[t]);
+        file = tmpfile();
+        img_writeToFile(wideImg, file);
+        rewind(file);
+        img_destroy(wideImg);
+        wideImg = img_makeFromFile(file, img->width, img->height,
+            img->pixelSize, (t == 1) ? IMG_LAYOUT_PLANAR
+                : IMG_LAYOUT_INTERLEAVED, types[t]);
+        fclose(file);
+        outImg = img_makeWithType(img->width, img->height, img->pixelSize,
+            wideImg->layout, types[t]);
+        conv_runFilterPartially(wideImg, 0, 9, outImg, filter);
+        conv_runFilterPartially(wideImg, 9, img->height, outImg, filter);
+        planar = img_convertLayout(outImg, IMG_LAYOUT_INTERLEAVED);
+        backImg = img_convertType(planar, IMG_SAMPLE_U8);
+        diff = getMaxDifference(refImg, backImg);
+        printf("Samples of %d byte(s) max difference: %d\n",
+            img_getSampleSize(types[t]), diff);
+        if (diff > maxDiff)
+            maxDiff = diff;
+        img_destroy(backImg);
+        img_destroy(planar);
+        img_destroy(outImg);
+
+        // The conversions keep the 8-bit values
+        outImg = img_convertType(wideImg, IMG_SAMPLE_U8);
+        planar = img_convertLayout(outImg, IMG_LAYOUT_INTERLEAVED);
+        if (getMaxDifference(img, planar) != 0) {
+            printf("Samples of %d byte(s) changed on conversion!\n",
+                img_getSampleSize(types[t]));
+            maxDiff = 256;
+        }
+        img_destroy(planar);
+        img_destroy(outImg);
+        img_destroy(wideImg);
+    }
+
+    // Clean
+    img_destroy(refImg);
+    img_destroy(img);
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return maxDiff <= 1;
+}
+
+static int testSampleDelta()
+{
+    int i, j, t, n, failed;
+    double d, dist, maxDiff;
+    float *in, *out;
+    struct matrix_t *mat;
+    struct conv_filter_t *filter;
+    struct conv_delta_t deltas[3];
+    struct image_t *img, *inImg, *outImg;
+
+    // Float samples in [0, 1) and a filter close to the identity: small
+    //  changes spread over the whole image, none of its rows changing by a
+    //  whole level
+    mat = mat_make(3, 3);
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            mat->values[i][j] = (i == 1 && j == 1) ? 0.9 : 0.0125;
+    filter = conv_makeFilter(mat);
+    filter->border = IMG_BORDER_CLAMP;
+    img = makeSyntheticImage(47, 23, 3);
+    inImg = img_convertType(img, IMG_SAMPLE_F32);
+    n = inImg->width * inImg->pixelSize;
+    for (i = 0; i < inImg->height; i++)
+        for (j = 0; j < n; j++)
+            ((float *) inImg->rows[i])[j] /= 256;
+    outImg = img_makeWithType(img->width, img->height, img->pixelSize,
+        inImg->layout, IMG_SAMPLE_F32);
+
+    // The same change whatever the rows of the calls and of the threads
+    failed = 0;
+    for (t = 0; t < 3; t++) {
+        filter->threads = (t == 2) ? 3 : 1;
+        deltas[t].sumSquares = 0;
+        deltas[t].maxDiff = 0;
+        deltas[t].endByte = 0;
+        for (i = 0; i < inImg->height; i += (t == 1) ? 5 : inImg->height)
+            conv_runFilterPartiallyDelta(inImg, i, (t == 1) ? 5
+                : inImg->height, outImg, filter, &(deltas[t]));
+        failed |= deltas[t].sumSquares != deltas[0].sumSquares
+            || deltas[t].maxDiff != deltas[0].maxDiff;
+    }
+
+    // Close to the exact change, with a largest change below 1 that the
+    //  criterion reaches
+    dist = 0;
+    maxDiff = 0;
+    for (i = 0; i < inImg->height; i++) {
+        in = (float *) inImg->rows[i];
+        out = (float *) outImg->rows[i];
+        for (j = 0; j < n; j++) {
+            d = fabs((double) out[j] - in[j]);
+            dist += d * d;
+            maxDiff = (d > maxDiff) ? d : maxDiff;
+        }
+    }
+    printf("Change of float samples distance: %lf (%lf), largest: %lf (%lf)"
+        "\n", conv_getDeltaDistance(&(deltas[0]), IMG_SAMPLE_F32), sqrt(dist),
+        deltas[0].maxDiff, maxDiff);
+    d = conv_getDeltaDistance(&(deltas[0]), IMG_SAMPLE_F32);
+    failed |= fabs(d * d - dist) > 0.5 * n * inImg->height
+        / CONV_DELTA_FLOAT_ONE || dist == 0;
+    failed |= deltas[0].maxDiff != maxDiff || maxDiff >= 1
+        || !conv_hasConverged(&(deltas[0]), IMG_SAMPLE_F32,
+            CONV_CRITERION_MAX, maxDiff)
+        || conv_hasConverged(&(deltas[0]), IMG_SAMPLE_F32,
+            CONV_CRITERION_MAX, maxDiff * 0.99);
+
+    // Clean
+    img_destroy(outImg);
+    img_destroy(inImg);
+    img_destroy(img);
+    conv_destroyFilter(filter);
+    mat_destroy(mat);
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
 
 int main(int argc, char **argv)
 {
+    // Separable convolution test
+    if (!testSeparable()) {
+        printf("Separable convolution test failed!\n");
+        return 1;
+    }
+
+    // Vectorised convolution test
+    if (!testVector()) {
+        printf("Vectorised convolution test failed!\n");
+        return 1;
+    }
+
+    // Border modes test
+    if (!testBorders()) {
+        printf("Border modes test failed!\n");
+        return 1;
+    }
+
+    // Fixed-point convolution test
+    if (!testFixed()) {
+        printf("Fixed-point convolution test failed!\n");
+        return 1;
+    }
+
+    // Column blocks test
+    if (!testTiles()) {
+        printf("Column blocks test failed!\n");
+        return 1;
+    }
+
+    // Threads test
+    if (!testThreads()) {
+        printf("Threads test failed!\n");
+        return 1;
+    }
+
+    // FFT convolution test
+    if (!testFft()) {
+        printf("FFT convolution test failed!\n");
+        return 1;
+    }
+
+    // Planar layout test
+    if (!testPlanar()) {
+        printf("Planar layout test failed!\n");
+        return 1;
+    }
+
+    // Box filters test
+    if (!testBox()) {
+        printf("Box filters test failed!\n");
+        return 1;
+    }
+
+    // Winograd convolution test
+    if (!testWinograd()) {
+        printf("Winograd convolution test failed!\n");
+        return 1;
+    }
+
+    // Filter banks test
+    if (!testBank()) {
+        printf("Filter banks test failed!\n");
+        return 1;
+    }
+
+    // Sparse taps test
+    if (!testSparse()) {
+        printf("Sparse taps test failed!\n");
+        return 1;
+    }
+
+    // Generated kernels test
+    if (!testJit()) {
+        printf("Generated kernels test failed!\n");
+        return 1;
+    }
+
+    // Sample types test
+    if (!testSamples()) {
+        printf("Sample types test failed!\n");
+        return 1;
+    }
+
+    // Change of the iterations test
+    if (!testDelta()) {
+        printf("Change of the iterations test failed!\n");
+        return 1;
+    }
+
+    // Change of float samples test
+    if (!testSampleDelta()) {
+        printf("Change of float samples test failed!\n");
+        return 1;
+    }
+
     // Matrix creation test
     struct matrix_t *mat;
     mat = mat_make(3, 3);
@@ -29,7 +1273,8 @@ int main(int argc, char **argv)
     struct image_t *img, *filteredImg;
     FILE *file;
     file = fopen("../test_datasets/in/colored.raw", "r");
-    img = img_makeFromFile(file, 1920, 2520, 3);
+    img = img_makeFromFile(file, 1920, 2520, 3, IMG_LAYOUT_INTERLEAVED,
+        IMG_SAMPLE_U8);
     fclose(file);
     if (img == NULL) {
         printf("Failed to initialize image!\n");
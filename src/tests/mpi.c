@@ -1,10 +1,473 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mpi.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
 
+// Files of the runs, in a directory of their own
+#define IMAGE_PATH "in.raw"
+#define SERIAL_PATH "serial.raw"
+#define MPI_PATH "mpi.raw"
+
+/*******************************************************************************
+ * Runs against the serial program
+ ******************************************************************************/
+
+// Programs under test (imcon and imcon-serial) and MPI launcher
+static char binDir[4096];
+static const char *mpiExec;
+// Options of the input image
+static char imageArgs[256];
+
+static void writeImage(int width, int height, int pixelSize,
+    const char *sampleType)
+{
+    int i, n;
+    unsigned char u8;
+    unsigned short u16;
+    float f32;
+    FILE *file;
+
+    // Random samples (the same ones on every run)
+    file = fopen(IMAGE_PATH, "wb");
+    if (file == NULL)
+        return;
+    srand(42);
+    n = width * height * pixelSize;
+    for (i = 0; i < n; i++) {
+        if (strcmp(sampleType, "u16") == 0) {
+            u16 = rand() % 65536;
+            fwrite(&u16, sizeof(u16), 1, file);
+        } else if (strcmp(sampleType, "f32") == 0) {
+            f32 = (rand() % 25600) / 100.0f;
+            fwrite(&f32, sizeof(f32), 1, file);
+        } else {
+            u8 = rand() % 256;
+            fwrite(&u8, sizeof(u8), 1, file);
+        }
+    }
+    fclose(file);
+    snprintf(imageArgs, sizeof(imageArgs), "-d %s -x %d -y %d -s %d -f %s",
+        IMAGE_PATH, width, height, pixelSize, sampleType);
+}
+
+static void writeMatrix(const char *path, int k, int integer, int append)
+{
+    int i, j;
+    FILE *file;
+
+    // Random weights, of both signs, which both programs apply as they are.
+    //  A bank separates its matrices with a blank line.
+    file = fopen(path, append ? "a" : "w");
+    if (file == NULL)
+        return;
+    if (append)
+        fprintf(file, "\n");
+    srand(k + append);
+    for (i = 0; i < k; i++)
+        for (j = 0; j < k; j++)
+            if (integer)
+                fprintf(file, "%d%c", rand() % 9 - 3, (j < k - 1) ? ' ' : '\n');
+            else
+                fprintf(file, "%.4f%c", (rand() % 200 - 50) / (100.0 * k * k),
+                    (j < k - 1) ? ' ' : '\n');
+    fclose(file);
+}
+
+static long getDifferentBytes(const char *pathA, const char *pathB)
+{
+    int a, b;
+    long n, retVal;
+    FILE *fileA, *fileB;
+
+    // -1 if a file is missing or empty, or the sizes differ
+    fileA = fopen(pathA, "rb");
+    fileB = fopen(pathB, "rb");
+    retVal = (fileA == NULL || fileB == NULL) ? -1 : 0;
+    for (n = 0; retVal >= 0; n++) {
+        a = fgetc(fileA);
+        b = fgetc(fileB);
+        if (a == EOF || b == EOF) {
+            if (a != b || n == 0)
+                retVal = -1;
+            break;
+        }
+        retVal += a != b;
+    }
+    if (fileA != NULL) fclose(fileA);
+    if (fileB != NULL) fclose(fileB);
+
+    return retVal;
+}
+
+static int compareRun(int np, const char *args)
+{
+    int status;
+    long diff;
+    char cmd[8192];
+
+    // Same output as the serial program, byte for byte
+    snprintf(cmd, sizeof(cmd), "%s/imcon-serial -o %s %s %s > /dev/null 2>&1",
+        binDir, SERIAL_PATH, imageArgs, args);
+    status = system(cmd);
+    remove(MPI_PATH);
+    snprintf(cmd, sizeof(cmd), "%s -np %d %s/imcon -o %s %s %s > /dev/null "
+        "2>&1", mpiExec, np, binDir, MPI_PATH, imageArgs, args);
+    status |= system(cmd);
+    diff = getDifferentBytes(SERIAL_PATH, MPI_PATH);
+    printf("MPI (%d process(es), %s %s) vs serial: %ld different byte(s)%s\n",
+        np, imageArgs, args, diff, (status != 0) ? " (failed to run)" : "");
+
+    return status == 0 && diff == 0;
+}
+
+/*******************************************************************************
+ * Iterations with deep halos
+ ******************************************************************************/
+
+static int testDeepHalos()
+{
+    int k, failed;
+    char args[256];
+    const char *halos[4] = {"auto", "1", "2", "3"};
+    const char *borders[4] = {"clamp", "wrap", "mirror", "zero"};
+
+    // Halos of 1 to 3 iterations, and the ones picked from the measured
+    //  costs, with every border mode and both stopping criteria
+    failed = 0;
+    writeImage(96, 64, 3, "u8");
+    writeMatrix("k5.txt", 5, 0, 0);
+    for (k = 0; k <= 3; k++) {
+        snprintf(args, sizeof(args), "-m k5.txt -i 7 -k %s -b %s",
+            halos[k], borders[k]);
+        failed |= !compareRun(2 + k % 3, args);
+    }
+    failed |= !compareRun(3, "-m k5.txt -i 9 -k 2 -c l2 -E 60");
+    failed |= !compareRun(4, "-m k5.txt -i 9 -c max -E 2 -b wrap");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Blocks
+ ******************************************************************************/
+
+static int testBlocks()
+{
+    int failed;
+
+    // Grids of 2 to 3 workers per side, then float samples on an odd width
+    //  (blocks of other widths than the serial rows) with a non-symmetric
+    //  filter, split on request or picked, and iterations stopping on float
+    //  changes of less than a level
+    failed = 0;
+    writeImage(96, 64, 3, "u8");
+    writeMatrix("k5.txt", 5, 0, 0);
+    failed |= !compareRun(5, "-m k5.txt -p blocks");
+    failed |= !compareRun(7, "-m k5.txt -p blocks -b wrap -l planar");
+    failed |= !compareRun(10, "-m k5.txt -p blocks -b mirror -i 4");
+    failed |= !compareRun(5, "-m k5.txt -p blocks -i 9 -c l2 -E 60");
+    writeImage(97, 83, 3, "f32");
+    writeMatrix("i7.txt", 7, 1, 0);
+    failed |= !compareRun(4, "-m i7.txt -p blocks");
+    failed |= !compareRun(7, "-m i7.txt -p blocks -b wrap -i 2");
+    failed |= !compareRun(4, "-m i7.txt");
+    failed |= !compareRun(7, "-m i7.txt");
+    failed |= !compareRun(6, "-g 1 -p blocks -i 60 -k 1 -c max -E 0.9");
+    failed |= !compareRun(5, "-g 1 -p blocks -i 60 -k 1 -c l2 -E 60");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Resident strips
+ ******************************************************************************/
+
+static int testResident()
+{
+    int failed;
+
+    // Resident strips, their halos exchanged while the inner rows run, with
+    //  deep halos, every layout and 16-bit samples
+    failed = 0;
+    writeImage(96, 64, 3, "u8");
+    writeMatrix("k5.txt", 5, 0, 0);
+    failed |= !compareRun(4, "-m k5.txt -R");
+    failed |= !compareRun(4, "-m k5.txt -R -i 5 -b wrap");
+    failed |= !compareRun(3, "-m k5.txt -R -i 7 -k 3 -b mirror");
+    failed |= !compareRun(5, "-m k5.txt -R -i 6 -l planar -b wrap");
+    failed |= !compareRun(4, "-m k5.txt -R -i 9 -c max -E 2");
+    writeImage(96, 64, 3, "u16");
+    failed |= !compareRun(3, "-m k5.txt -R -i 4 -b wrap");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Share of the root process
+ ******************************************************************************/
+
+static int testRootShare()
+{
+    int failed;
+
+    // Root strips of no rows, of a worker's share and more, then a single
+    //  process that runs the whole image, whatever its share, and a root
+    //  strip stopping on float changes of less than a level
+    failed = 0;
+    writeImage(96, 64, 3, "u8");
+    writeMatrix("k5.txt", 5, 0, 0);
+    failed |= !compareRun(4, "-m k5.txt -r 0");
+    failed |= !compareRun(4, "-m k5.txt -r 1 -b wrap");
+    failed |= !compareRun(3, "-m k5.txt -r 2.5 -i 5 -b mirror");
+    failed |= !compareRun(4, "-m k5.txt -r 0 -R -i 4 -b wrap");
+    failed |= !compareRun(1, "-m k5.txt");
+    failed |= !compareRun(1, "-m k5.txt -r 0");
+    failed |= !compareRun(1, "-m k5.txt -r 0 -i 3 -b wrap");
+    failed |= !compareRun(1, "-m k5.txt -R -i 4 -b mirror");
+    failed |= !compareRun(1, "-m k5.txt -P 16");
+    writeImage(97, 83, 3, "f32");
+    failed |= !compareRun(4, "-g 1 -p strips -i 60 -k 1 -c max -E 0.9");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Collectives
+ ******************************************************************************/
+
+static int testCollectives()
+{
+    int failed;
+
+    // Strips of uneven heights scattered and gathered at once, for every
+    //  pixel size, layout and sample type, and for a bank of filters
+    failed = 0;
+    writeMatrix("k5.txt", 5, 0, 0);
+    writeMatrix("bank.txt", 3, 0, 0);
+    writeMatrix("bank.txt", 5, 0, 1);
+    writeImage(96, 61, 3, "u8");
+    failed |= !compareRun(4, "-m k5.txt -p strips");
+    failed |= !compareRun(5, "-m k5.txt -p strips -l planar -b wrap");
+    failed |= !compareRun(3, "-m bank.txt -p strips");
+    writeImage(53, 47, 1, "u8");
+    failed |= !compareRun(6, "-m k5.txt -p strips -b mirror");
+    writeImage(53, 47, 4, "u16");
+    failed |= !compareRun(4, "-m k5.txt -p strips");
+    writeImage(53, 47, 3, "f32");
+    failed |= !compareRun(3, "-m k5.txt -p strips -l planar");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Strip buffers
+ ******************************************************************************/
+
+static int testStripBuffers()
+{
+    int failed;
+
+    // Workers holding their strip and halos only: halos deeper than the
+    //  strips (whose wrapped rows come from the opposite edge), then an image
+    //  thinner than the filter radius (wrapped several times)
+    failed = 0;
+    writeMatrix("k15.txt", 15, 0, 0);
+    writeImage(96, 20, 3, "u8");
+    failed |= !compareRun(6, "-m k15.txt -p strips");
+    failed |= !compareRun(6, "-m k15.txt -p strips -b wrap -r 0");
+    failed |= !compareRun(7, "-m k15.txt -p strips -b wrap -M");
+    failed |= !compareRun(3, "-m k15.txt -p strips -b mirror -i 3");
+    writeImage(96, 3, 3, "u8");
+    failed |= !compareRun(3, "-m k15.txt -b wrap");
+    failed |= !compareRun(4, "-m k15.txt -b wrap -r 0 -M");
+    failed |= !compareRun(3, "-m k15.txt -b mirror -r 0");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Parallel I/O
+ ******************************************************************************/
+
+static int testMpiIo()
+{
+    int failed;
+
+    // Strips read and written by every process, with the root one or not,
+    //  iterations, resident strips, a bank and every sample type
+    failed = 0;
+    writeMatrix("k5.txt", 5, 0, 0);
+    writeMatrix("bank.txt", 3, 0, 0);
+    writeMatrix("bank.txt", 5, 0, 1);
+    writeImage(96, 61, 3, "u8");
+    failed |= !compareRun(2, "-m k5.txt -M");
+    failed |= !compareRun(4, "-m k5.txt -M -b wrap -r 0");
+    failed |= !compareRun(4, "-m k5.txt -M -i 6 -k 2 -b mirror");
+    failed |= !compareRun(4, "-m k5.txt -M -R -i 5 -b wrap");
+    failed |= !compareRun(3, "-m bank.txt -M -l planar -b wrap");
+    writeImage(96, 61, 3, "u16");
+    failed |= !compareRun(3, "-m k5.txt -M -i 3");
+    writeImage(96, 61, 3, "f32");
+    failed |= !compareRun(5, "-m k5.txt -M -b wrap -r 2.5");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Tiles
+ ******************************************************************************/
+
+static int testTiles()
+{
+    int failed;
+
+    // Tiles of one row to more than the image, handed out to the workers
+    //  and the root process (or not), then tiles thinner than the filter
+    //  radius on an image thinner than it
+    failed = 0;
+    writeMatrix("k5.txt", 5, 0, 0);
+    writeMatrix("k15.txt", 15, 0, 0);
+    writeMatrix("bank.txt", 3, 0, 0);
+    writeMatrix("bank.txt", 5, 0, 1);
+    writeImage(96, 64, 3, "u8");
+    failed |= !compareRun(3, "-m k5.txt -p tiles");
+    failed |= !compareRun(4, "-m k5.txt -p tiles -D 1 -b wrap -r 0");
+    failed |= !compareRun(4, "-m k15.txt -p tiles -D 5 -b wrap -l planar");
+    failed |= !compareRun(5, "-m k15.txt -p tiles -D 100 -b mirror");
+    failed |= !compareRun(6, "-m bank.txt -p tiles -D 7 -b wrap");
+    writeImage(96, 64, 3, "u16");
+    failed |= !compareRun(3, "-m k5.txt -p tiles -D 3");
+    writeImage(96, 3, 3, "f32");
+    failed |= !compareRun(3, "-m k15.txt -p tiles -D 1 -b wrap");
+    failed |= !compareRun(4, "-m k15.txt -p tiles -D 2 -b mirror -r 0");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Chunks
+ ******************************************************************************/
+
+static int testChunks()
+{
+    int failed;
+
+    // Strips streamed in chunks of one row to more than a strip, thinner
+    //  than the filter radius or not, with and without a root strip, then
+    //  strips thinner than their halos
+    failed = 0;
+    writeMatrix("k5.txt", 5, 0, 0);
+    writeMatrix("k15.txt", 15, 0, 0);
+    writeMatrix("bank.txt", 3, 0, 0);
+    writeMatrix("bank.txt", 5, 0, 1);
+    writeImage(96, 64, 3, "u8");
+    failed |= !compareRun(2, "-m k5.txt -P 4");
+    failed |= !compareRun(3, "-m k5.txt -P 4 -r 0");
+    failed |= !compareRun(7, "-m k5.txt -P 1 -b mirror -r 0");
+    failed |= !compareRun(4, "-m k15.txt -P 2 -b wrap -r 0");
+    failed |= !compareRun(5, "-m k15.txt -P 3 -b wrap -r 2.5 -l planar");
+    failed |= !compareRun(3, "-m bank.txt -P 50");
+    failed |= !compareRun(6, "-m bank.txt -P 7 -b wrap -l planar");
+    writeImage(96, 64, 3, "u16");
+    failed |= !compareRun(3, "-m k5.txt -P 6 -b clamp");
+    writeImage(96, 64, 3, "f32");
+    failed |= !compareRun(3, "-m k5.txt -P 4 -b wrap");
+    writeImage(96, 20, 3, "u8");
+    failed |= !compareRun(6, "-m k15.txt -P 2 -b wrap -r 0");
+    failed |= !compareRun(4, "-m k15.txt -P 1 -b mirror");
+
+    return !failed;
+}
+
+/*******************************************************************************
+ * Comparisons
+ ******************************************************************************/
+
+static int runComparisons(const char *dir)
+{
+    char workDir[] = "/tmp/imcon-mpi-XXXXXX";
+
+    // Programs of the given directory, run in a scratch directory
+    if (realpath(dir, binDir) == NULL || mkdtemp(workDir) == NULL
+        || chdir(workDir) != 0) {
+        printf("Failed to prepare the runs!\n");
+        return 1;
+    }
+    mpiExec = getenv("MPIEXEC");
+    if (mpiExec == NULL)
+        mpiExec = "mpirun";
+
+    // Iterations with deep halos test
+    if (!testDeepHalos()) {
+        printf("Deep halos test failed!\n");
+        return 1;
+    }
+
+    // Blocks test
+    if (!testBlocks()) {
+        printf("Blocks test failed!\n");
+        return 1;
+    }
+
+    // Resident strips test
+    if (!testResident()) {
+        printf("Resident strips test failed!\n");
+        return 1;
+    }
+
+    // Root share test
+    if (!testRootShare()) {
+        printf("Root share test failed!\n");
+        return 1;
+    }
+
+    // Collectives test
+    if (!testCollectives()) {
+        printf("Collectives test failed!\n");
+        return 1;
+    }
+
+    // Strip buffers test
+    if (!testStripBuffers()) {
+        printf("Strip buffers test failed!\n");
+        return 1;
+    }
+
+    // Parallel I/O test
+    if (!testMpiIo()) {
+        printf("Parallel I/O test failed!\n");
+        return 1;
+    }
+
+    // Tiles test
+    if (!testTiles()) {
+        printf("Tiles test failed!\n");
+        return 1;
+    }
+
+    // Chunks test
+    if (!testChunks()) {
+        printf("Chunks test failed!\n");
+        return 1;
+    }
+
+    // Clean (only after all the tests pass, to keep the files of a failure)
+    remove(IMAGE_PATH);
+    remove(SERIAL_PATH);
+    remove(MPI_PATH);
+    remove("k5.txt");
+    remove("i7.txt");
+    remove("bank.txt");
+    remove("k15.txt");
+    if (chdir("/") == 0)
+        rmdir(workDir);
+
+    return 0;
+}
+
 /*******************************************************************************
  * Random list generation
  ******************************************************************************/
@@ -40,7 +503,12 @@ int main(int argc, char **argv)
     // Vars
     int i;
     int *data = NULL, *locData, dataSize, dataPerNode;
-    long sum, *sums;
+    long sum, *sums = NULL;
+
+    // Programs of a build directory against the serial one (launched
+    //  directly, as the runs start MPI programs of their own)
+    if (argc > 1)
+        return runComparisons(argv[1]);
 
     // Before MPI_Init
     printf("PID before MPI_Init: %d. PPID: %d\n", getpid(), getppid());
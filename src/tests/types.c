@@ -24,11 +24,30 @@ int main(int argc, char **argv)
     mat->values[2][1] = 1;
     mat->values[2][2] = 2;
 
+    // Matrix bank reading test (matrices separated by blank lines)
+    struct matrix_t *bank[3];
+    FILE *file;
+    file = tmpfile();
+    fprintf(file, "1 2 3\n4 5 6\n7 8 9\n\n\n1\n");
+    rewind(file);
+    bank[0] = mat_makeFromFile(file);
+    bank[1] = mat_makeFromFile(file);
+    bank[2] = mat_makeFromFile(file);
+    fclose(file);
+    if (bank[0] == NULL || bank[0]->height != 3 || bank[0]->values[2][2] != 9
+        || bank[1] == NULL || bank[1]->width != 1 || bank[2] != NULL) {
+        printf("Failed to read a bank of matrices!\n");
+        mat_destroy(mat);
+        return 1;
+    }
+    mat_destroy(bank[0]);
+    mat_destroy(bank[1]);
+
     // Image creation test
     struct image_t *img, *croppedImg;
-    FILE *file;
     file = fopen("../test_datasets/in/colored.raw", "r");
-    img = img_makeFromFile(file, 1920, 2520, 3);
+    img = img_makeFromFile(file, 1920, 2520, 3, IMG_LAYOUT_INTERLEAVED,
+        IMG_SAMPLE_U8);
     fclose(file);
     if (img == NULL) {
         printf("Failed to initialize image!\n");